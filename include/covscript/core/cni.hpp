@@ -244,6 +244,11 @@ namespace cs_impl {
 			return sizeof...(_Source_ArgsT);
 		}
 
+		const std::type_info &return_type() const noexcept
+		{
+			return typeid(void);
+		}
+
 		any call(cs::vector &args) const
 		{
 			if (args.size() != sizeof...(_Target_ArgsT))
@@ -279,6 +284,12 @@ namespace cs_impl {
 			return sizeof...(_Source_ArgsT);
 		}
 
+		// Type of the value handed back to CovScript, cs::var if it is only known at runtime
+		const std::type_info &return_type() const noexcept
+		{
+			return typeid(_Source_RetT);
+		}
+
 		any call(cs::vector &args) const
 		{
 			if (args.size() != sizeof...(_Target_ArgsT))
@@ -301,6 +312,8 @@ namespace cs_impl {
 
 		virtual std::size_t argument_count() const noexcept = 0;
 
+		virtual const std::type_info &return_type() const noexcept = 0;
+
 		virtual cni_holder_base *clone() = 0;
 
 		virtual any call(cs::vector &) const = 0;
@@ -323,6 +336,11 @@ namespace cs_impl {
 			return mCni.argument_count();
 		}
 
+		const std::type_info &return_type() const noexcept override
+		{
+			return mCni.return_type();
+		}
+
 		cni_holder_base *clone() override
 		{
 			return new cni_holder(*this);
@@ -404,6 +422,11 @@ namespace cs_impl {
 			return mCni->argument_count();
 		}
 
+		const std::type_info &return_type() const noexcept
+		{
+			return mCni->return_type();
+		}
+
 		any operator()(cs::vector &args) const
 		{
 			try {
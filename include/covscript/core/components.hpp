@@ -25,6 +25,7 @@
 * Website: http://covscript.org.cn
 */
 #include <covscript/import/mozart/base.hpp>
+#include <vector>
 
 namespace cs {
 // Exceptions
@@ -361,45 +362,98 @@ namespace cs {
 	};
 
 // Buffer Pool
+	struct allocator_stats final {
+		const char *name = nullptr;
+		std::size_t alloc_count = 0;
+		// Allocations served from the pool
+		std::size_t pool_hits = 0;
+		std::size_t live = 0;
+		std::size_t peak = 0;
+	};
+
+	// Named buffer pools of this binary which have allocated, entries are never removed
+	inline std::vector<const allocator_stats *> &allocator_registry()
+	{
+		static std::vector<const allocator_stats *> registry;
+		return registry;
+	}
+
+	// Allocations of every named buffer pool, a value with a proxy and a holder counts twice
+	inline std::size_t allocator_total()
+	{
+		std::size_t count = 0;
+		for (auto it:allocator_registry())
+			count += it->alloc_count;
+		return count;
+	}
+
 	template<typename T, std::size_t blck_size, template<typename> class allocator_t=std::allocator>
 	class allocator_type final {
-		T *mPool[blck_size];
-		allocator_t<T> mAlloc;
+		T *mPool[blck_size] = {};
 		std::size_t mOffset = 0;
-	public:
-		allocator_type()
+		allocator_stats mStats;
+		// Named pools register their statistics on the first allocation
+		const char *(*mName)() = nullptr;
+
+		void register_stats()
 		{
-			while (mOffset < 0.5 * blck_size)
-				mPool[mOffset++] = mAlloc.allocate(1);
+			if (mName != nullptr) {
+				mStats.name = mName();
+				allocator_registry().push_back(&mStats);
+			}
 		}
+	public:
+		// Constant initialized, so the pool is ready before the dynamic initialization of any unit
+		constexpr allocator_type() = default;
+
+		explicit constexpr allocator_type(const char *(*name)()) : mName(name) {}
 
 		allocator_type(const allocator_type &) = delete;
 
 		~allocator_type()
 		{
 			while (mOffset > 0)
-				mAlloc.deallocate(mPool[--mOffset], 1);
+				allocator_t<T>().deallocate(mPool[--mOffset], 1);
 		}
 
 		template<typename...ArgsT>
 		inline T *alloc(ArgsT &&...args)
 		{
+			allocator_t<T> alloc;
 			T *ptr = nullptr;
-			if (mOffset > 0)
+			if (mOffset > 0) {
 				ptr = mPool[--mOffset];
+				++mStats.pool_hits;
+			}
 			else
-				ptr = mAlloc.allocate(1);
-			mAlloc.construct(ptr, std::forward<ArgsT>(args)...);
+				ptr = alloc.allocate(1);
+			alloc.construct(ptr, std::forward<ArgsT>(args)...);
+			if (mStats.alloc_count++ == 0)
+				register_stats();
+			if (++mStats.live > mStats.peak)
+				mStats.peak = mStats.live;
 			return ptr;
 		}
 
 		inline void free(T *ptr)
 		{
-			mAlloc.destroy(ptr);
+			allocator_t<T> alloc;
+			alloc.destroy(ptr);
+			--mStats.live;
 			if (mOffset < blck_size)
 				mPool[mOffset++] = ptr;
 			else
-				mAlloc.deallocate(ptr, 1);
+				alloc.deallocate(ptr, 1);
+		}
+
+		std::size_t alloc_count() const noexcept
+		{
+			return mStats.alloc_count;
+		}
+
+		const allocator_stats &stats() const noexcept
+		{
+			return mStats;
 		}
 	};
 
@@ -52,10 +52,12 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <limits>
 #include <istream>
 #include <ostream>
 #include <utility>
 #include <cstring>
+#include <cstddef>
 #include <atomic>
 #include <cctype>
 #include <string>
@@ -85,12 +87,21 @@ namespace cs {
 		int exit_code = 0;
 // Import Path
 		std::string import_path = ".";
+// Module Cache Path, disabled if empty
+		std::string module_cache_path;
+// Defer code generation of file-level function bodies to their first call
+		bool lazy_compile = false;
+// Profiler of the running scripts, disabled if null
+		profiler *profiling = nullptr;
+// Runtime Statistics, see runtime.stats
+		std::size_t copy_count = 0;
 // Stack
 		std::size_t stack_size = 1000;
 
 		stack_type<var> stack;
 #ifdef CS_DEBUGGER
-		stack_type<std::string> stack_backtrace;
+		// Functions being called, declarations are only formatted when the debugger shows them
+		stack_type<const function *> stack_backtrace;
 #endif
 
 // Stack Resize must before any context instance start
@@ -172,7 +183,7 @@ namespace cs {
 	public:
 		using function_type = std::function<var(vector &)>;
 		enum class types {
-			normal, request_fold, member_fn, member_visitor, force_regular
+			normal, request_fold, member_fn, member_visitor, force_regular, member_visitor_fold
 		};
 	private:
 		function_type mFunc;
@@ -216,13 +227,28 @@ namespace cs {
 		// Debug Information
 		mutable bool mMatch = false;
 		std::string mDecl;
-		statement_base *mStmt;
 #endif
+		// Statement which declares this function, also used to name profiler frames
+		statement_base *mStmt;
 		bool mIsLambda = false;
 		bool mIsMemFn = false;
 		bool mIsVargs = false;
 		std::vector<std::string> mArgs;
-		std::deque<statement_base *> mBody;
+		mutable std::deque<statement_base *> mBody;
+		// Statement which generates the body on first call, see statement_function::defer_block
+		mutable statement_base *mLazy = nullptr;
+		// Unit of the declaring statement, whose statements have to outlive the function
+		unit_t mUnit;
+
+		void load_body() const;
+		// Expression-bodied functions that only read their arguments run without a scope
+		enum class inline_state {
+			unknown, enabled, disabled
+		};
+		mutable inline_state mInline = inline_state::unknown;
+
+		bool inlinable() const;
+
 	public:
 		function() = delete;
 
@@ -234,9 +260,9 @@ namespace cs {
 			mIsLambda(is_lambda), mArgs(std::move(args)), mBody(std::move(body)) {}
 #else
 
-		function(context_t c, std::vector<std::string> args, std::deque<statement_base *> body, bool is_vargs = false,
-		         bool is_lambda = false)
-			: mContext(std::move(c)), mIsVargs(is_vargs), mIsLambda(is_lambda), mArgs(std::move(args)),
+		function(context_t c, statement_base *stmt, std::vector<std::string> args, std::deque<statement_base *> body,
+		         bool is_vargs = false, bool is_lambda = false)
+			: mContext(std::move(c)), mStmt(stmt), mIsVargs(is_vargs), mIsLambda(is_lambda), mArgs(std::move(args)),
 			  mBody(std::move(body)) {}
 
 #endif
@@ -282,17 +308,32 @@ namespace cs {
 			return mArgs.size();
 		}
 
-#ifdef CS_DEBUGGER
-		const std::string& get_declaration() const
+		bool is_vargs() const noexcept
 		{
-			return mDecl;
+			return mIsVargs;
 		}
 
-		statement_base* get_raw_statement() const
+		void defer_body(statement_base *stmt) noexcept
+		{
+			mLazy = stmt;
+		}
+
+		void hold_unit(unit_t unit) noexcept
+		{
+			mUnit = std::move(unit);
+		}
+
+		statement_base *get_raw_statement() const
 		{
 			return mStmt;
 		}
 
+#ifdef CS_DEBUGGER
+		const std::string& get_declaration() const
+		{
+			return mDecl;
+		}
+
 		void set_debugger_state(bool match) const
 		{
 			mMatch=match;
@@ -436,6 +477,8 @@ namespace cs {
 	};
 
 	class domain_type final {
+		// Constant initialized, domains of the builtin namespaces are built before any process context
+		static std::size_t mCount;
 		map_t<std::string, std::size_t> m_reflect;
 		std::shared_ptr<domain_ref> m_ref;
 		std::vector<var> m_slot;
@@ -449,10 +492,16 @@ namespace cs {
 		}
 
 	public:
-		domain_type() : m_ref(std::make_shared<domain_ref>(this)) {}
+		domain_type() : m_ref(std::make_shared<domain_ref>(this))
+		{
+			++mCount;
+		}
 
 		domain_type(const domain_type &domain) : m_reflect(domain.m_reflect), m_ref(std::make_shared<domain_ref>(this)),
-			m_slot(domain.m_slot) {}
+			m_slot(domain.m_slot)
+		{
+			++mCount;
+		}
 
 		domain_type(domain_type &&domain) noexcept: m_ref(std::make_shared<domain_ref>(this))
 		{
@@ -465,6 +514,21 @@ namespace cs {
 			m_ref->domain = nullptr;
 		}
 
+		// Domains created so far, see runtime.stats
+		static std::size_t created_count() noexcept
+		{
+			return mCount;
+		}
+
+		// Take over a copy of another domain, ids resolved against the old contents are invalidated
+		void assign(const domain_type &domain)
+		{
+			m_ref->domain = nullptr;
+			m_ref = std::make_shared<domain_ref>(this);
+			m_reflect = domain.m_reflect;
+			m_slot = domain.m_slot;
+		}
+
 		void clear()
 		{
 			m_reflect.clear();
@@ -790,6 +854,7 @@ namespace cs {
 		std::string mName;
 		tree_type<token_base *> mParent;
 		std::deque<statement_base *> mMethod;
+		unit_t mUnit;
 	public:
 		struct_builder() = delete;
 
@@ -814,6 +879,11 @@ namespace cs {
 			return mTypeId;
 		}
 
+		void hold_unit(unit_t unit) noexcept
+		{
+			mUnit = std::move(unit);
+		}
+
 		var operator()();
 	};
 
@@ -935,6 +1005,263 @@ namespace cs {
 		}
 	};
 
+// Compiler Node Arena
+	template<typename T>
+	class memory_arena final {
+		static constexpr std::size_t chunk_size = 64 * 1024;
+		static constexpr std::size_t alignment = alignof(std::max_align_t);
+		std::vector<void *> chunks;
+		char *cursor = nullptr, *limit = nullptr;
+		std::size_t used = 0, retained = 0, retained_used = 0;
+		std::size_t nodes = 0, retained_nodes = 0;
+
+		static constexpr std::size_t align(std::size_t size)
+		{
+			return (size + alignment - 1) & ~(alignment - 1);
+		}
+
+	public:
+		memory_arena() = default;
+
+		memory_arena(const memory_arena &) = delete;
+
+		~memory_arena()
+		{
+			retained = retained_used = retained_nodes = 0;
+			collect();
+		}
+
+		void *allocate(std::size_t size)
+		{
+			size = align(size);
+			used += size;
+			++nodes;
+			// Oversized nodes get a chunk of their own so the current one stays usable
+			if (size > chunk_size / 4) {
+				void *ptr = ::operator new(size);
+				chunks.push_back(ptr);
+				return ptr;
+			}
+			if (cursor == nullptr || static_cast<std::size_t>(limit - cursor) < size) {
+				cursor = static_cast<char *>(::operator new(chunk_size));
+				limit = cursor + chunk_size;
+				chunks.push_back(cursor);
+			}
+			void *ptr = cursor;
+			cursor += size;
+			return ptr;
+		}
+
+		// Only the most recent allocation can be handed back, which covers a constructor throwing
+		void deallocate(void *ptr, std::size_t size) noexcept
+		{
+			size = align(size);
+			if (static_cast<char *>(ptr) + size == cursor) {
+				cursor = static_cast<char *>(ptr);
+				used -= size;
+				--nodes;
+			}
+		}
+
+		// Everything allocated so far survives collect(), for data shared by all contexts
+		void retain() noexcept
+		{
+			retained = chunks.size();
+			retained_used = used;
+			retained_nodes = nodes;
+			cursor = limit = nullptr;
+		}
+
+		void collect()
+		{
+			for (std::size_t i = retained; i < chunks.size(); ++i)
+				::operator delete(chunks[i]);
+			chunks.resize(retained);
+			cursor = limit = nullptr;
+			used = retained_used;
+			nodes = retained_nodes;
+		}
+
+		std::size_t bytes_used() const noexcept
+		{
+			return used;
+		}
+
+		std::size_t chunk_count() const noexcept
+		{
+			return chunks.size();
+		}
+
+		// Nodes allocated since the last collection, retained ones included
+		std::size_t node_count() const noexcept
+		{
+			return nodes;
+		}
+	};
+
+// Compile Unit
+	/*
+	 * Tokens and statements of one module, eval or REPL statement. While a unit is selected
+	 * through compile_unit::scope, token_base and statement_base are allocated from its arenas
+	 * and everything is destroyed together once the last reference to the unit is dropped.
+	 * Functions and structs hold a reference to the unit they were declared in.
+	 * Lambdas are folded into a token of their own unit, so they hold it through an anchor instead:
+	 * the owning context drops every anchor when it releases its units, which breaks the cycle.
+	 */
+	class compile_unit final : public std::enable_shared_from_this<compile_unit> {
+		static compile_unit *m_current;
+		static std::size_t m_token_count, m_statement_count, m_bytes;
+
+		memory_arena<token_base> m_token_arena;
+		memory_arena<statement_base> m_statement_arena;
+		std::vector<token_base *> m_tokens;
+		std::vector<statement_base *> m_statements;
+		std::vector<std::weak_ptr<unit_t>> m_anchors;
+		std::size_t m_size = 0;
+
+		compile_unit() = default;
+
+		// Units dropped while a profiler is attached are kept by it, its records point into them
+		static void release(compile_unit *);
+
+	public:
+		class scope final {
+			compile_unit *m_saved;
+		public:
+			scope() = delete;
+
+			explicit scope(compile_unit *unit) noexcept : m_saved(m_current)
+			{
+				m_current = unit;
+			}
+
+			scope(const scope &) = delete;
+
+			~scope()
+			{
+				m_current = m_saved;
+			}
+		};
+
+		static unit_t create()
+		{
+			return unit_t(new compile_unit, release);
+		}
+
+		// Null for code compiled outside of any unit, which lives in the global arenas
+		static compile_unit *current() noexcept
+		{
+			return m_current;
+		}
+
+		static unit_t hold(compile_unit *unit)
+		{
+			return unit == nullptr ? nullptr : unit->shared_from_this();
+		}
+
+		// Reference from a value stored inside the unit itself, it keeps the unit alive until release_anchors()
+		static unit_t hold_from_inside(compile_unit *unit)
+		{
+			if (unit == nullptr)
+				return nullptr;
+			std::shared_ptr<unit_t> anchor = std::make_shared<unit_t>(unit->shared_from_this());
+			unit->m_anchors.push_back(anchor);
+			return unit_t(anchor, anchor->get());
+		}
+
+		bool has_anchors() const noexcept
+		{
+			return !m_anchors.empty();
+		}
+
+		// Caller must hold the unit, dropping the anchors may drop every other reference to it
+		void release_anchors() noexcept
+		{
+			std::vector<std::weak_ptr<unit_t>> anchors;
+			anchors.swap(m_anchors);
+			for (auto &it:anchors) {
+				std::shared_ptr<unit_t> anchor = it.lock();
+				if (anchor)
+					anchor->reset();
+			}
+		}
+
+		compile_unit(const compile_unit &) = delete;
+
+		~compile_unit();
+
+		void *allocate_token(std::size_t size)
+		{
+			void *ptr = m_token_arena.allocate(size);
+			m_tokens.push_back(static_cast<token_base *>(ptr));
+			++m_token_count;
+			m_size += size;
+			m_bytes += size;
+			return ptr;
+		}
+
+		void *allocate_statement(std::size_t size)
+		{
+			void *ptr = m_statement_arena.allocate(size);
+			m_statements.push_back(static_cast<statement_base *>(ptr));
+			++m_statement_count;
+			m_size += size;
+			m_bytes += size;
+			return ptr;
+		}
+
+		// Constructor threw, the node is the last one allocated
+		void deallocate_token(void *ptr, std::size_t size) noexcept
+		{
+			if (!m_tokens.empty() && m_tokens.back() == ptr) {
+				m_tokens.pop_back();
+				--m_token_count;
+				m_size -= size;
+				m_bytes -= size;
+			}
+			m_token_arena.deallocate(ptr, size);
+		}
+
+		void deallocate_statement(void *ptr, std::size_t size) noexcept
+		{
+			if (!m_statements.empty() && m_statements.back() == ptr) {
+				m_statements.pop_back();
+				--m_statement_count;
+				m_size -= size;
+				m_bytes -= size;
+			}
+			m_statement_arena.deallocate(ptr, size);
+		}
+
+		// Nodes and bytes held by all live units
+		static std::size_t token_count() noexcept
+		{
+			return m_token_count;
+		}
+
+		static std::size_t statement_count() noexcept
+		{
+			return m_statement_count;
+		}
+
+		static std::size_t bytes_used() noexcept
+		{
+			return m_bytes;
+		}
+	};
+
+	// Expression compiled at runtime, keeps the unit of its tokens alive
+	class expression_t final {
+	public:
+		tree_type<token_base *> tree;
+		unit_t unit;
+
+		tree_type<token_base *>::iterator root() const
+		{
+			return tree.root();
+		}
+	};
+
 	namespace dll_resources {
 		constexpr char dll_compatible_check[] = "__CS_ABI_COMPATIBLE__";
 		constexpr char dll_main_entrance[] = "__CS_EXTENSION_MAIN__";
@@ -68,10 +68,20 @@ namespace cs {
 
 	class callable;
 
+	class function;
+
 	class domain_type;
 
+	class profiler;
+
 	class name_space;
 
+	class compile_unit;
+
+	class expression_t;
+
+	class type_inference;
+
 #ifndef CS_COMPATIBILITY_MODE
 	template<typename _kT, typename _vT> using map_t = phmap::flat_hash_map<_kT, _vT>;
 	template<typename _Tp> using set_t = phmap::flat_hash_set<_Tp>;
@@ -89,10 +99,10 @@ namespace cs {
 	using hash_set = set_t<var>;
 	using hash_map = map_t<var, var>;
 	using vector = std::vector<var>;
-	using expression_t = tree_type<token_base *>;
 	using compiler_t = std::shared_ptr<compiler_type>;
 	using instance_t = std::shared_ptr<instance_type>;
 	using context_t = std::shared_ptr<context_type>;
+	using unit_t = std::shared_ptr<compile_unit>;
 	using domain_t = std::shared_ptr<domain_type>;
 	using namespace_t = std::shared_ptr<name_space>;
 	using char_buff = std::shared_ptr<std::stringstream>;
@@ -426,6 +426,11 @@ namespace cs_impl {
 			}
 		};
 
+		static const char *proxy_name()
+		{
+			return "cs_impl::any::proxy";
+		}
+
 		static default_allocator<proxy> allocator;
 		proxy *mDat = nullptr;
 
@@ -451,6 +456,12 @@ namespace cs_impl {
 		explicit any(proxy *dat) : mDat(dat) {}
 
 	public:
+		// Every new or copied-on-write value takes one proxy
+		static const cs::allocator_stats &proxy_stats() noexcept
+		{
+			return allocator.stats();
+		}
+
 		void swap(any &obj, bool raw = false)
 		{
 			if (this->mDat != nullptr && obj.mDat != nullptr && raw) {
@@ -608,6 +619,12 @@ namespace cs_impl {
 			return this->mDat != nullptr && this->mDat->protect_level > 1;
 		}
 
+		// True if a raw swap into this variable would be accepted
+		bool is_assignable() const
+		{
+			return this->mDat != nullptr && !this->mDat->is_rvalue && this->mDat->protect_level == 0;
+		}
+
 		bool is_single() const
 		{
 			return this->mDat != nullptr && this->mDat->protect_level > 2;
@@ -689,6 +706,13 @@ namespace cs_impl {
 			return static_cast<holder<T> *>(this->mDat->data)->data();
 		}
 
+		// For callers which have just compared type() themselves
+		template<typename T>
+		T &unchecked_val() const noexcept
+		{
+			return static_cast<holder<T> *>(this->mDat->data)->data();
+		}
+
 		template<typename T>
 		const T &const_val() const
 		{
@@ -774,7 +798,7 @@ namespace cs_impl {
 		using holder<std::type_index>::holder;
 	};
 
-	template<typename T> default_allocator<any::holder<T>> any::holder<T>::allocator;
+	template<typename T> default_allocator<any::holder<T>> any::holder<T>::allocator(get_name_of_type<T>);
 }
 
 std::ostream &operator<<(std::ostream &, const cs_impl::any &);
@@ -36,6 +36,6 @@
 #define COVSCRIPT_VERSION_STR "3.3.5 Manis pentadactyla(Stable) Build 24"
 #define COVSCRIPT_STD_VERSION 210503
 #define COVSCRIPT_API_VERSION 210504
-#define COVSCRIPT_ABI_VERSION 210503
+#define COVSCRIPT_ABI_VERSION 261019
 #define CS_VERSION_STR_MIXER(VER) #VER
 #define CS_GET_VERSION_STR(VER) CS_VERSION_STR_MIXER(VER)
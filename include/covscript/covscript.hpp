@@ -106,14 +106,64 @@ namespace cs {
 
 	context_t create_subcontext(const context_t &);
 
+	// Fork a context at its global scope, every global of the origin including imported packages is already defined.
+	// Constants, functions and types are shared, plain variables are copied, also inside namespaces and packages.
+	// Functions of the origin and its packages run in the origin, but see the copies of the fork when it calls them
+	// through eval, interpret or one of its own functions. The origin should not change while forks are in use.
+	context_t fork_context(const context_t &);
+
 	void collect_garbage();
 
 	void collect_garbage(context_t &);
 
 	cs::var eval(const context_t &, const std::string &);
 
+	// Memory telemetry of current process, also exported as runtime.stats
+	struct runtime_stats final {
+		// Pool of value proxies, one per live value
+		allocator_stats values;
+		// Pools of value storage, one per value type
+		std::vector<allocator_stats> types;
+		std::size_t domain_count = 0;
+		std::size_t copy_count = 0;
+		// Nodes held by the compiler arenas
+		std::size_t token_nodes = 0;
+		std::size_t statement_nodes = 0;
+		std::size_t method_nodes = 0;
+		// Zero if the platform does not report it
+		std::size_t resident_memory = 0;
+	};
+
+	runtime_stats get_runtime_stats();
+
 	using cs_function_invoker_impl::function_invoker;
 
+	// Hands out forks of a prepared context and takes them back for reuse.
+	// Code compiled in a fork is released when the fork is handed back, collect_garbage() releases the origin.
+	class context_pool final {
+		context_t m_origin;
+		std::vector<context_t> m_idle;
+		std::size_t m_capacity;
+	public:
+		context_pool() = delete;
+
+		explicit context_pool(context_t origin, std::size_t capacity = 16) : m_origin(std::move(origin)),
+			m_capacity(capacity) {}
+
+		context_pool(const context_pool &) = delete;
+
+		~context_pool();
+
+		context_t acquire();
+
+		void release(context_t &);
+
+		const context_t &get_origin() const noexcept
+		{
+			return m_origin;
+		}
+	};
+
 	class bootstrap final {
 	public:
 		context_t context;
@@ -56,6 +56,12 @@ namespace cs {
 			return *this;
 		}
 
+		translator_type &copy_methods(const translator_type &translator)
+		{
+			m_data = translator.m_data;
+			return *this;
+		}
+
 		method_base *match(const std::deque<token_base *> &raw)
 		{
 			if (raw.size() <= 1)
@@ -81,6 +87,32 @@ namespace cs {
 			return stack.front()->second;
 		}
 
+		// Match a line by its action tokens only, which is enough to tell blocks apart before the expressions are built
+		method_base *match_skeleton(const std::deque<token_base *> &raw)
+		{
+			for (auto &it:m_data) {
+				auto rule = it->first.begin(), rule_end = it->first.end();
+				bool matched = true;
+				for (auto &token:raw) {
+					if (token->get_type() != token_types::action)
+						continue;
+					while (rule != rule_end && (*rule)->get_type() != token_types::action)
+						++rule;
+					if (rule == rule_end || !compare(*rule, token)) {
+						matched = false;
+						break;
+					}
+					++rule;
+				}
+				for (; matched && rule != rule_end; ++rule)
+					if ((*rule)->get_type() == token_types::action)
+						matched = false;
+				if (matched)
+					return it->second;
+			}
+			return nullptr;
+		}
+
 		void match_grammar(const context_t &, std::deque<token_base *> &);
 
 		void translate(const context_t &, const std::deque<std::deque<token_base *>> &, std::deque<statement_base *> &,
@@ -123,16 +155,27 @@ namespace cs {
 		class preprocessor;
 
 		// Lexer
-		void process_char_buff(const std::deque<char> &, std::deque<token_base *> &, charset);
+		void process_char_buff(const char *, const char *, std::deque<token_base *> &, charset);
+
+		void process_char_buff(const std::deque<char> &buff, std::deque<token_base *> &tokens, charset encoding)
+		{
+			std::string str(buff.begin(), buff.end());
+			process_char_buff(str.data(), str.data() + str.size(), tokens, encoding);
+		}
 
 		void process_token_buff(std::deque<token_base *> &, std::deque<std::deque<token_base *>> &);
 
-		void translate_into_tokens(const std::deque<char> &, std::deque<token_base *> &, charset);
+		void translate_into_tokens(const char *, const char *, std::deque<token_base *> &, charset);
 
 		void process_empty_brackets(std::deque<token_base *> &);
 
 		void process_brackets(std::deque<token_base *> &);
 
+		// Module Cache
+		bool load_token_cache(const char *, const char *, std::deque<token_base *> &);
+
+		void save_token_cache(const char *, const char *, const std::deque<token_base *> &);
+
 		// AST Builder
 		int get_signal_level(token_base *ptr)
 		{
@@ -196,16 +239,28 @@ namespace cs {
 		void optimize_expression(tree_type<token_base *> &tree, optm_type do_optm = optm_type::normal)
 		{
 			trim_expr(tree, tree.root(), trim_type::normal);
-			if (!disable_optimizer && !no_optimize)
+			if (!disable_optimizer && !no_optimize) {
+				step_scope step("opt_expr");
 				opt_expr(tree, tree.root(), do_optm);
+				flatten_expr(tree, tree.root());
+			}
 		}
 
 		void trim_expr(tree_type<token_base *> &, tree_type<token_base *>::iterator, trim_type);
 
 		void opt_expr(tree_type<token_base *> &, tree_type<token_base *>::iterator, optm_type);
 
+		static bool is_pure_visitor(const var &, token_base *);
+
+		bool flatten_node(tree_type<token_base *>::iterator, token_flat &, std::size_t &, std::size_t &, bool= false);
+
+		void flatten_expr(tree_type<token_base *> &, tree_type<token_base *>::iterator);
+
 	public:
 		map_t<string, namespace_t> modules;
+		// Compiled files and the contexts of imported packages, released with the owning context
+		std::vector<unit_t> units;
+		std::vector<context_t> packages;
 
 		void try_fix_this_deduction(tree_type<token_base *>::iterator);
 
@@ -216,6 +271,12 @@ namespace cs {
 			struct_builder::reset_counter();
 		}
 
+		// Struct type ids keep counting in a fork, so they never collide with the ones of the origin
+		compiler_type(context_t c, const compiler_type &origin) : context(std::move(c))
+		{
+			fork(origin);
+		}
+
 		compiler_type(const compiler_type &) = delete;
 
 		~compiler_type() = default;
@@ -268,6 +329,19 @@ namespace cs {
 			gen_tree(tree, tokens);
 		}
 
+		// Tokens of the expression go into a unit of its own, see expression_t
+		void build_expr(const std::deque<char> &buff, expression_t &tree, charset encoding = charset::utf8)
+		{
+			unit_t unit = compile_unit::create();
+			{
+				compile_unit::scope scope(unit.get());
+				build_expr(buff, tree.tree, encoding);
+			}
+			if (unit->has_anchors())
+				units.push_back(unit);
+			tree.unit = std::move(unit);
+		}
+
 		void process_line(std::deque<token_base *> &line)
 		{
 			process_brackets(line);
@@ -287,20 +361,52 @@ namespace cs {
 				process_line(line);
 		}
 
-		void build_ast(const std::deque<char> &buff, std::deque<std::deque<token_base *>> &ast,
+		void build_ast(const char *begin, const char *end, std::deque<std::deque<token_base *>> &ast,
 		               charset encoding = charset::utf8)
 		{
-			std::deque<token_base *> tokens, tmp;
-			translate_into_tokens(buff, tokens, encoding);
+			std::deque<token_base *> tokens;
+			{
+				trace_scope trace("lex", context->file_path);
+				if (current_process->module_cache_path.empty())
+					translate_into_tokens(begin, end, tokens, encoding);
+				else if (!load_token_cache(begin, end, tokens)) {
+					translate_into_tokens(begin, end, tokens, encoding);
+					save_token_cache(begin, end, tokens);
+				}
+			}
+			trace_scope trace("parse", context->file_path);
 			process_token_buff(tokens, ast);
 		}
 
+		void build_ast(const std::deque<char> &buff, std::deque<std::deque<token_base *>> &ast,
+		               charset encoding = charset::utf8)
+		{
+			std::string str(buff.begin(), buff.end());
+			build_ast(str.data(), str.data() + str.size(), ast, encoding);
+		}
+
 		compiler_type &add_method(const std::deque<token_base *> &grammar, method_base *method)
 		{
 			translator.add_method(grammar, method);
 			return *this;
 		}
 
+		compiler_type &copy_grammar(const translator_type &grammar)
+		{
+			translator.copy_methods(grammar);
+			return *this;
+		}
+
+		// Grammar, settings and loaded modules of another compiler, see fork_context
+		void fork(const compiler_type &origin)
+		{
+			translator.copy_methods(origin.translator);
+			modules = origin.modules;
+			disable_optimizer = origin.disable_optimizer;
+			inside_lambda = false;
+			clear_metadata();
+		}
+
 		method_base *match_method(const std::deque<token_base *> &raw)
 		{
 			return translator.match(raw);
@@ -313,10 +419,126 @@ namespace cs {
 
 		void code_gen(const std::deque<std::deque<token_base *>> &ast, std::deque<statement_base *> &code)
 		{
+			trace_scope trace("code_gen", context->file_path);
 			translator.translate(context, ast, code, true);
 		}
 
+		void code_gen_deferred(const context_t &, const std::vector<std::string> &,
+		                       const std::deque<std::deque<token_base *>> &, std::deque<statement_base *> &);
+
+		// Specialize the operators of a function body, see type_inference
+		void infer_types(std::deque<statement_base *> &);
+
 		// AST Debugger
 		static void dump_expr(tree_type<token_base *>::iterator, std::ostream &);
 	};
+
+	/*
+	 * Flow-sensitive type inference over function bodies
+	 * Types are learnt from literals, folded constants, definitions and the signatures of CNI functions, then
+	 * followed through branches and loops. Operators whose operands are proven get a specialized signal.
+	 * Calls into script code forget everything, callees can reach the locals of their caller by name.
+	 * The specialized operators check their operands again and fall back to the generic ones, so a fact broken
+	 * behind the back of the pass (struct hooks, pointers, other threads) only costs time.
+	 */
+	class type_inference final {
+	public:
+		// Unknown types are represented by nullptr
+		using fact_t = const std::type_info *;
+	private:
+		struct state_type final {
+			bool reachable = true;
+			std::map<std::string, fact_t> facts;
+		};
+
+		struct loop_type final {
+			// Scopes of the enclosing code, the ones above belong to the loop
+			std::size_t depth;
+			state_type breaks, continues;
+		};
+
+		// Give up on loops whose facts are still changing after that many passes
+		static constexpr std::size_t max_iterations = 8;
+
+		state_type m_state;
+		// Names sharing their value with something else, links and pointers
+		set_t<std::string> m_aliased;
+		std::vector<std::vector<std::string>> m_scopes;
+		std::vector<loop_type> m_loops;
+		// Loop bodies are only rewritten on the last pass, once the facts have settled
+		bool m_emit = true;
+
+		static state_type unreachable()
+		{
+			state_type state;
+			state.reachable = false;
+			return state;
+		}
+
+		static bool same_state(const state_type &, const state_type &);
+
+		static void merge(state_type &, const state_type &);
+
+		void forget(state_type &, std::size_t) const;
+
+		fact_t lookup(const std::string &) const;
+
+		void assign(const std::string &, fact_t);
+
+		void alias(tree_type<token_base *>::iterator);
+
+		void specialize(tree_type<token_base *>::iterator, signal_types);
+
+		fact_t infer_call(tree_type<token_base *>::iterator);
+
+		state_type iterate(const state_type &, const std::function<void()> &, const std::function<void()> &,
+		                   const std::function<void()> &, bool, bool, state_type &);
+
+	public:
+		type_inference()
+		{
+			m_scopes.emplace_back();
+		}
+
+		type_inference(const type_inference &) = delete;
+
+		void clobber()
+		{
+			m_state.facts.clear();
+		}
+
+		// Return and throw
+		void terminate()
+		{
+			m_state.reachable = false;
+		}
+
+		// Break and continue
+		void jump(bool);
+
+		void enter_scope()
+		{
+			m_scopes.emplace_back();
+		}
+
+		void leave_scope();
+
+		void declare(const std::string &, fact_t);
+
+		// Variable definitions, either one or a parallel list
+		void define(tree_type<token_base *>::iterator, bool);
+
+		fact_t infer(tree_type<token_base *>::iterator);
+
+		void infer_statements(std::deque<statement_base *> &);
+
+		void infer_block(std::deque<statement_base *> &);
+
+		void infer_branches(tree_type<token_base *>::iterator, std::deque<statement_base *> &,
+		                    std::deque<statement_base *> *);
+
+		// One iteration runs head, body and tail, the loop may be left after the head and after the tail
+		void infer_loop(const std::function<void()> &, const std::function<void()> &, const std::function<void()> &,
+		                bool, bool);
+	};
 }
\ No newline at end of file
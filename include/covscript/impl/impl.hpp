@@ -39,6 +39,10 @@ namespace cs {
 		bool continue_block = false;
 		// Context
 		context_t context;
+		// Forked globals of the origin and its packages by slot, they stand in for the originals while the fork runs
+		std::vector<std::pair<instance_t, std::vector<std::pair<std::size_t, var>>>> fork_overlay;
+		// The fork whose globals are in place, see fork_guard
+		static instance_type *running_fork;
 
 		// Constructor and destructor
 		instance_type() = delete;
@@ -62,6 +66,16 @@ namespace cs {
 
 		void dump_ast(std::ostream &);
 
+		// Drop compiled code and start over from the global scope of another instance, see fork_context
+		void fork(const instance_type &);
+
+		// Exchange the globals of the origin and its packages with the ones of this fork
+		void swap_overlay();
+
+		// Translate pure functions of the compiled package into <dir>/<name>_aot.cpp, a CNI extension,
+		// and <dir>/<name>.csp, a wrapper package that falls back to the script where the types differ
+		void dump_aot(const std::string &);
+
 		// Parse variable definition
 		void check_declar_var(tree_type<token_base *>::iterator, bool= false);
 
@@ -77,10 +91,45 @@ namespace cs {
 		void parse_using(tree_type<token_base *>::iterator, bool= false);
 	};
 
+	// Functions of an origin keep running in the origin, so the globals of a fork are put in place while it runs.
+	// Nested guards of the same fork do nothing, another fork takes the place of the running one until it returns.
+	class fork_guard final {
+		instance_type *previous = nullptr;
+		instance_type *current = nullptr;
+	public:
+		fork_guard() = delete;
+
+		explicit fork_guard(instance_type *instance)
+		{
+			if (instance->fork_overlay.empty() || instance == instance_type::running_fork)
+				return;
+			previous = instance_type::running_fork;
+			current = instance;
+			if (previous != nullptr)
+				previous->swap_overlay();
+			current->swap_overlay();
+			instance_type::running_fork = current;
+		}
+
+		fork_guard(const fork_guard &) = delete;
+
+		~fork_guard()
+		{
+			if (current == nullptr)
+				return;
+			current->swap_overlay();
+			if (previous != nullptr)
+				previous->swap_overlay();
+			instance_type::running_fork = previous;
+		}
+	};
+
 // Repl
 	class repl final {
 		std::deque<std::deque<token_base *>> tmp;
 		stack_type<method_base *> methods;
+		// Unit of the statement being entered, replaced by the next one once it has run
+		unit_t unit;
 		charset encoding = charset::utf8;
 		std::size_t line_num = 0;
 		bool multi_line = false;
@@ -157,10 +206,10 @@ namespace cs {
 #ifdef CS_DEBUGGER
 		fcall_guard() = delete;
 
-		explicit fcall_guard(const std::string &decl)
+		explicit fcall_guard(const function *func)
 		{
 			current_process->stack.push(null_pointer);
-			current_process->stack_backtrace.push(decl);
+			current_process->stack_backtrace.push(func);
 		}
 
 		~fcall_guard()
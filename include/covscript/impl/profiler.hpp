@@ -0,0 +1,441 @@
+#pragma once
+/*
+* Covariant Script Profiler
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Copyright (C) 2017-2022 Michael Lee(李登淳)
+*
+* This software is registered with the National Copyright Administration
+* of the People's Republic of China(Registration Number: 2020SR0408026)
+* and is protected by the Copyright Law of the People's Republic of China.
+*
+* Email:   lee@covariant.cn, mikecovlee@163.com
+* Github:  https://github.com/mikecovlee
+* Website: http://covscript.org.cn
+*/
+#include <covscript/core/core.hpp>
+#include <thread>
+#include <chrono>
+#include <map>
+
+namespace cs {
+	/*
+	 * Profiler interface
+	 * An attached profiler runs every statement and sees every script function call,
+	 * detached profiling costs one branch per statement and call.
+	 */
+	class profiler {
+		std::vector<compile_unit *> m_units;
+	public:
+		profiler() = default;
+
+		profiler(const profiler &) = delete;
+
+		virtual ~profiler();
+
+// Attach to current process
+		virtual void start();
+
+		virtual void stop();
+
+		virtual void run_statement(statement_base *) = 0;
+
+		virtual void push_frame(const statement_base *) = 0;
+
+		virtual void pop_frame() = 0;
+
+// Statements compiled while attached
+		virtual void add_statement(statement_base *) {}
+
+// Compile units released while attached, destroyed with the profiler as the records point into them
+		void keep_unit(compile_unit *unit)
+		{
+			m_units.push_back(unit);
+		}
+
+// Compile, import and cleanup phases, see trace_scope
+		virtual void begin_phase(const char *, const std::string &) {}
+
+		virtual void end_phase() {}
+
+// Compiler steps inside the phases, once per line or expression, see step_scope
+		virtual void begin_step(const char *) {}
+
+		virtual void end_step() {}
+
+// Write the results into path and its companion files
+		virtual void report(const std::string &) const = 0;
+	};
+
+	/*
+	 * Sampling profiler
+	 * A timer thread only counts ticks, the interpreter thread records its call stack
+	 * at the next statement, so no signal handler ever touches the interpreter state.
+	 * Pending ticks are charged to the statement that was running when they elapsed.
+	 */
+	class sampling_profiler final : public profiler {
+		struct frame_type final {
+			const statement_base *decl = nullptr;
+			const statement_base *current = nullptr;
+		};
+
+		struct line_record final {
+			std::size_t self = 0;
+			std::size_t total = 0;
+			std::size_t last_sample = 0;
+		};
+
+		std::vector<frame_type> m_frames;
+		std::map<std::vector<const statement_base *>, std::size_t> m_stacks;
+		std::map<const statement_base *, line_record> m_lines;
+		std::size_t m_samples = 0;
+		std::size_t m_sample_id = 0;
+
+		std::chrono::microseconds m_interval;
+		std::atomic<std::size_t> m_ticks{0};
+		std::atomic<bool> m_running{false};
+		std::thread m_timer;
+
+		void take_sample();
+
+		inline void poll_sample()
+		{
+			if (m_ticks.load(std::memory_order_relaxed) != 0)
+				take_sample();
+		}
+
+	public:
+		explicit sampling_profiler(std::chrono::microseconds interval = std::chrono::microseconds(1000)) : m_frames(1),
+			m_interval(interval) {}
+
+		~sampling_profiler() override
+		{
+			stop();
+		}
+
+		void start() override;
+
+		void stop() override;
+
+		void run_statement(statement_base *) override;
+
+		void push_frame(const statement_base *decl) override
+		{
+			poll_sample();
+			m_frames.push_back({decl, nullptr});
+		}
+
+		void pop_frame() override
+		{
+			poll_sample();
+			if (m_frames.size() > 1)
+				m_frames.pop_back();
+		}
+
+		std::size_t sample_count() const noexcept
+		{
+			return m_samples;
+		}
+
+// Folded stacks, one "frame;frame;... count" per line, consumable by flamegraph.pl
+		void dump_folded(std::ostream &) const;
+
+// Samples per source line, sorted by self samples
+		void dump_lines(std::ostream &) const;
+
+// Folded stacks into path, line table into path.lines
+		void report(const std::string &) const override;
+	};
+
+	/*
+	 * Instrumentation profiler
+	 * Counts every call and statement, with inclusive and exclusive wall time and value allocations.
+	 * Exclusive figures of a function exclude its callees, of a statement exclude nested statements
+	 * and the functions it calls. Recursive activations are only accounted once, by the outermost one.
+	 */
+	class instrument_profiler final : public profiler {
+		using clock_type = std::chrono::steady_clock;
+
+		struct record_type final {
+			std::size_t count = 0;
+			std::size_t active = 0;
+			std::chrono::nanoseconds inclusive{0};
+			std::chrono::nanoseconds exclusive{0};
+			std::size_t allocations = 0;
+			std::size_t exclusive_allocations = 0;
+		};
+
+		struct entry_type final {
+			record_type *record;
+			clock_type::time_point start;
+			std::size_t start_allocations;
+			std::chrono::nanoseconds children{0};
+			std::size_t children_allocations = 0;
+			// Depth of the call stack when a statement starts
+			std::size_t depth = 0;
+		};
+
+		std::map<const statement_base *, record_type> m_functions;
+		std::map<const statement_base *, record_type> m_lines;
+		std::vector<entry_type> m_calls;
+		std::vector<entry_type> m_stmts;
+
+		static void enter(std::vector<entry_type> &, record_type &, std::size_t);
+
+		static void leave(entry_type &, std::chrono::nanoseconds &, std::size_t &);
+
+		void leave_statement();
+
+	public:
+		instrument_profiler() = default;
+
+		~instrument_profiler() override
+		{
+			stop();
+		}
+
+		void run_statement(statement_base *) override;
+
+		void push_frame(const statement_base *) override;
+
+		void pop_frame() override;
+
+		void dump_json(std::ostream &) const;
+
+// Functions and lines sorted by exclusive time
+		void dump_text(std::ostream &) const;
+
+// JSON into path, text report into path.txt
+		void report(const std::string &) const override;
+	};
+
+	/*
+	 * Trace profiler
+	 * Records a Chrome trace-event timeline of the phases and of the script function calls
+	 * which last longer than the threshold, viewable in chrome://tracing or Perfetto.
+	 */
+	class trace_profiler final : public profiler {
+		using clock_type = std::chrono::steady_clock;
+
+		struct event_type final {
+			std::string name;
+			const char *category;
+			std::string file;
+			std::size_t line;
+			clock_type::time_point start;
+			clock_type::duration duration;
+		};
+
+		clock_type::time_point m_origin = clock_type::now();
+		clock_type::duration m_threshold;
+		std::vector<event_type> m_events;
+		// Indexes of unfinished phases in m_events
+		std::vector<std::size_t> m_phases;
+		std::vector<std::pair<const statement_base *, clock_type::time_point>> m_calls;
+
+	public:
+		explicit trace_profiler(std::chrono::microseconds threshold = std::chrono::microseconds(100)) : m_threshold(
+			    threshold) {}
+
+		~trace_profiler() override
+		{
+			stop();
+		}
+
+		void run_statement(statement_base *) override;
+
+		void push_frame(const statement_base *decl) override
+		{
+			m_calls.emplace_back(decl, clock_type::now());
+		}
+
+		void pop_frame() override;
+
+		void begin_phase(const char *, const std::string &) override;
+
+		void end_phase() override;
+
+		void dump_json(std::ostream &) const;
+
+		void report(const std::string &) const override;
+	};
+
+	/*
+	 * Coverage profiler
+	 * Counts executions and taken branches of every statement compiled while attached,
+	 * the counters live in the statements so counting costs no lookup.
+	 */
+	class coverage_profiler final : public profiler {
+		std::vector<const statement_base *> m_statements;
+
+	public:
+		coverage_profiler() = default;
+
+		~coverage_profiler() override
+		{
+			stop();
+		}
+
+		void add_statement(statement_base *stmt) override
+		{
+			m_statements.push_back(stmt);
+		}
+
+		void run_statement(statement_base *) override;
+
+		void push_frame(const statement_base *) override {}
+
+		void pop_frame() override {}
+
+// lcov tracefile, line counts are the highest count of the statements on a line
+		void dump_lcov(std::ostream &) const;
+
+// Executed lines sorted by count
+		void dump_hotspots(std::ostream &) const;
+
+// Tracefile into path, hotspots into path.hot
+		void report(const std::string &) const override;
+	};
+
+	/*
+	 * Phase profiler
+	 * Wall time of every compile phase and step per file, exclusive of the nested ones,
+	 * with the tokens, statements and AST arena bytes allocated while compiling the file.
+	 */
+	class phase_profiler final : public profiler {
+		using clock_type = std::chrono::steady_clock;
+
+		struct record_type final {
+			std::map<std::string, clock_type::duration> phases;
+			std::size_t tokens = 0;
+			std::size_t statements = 0;
+			std::size_t bytes = 0;
+		};
+
+		struct entry_type final {
+			const char *name;
+			record_type *record;
+			clock_type::time_point start;
+			std::size_t tokens, statements, bytes;
+			clock_type::duration children{0};
+			std::size_t children_tokens = 0, children_statements = 0, children_bytes = 0;
+		};
+
+		std::vector<std::string> m_files;
+		std::map<std::string, record_type> m_records;
+		std::vector<entry_type> m_entries;
+
+		// Compiler nodes of the global arenas and of all live units
+		static std::size_t token_nodes();
+
+		static std::size_t statement_nodes();
+
+		static std::size_t node_bytes();
+
+		void enter(const char *, record_type *);
+
+		void leave();
+
+	public:
+		phase_profiler() = default;
+
+		~phase_profiler() override
+		{
+			stop();
+		}
+
+		void run_statement(statement_base *) override;
+
+		void push_frame(const statement_base *) override {}
+
+		void pop_frame() override {}
+
+		void begin_phase(const char *, const std::string &) override;
+
+		void end_phase() override
+		{
+			leave();
+		}
+
+		void begin_step(const char *name) override
+		{
+			enter(name, m_entries.empty() ? nullptr : m_entries.back().record);
+		}
+
+		void end_step() override
+		{
+			leave();
+		}
+
+// Table of phases in milliseconds per file, in order of compilation
+		void dump(std::ostream &) const;
+
+// Table into path, or standard error if path is empty
+		void report(const std::string &) const override;
+	};
+
+	class trace_scope final {
+		profiler *m_profiler;
+	public:
+		trace_scope() = delete;
+
+		trace_scope(const char *name, const std::string &detail) : m_profiler(current_process->profiling)
+		{
+			if (m_profiler != nullptr)
+				m_profiler->begin_phase(name, detail);
+		}
+
+		~trace_scope()
+		{
+			if (m_profiler != nullptr)
+				m_profiler->end_phase();
+		}
+	};
+
+	class step_scope final {
+		profiler *m_profiler;
+	public:
+		step_scope() = delete;
+
+		explicit step_scope(const char *name) : m_profiler(current_process->profiling)
+		{
+			if (m_profiler != nullptr)
+				m_profiler->begin_step(name);
+		}
+
+		~step_scope()
+		{
+			if (m_profiler != nullptr)
+				m_profiler->end_step();
+		}
+	};
+
+	class profile_guard final {
+		profiler *m_profiler;
+	public:
+		profile_guard() = delete;
+
+		explicit profile_guard(const statement_base *decl) : m_profiler(current_process->profiling)
+		{
+			if (m_profiler != nullptr)
+				m_profiler->push_frame(decl);
+		}
+
+		~profile_guard()
+		{
+			if (m_profiler != nullptr)
+				m_profiler->pop_frame();
+		}
+	};
+}
@@ -108,6 +108,27 @@ namespace cs {
 			m_set.top().clear();
 		}
 
+		// Deferred compilation only sees the global scope, everything above it is set aside meanwhile
+		void detach_scopes(std::vector<domain_type> &domains, std::vector<set_t<string>> &sets)
+		{
+			for (; m_data.size() > 1; m_data.pop_no_return())
+				domains.push_back(std::move(m_data.top()));
+			for (; m_set.size() > 1; m_set.pop_no_return())
+				sets.push_back(std::move(m_set.top()));
+		}
+
+		void attach_scopes(std::vector<domain_type> &domains, std::vector<set_t<string>> &sets)
+		{
+			while (m_data.size() > 1)
+				m_data.pop_no_return();
+			while (m_set.size() > 1)
+				m_set.pop_no_return();
+			for (auto it = domains.rbegin(); it != domains.rend(); ++it)
+				m_data.push(std::move(*it));
+			for (auto it = sets.rbegin(); it != sets.rend(); ++it)
+				m_set.push(std::move(*it));
+		}
+
 		void clear_domain()
 		{
 			m_data.top().clear();
@@ -267,6 +288,40 @@ namespace cs {
 			return add_var(name, var::make_protect<type_t>(func, id, ext));
 		}
 
+		// Builtin symbols are prepared once per process and copied into every new context
+		domain_manager &involve_buildin(const domain_manager &buildin)
+		{
+			m_set.bottom() = buildin.m_set.bottom();
+			m_data.bottom().assign(buildin.m_data.bottom());
+			buildin_symbols = buildin.buildin_symbols;
+			return *this;
+		}
+
+		bool is_buildin(const string &name) const
+		{
+			return buildin_symbols.count(name) > 0;
+		}
+
+		// Global scope of a forked context: builtin symbols are shared, every other value goes through the fork function
+		template<typename ForkT>
+		domain_manager &fork_global(const domain_manager &origin, ForkT &&fork)
+		{
+			while (m_data.size() > 1)
+				m_data.pop_no_return();
+			while (m_set.size() > 1)
+				m_set.pop_no_return();
+			m_set.bottom() = origin.m_set.bottom();
+			buildin_symbols = origin.buildin_symbols;
+			domain_type &global = m_data.bottom();
+			global.assign(origin.m_data.bottom());
+			for (auto &it:global) {
+				var &val = global.get_var_by_id(it.second);
+				if (val.usable() && buildin_symbols.count(it.first) == 0)
+					val = fork(it.first, val);
+			}
+			return *this;
+		}
+
 		void involve_domain(const domain_type &domain, bool is_override = false)
 		{
 			for (auto &it:domain)
@@ -279,10 +334,53 @@ namespace cs {
 	public:
 		domain_manager storage;
 
+		// Arguments of an inlined function, which are read without a scope of their own
+		struct inline_frame final {
+			const std::vector<std::string> *names = nullptr;
+			vector *args = nullptr;
+		} frame;
+
+		class frame_guard final {
+			runtime_type *runtime;
+			inline_frame saved;
+		public:
+			frame_guard() = delete;
+
+			frame_guard(runtime_type *rt, const std::vector<std::string> *names, vector *args) : runtime(rt),
+				saved(rt->frame)
+			{
+				runtime->frame.names = names;
+				runtime->frame.args = args;
+			}
+
+			frame_guard(const frame_guard &) = delete;
+
+			~frame_guard()
+			{
+				runtime->frame = saved;
+			}
+		};
+
+		inline var &lookup_var(const var_id &id)
+		{
+			if (frame.args != nullptr) {
+				const auto &names = *frame.names;
+				for (std::size_t i = 0, size = names.size(); i < size; ++i)
+					if (names[i] == id.get_id())
+						return (*frame.args)[i];
+			}
+			return storage.get_var(id);
+		}
+
 		runtime_type() = default;
 
 		explicit runtime_type(std::size_t size) : storage(size) {}
 
+		void copy_string_literals(const runtime_type &rt)
+		{
+			literals = rt.literals;
+		}
+
 		void add_string_literal(const std::string &literal, const callable &func)
 		{
 			if (literals.count(literal) > 0)
@@ -303,8 +401,12 @@ namespace cs {
 
 		var parse_add(const var &, const var &);
 
+		var parse_add_num(const var &, const var &);
+
 		var parse_addasi(var, const var &);
 
+		var parse_addasi_str(var, const var &);
+
 		var parse_sub(const var &, const var &);
 
 		var parse_subasi(var, const var &);
@@ -383,6 +485,10 @@ namespace cs {
 
 		var parse_access(const var &, const var &);
 
+		var parse_access_arr(const var &, const var &);
+
+		var parse_flat(token_flat *);
+
 		var parse_expr(const tree_type<token_base *>::iterator &, bool= false);
 	};
 }
@@ -46,6 +46,8 @@ namespace cs {
 		void repl_run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_import final : public statement_base {
@@ -103,6 +105,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_constant final : public statement_base {
@@ -122,6 +126,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_break final : public statement_base {
@@ -138,6 +144,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_continue final : public statement_base {
@@ -154,6 +162,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_block final : public statement_base {
@@ -174,6 +184,8 @@ namespace cs {
 
 		void dump(std::ostream &) const override;
 
+		void infer_types(type_inference &) override;
+
 		const std::deque<statement_base *> &get_block() const
 		{
 			return this->mBlock;
@@ -218,6 +230,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_ifelse final : public statement_base {
@@ -244,6 +258,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_else final : public statement_base {
@@ -374,6 +390,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_until final : public statement_base {
@@ -421,6 +439,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_loop_until final : public statement_base {
@@ -440,17 +460,38 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_for final : public statement_base {
 		std::deque<tree_type<token_base *>> mParallel;
 		std::deque<statement_base *> mBlock;
+		// Counted loop shape: "<id> <cmp> <expr>" as condition and "++<id>" or "--<id>" as step
+		const var_id *mCondId = nullptr;
+		// Bound of a flattened condition, otherwise the right leaf of the comparison is evaluated
+		token_flat *mCondBound = nullptr;
+		signal_types mCondSig = signal_types::und_;
+		token_id *mStepId = nullptr;
+		bool mStepInc = true;
+
+		void analyze_loop();
+
+		void analyze_flat_condition(token_flat *);
+
+		bool test_condition();
+
+		void step();
+
 	public:
 		statement_for() = delete;
 
 		statement_for(std::deque<tree_type<token_base *>> parallel_list, std::deque<statement_base *> block,
 		              context_t c, token_base *ptr) : statement_base(std::move(c), ptr),
-			mParallel(std::move(parallel_list)), mBlock(std::move(block)) {}
+			mParallel(std::move(parallel_list)), mBlock(std::move(block))
+		{
+			analyze_loop();
+		}
 
 		statement_types get_type() const noexcept override
 		{
@@ -460,6 +501,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_foreach final : public statement_base {
@@ -481,6 +524,8 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_struct final : public statement_base {
@@ -488,6 +533,7 @@ namespace cs {
 		struct_builder mBuilder;
 		tree_type<token_base *> mParent;
 		std::deque<statement_base *> mBlock;
+		compile_unit *mUnit = compile_unit::current();
 	public:
 		statement_struct() = delete;
 
@@ -523,6 +569,11 @@ namespace cs {
 #endif
 		std::vector<std::string> mArgs;
 		std::deque<statement_base *> mBlock;
+		// Raw lines of a deferred body, generated by load_block on first use
+		std::deque<std::deque<token_base *>> mLazyBlock;
+		bool mIsLazy = false;
+		// Deferred bodies are compiled into the unit of the declaration
+		compile_unit *mUnit = compile_unit::current();
 	public:
 		statement_function() = delete;
 
@@ -541,7 +592,7 @@ namespace cs {
 		                   const std::deque<statement_base *> &body, bool is_override, bool is_vargs,
 		                   const context_t &c,
 		                   token_base *ptr)
-			: statement_base(c, ptr), mName(std::move(name)), mFunc(c, args, body, is_vargs),
+			: statement_base(c, ptr), mName(std::move(name)), mFunc(c, this, args, body, is_vargs),
 			  mOverride(is_override),
 			  mArgs(args),
 			  mBlock(body) {}
@@ -553,6 +604,37 @@ namespace cs {
 			return statement_types::function_;
 		}
 
+		const std::string &get_name() const noexcept
+		{
+			return mName;
+		}
+
+		const function &get_function() const noexcept
+		{
+			return mFunc;
+		}
+
+		const std::vector<std::string> &get_args() const noexcept
+		{
+			return mArgs;
+		}
+
+		const std::deque<statement_base *> &get_block()
+		{
+			if (mIsLazy)
+				load_block();
+			return mBlock;
+		}
+
+		void defer_block(std::deque<std::deque<token_base *>> block)
+		{
+			mLazyBlock = std::move(block);
+			mIsLazy = true;
+			mFunc.defer_body(this);
+		}
+
+		void load_block();
+
 		void set_mem_fn()
 		{
 			mFunc.add_reserve_var("this", true);
@@ -587,9 +669,16 @@ namespace cs {
 			return statement_types::return_;
 		}
 
+		tree_type<token_base *> &get_tree() noexcept
+		{
+			return this->mTree;
+		}
+
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 
 	class statement_try final : public statement_base {
@@ -662,5 +751,7 @@ namespace cs {
 		void run_impl() override;
 
 		void dump(std::ostream &) const override;
+
+		void infer_types(type_inference &) override;
 	};
 }
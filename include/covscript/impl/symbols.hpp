@@ -25,6 +25,7 @@
 * Website: http://covscript.org.cn
 */
 #include <covscript/impl/type_ext.hpp>
+#include <covscript/impl/profiler.hpp>
 
 namespace cs {
 	enum class token_types {
@@ -43,7 +44,8 @@ namespace cs {
 		expr,
 		arglist,
 		array,
-		parallel
+		parallel,
+		flat
 	};
 	enum class action_types {
 		import_,
@@ -134,6 +136,10 @@ namespace cs {
 		varprt_,
 		vargs_,
 		bind_,
+		// Specialized by type_inference, each falls back to its generic counterpart
+		add_num_,
+		access_arr_,
+		addasi_str_,
 		error_
 	};
 	enum class constant_values {
@@ -175,19 +181,22 @@ namespace cs {
 	protected:
 		std::size_t line_num = 1;
 	public:
-		static garbage_collector<token_base> gc;
+		// Nodes compiled outside of any compile unit
+		static memory_arena<token_base> gc;
 
 		static void *operator new(std::size_t size)
 		{
-			void *ptr = ::operator new(size);
-			gc.add(ptr);
-			return ptr;
+			compile_unit *unit = compile_unit::current();
+			return unit != nullptr ? unit->allocate_token(size) : gc.allocate(size);
 		}
 
-		static void operator delete(void *ptr)
+		static void operator delete(void *ptr, std::size_t size)
 		{
-			gc.remove(ptr);
-			::operator delete(ptr);
+			compile_unit *unit = compile_unit::current();
+			if (unit != nullptr)
+				unit->deallocate_token(ptr, size);
+			else
+				gc.deallocate(ptr, size);
 		}
 
 		token_base() = default;
@@ -570,6 +579,65 @@ namespace cs {
 		bool dump(std::ostream &) const override;
 	};
 
+	class token_flat final : public token_base {
+	public:
+		enum class opcode : unsigned char {
+			push_number, push_var, add, sub, mul, div, mod, pow, minus, square, und, abo, ueq, aeq
+		};
+
+		// Post-order node: operands are pushed before the operator that consumes them
+		struct node_type final {
+			opcode op;
+			std::size_t index;
+			number value;
+		};
+
+		static constexpr std::size_t max_depth = 16;
+	private:
+		std::vector<node_type> mNodes;
+		std::vector<var_id> mIds;
+		std::size_t mDepth = 0;
+	public:
+		token_flat() = default;
+
+		token_flat(const token_flat &) = default;
+
+		token_flat(token_flat &&) noexcept = default;
+
+		token_types get_type() const noexcept override
+		{
+			return token_types::flat;
+		}
+
+		std::vector<node_type> &get_nodes() noexcept
+		{
+			return this->mNodes;
+		}
+
+		std::vector<var_id> &get_ids() noexcept
+		{
+			return this->mIds;
+		}
+
+		std::size_t get_depth() const noexcept
+		{
+			return this->mDepth;
+		}
+
+		void set_depth(std::size_t depth) noexcept
+		{
+			this->mDepth = depth;
+		}
+
+		// Comparisons may only appear last, turning the whole expression into a boolean
+		bool is_predicate() const noexcept
+		{
+			return !mNodes.empty() && mNodes.back().op >= opcode::und;
+		}
+
+		bool dump(std::ostream &) const override;
+	};
+
 	enum class statement_types {
 		null,
 		expression_,
@@ -606,20 +674,38 @@ namespace cs {
 	protected:
 		context_t context;
 		std::size_t line_num = 1;
+		// Coverage counters, only maintained while a profiler is attached
+		std::size_t exec_count = 0;
+		std::size_t branch_count = 0;
+		std::size_t taken_count = 0;
+
+		// Conditional statements and loops count every evaluation of their condition
+		inline bool count_branch(bool taken) noexcept
+		{
+			if (current_process->profiling != nullptr) {
+				++branch_count;
+				taken_count += taken;
+			}
+			return taken;
+		}
+
 	public:
-		static garbage_collector<statement_base> gc;
+		// Nodes compiled outside of any compile unit
+		static memory_arena<statement_base> gc;
 
 		static void *operator new(std::size_t size)
 		{
-			void *ptr = ::operator new(size);
-			gc.add(ptr);
-			return ptr;
+			compile_unit *unit = compile_unit::current();
+			return unit != nullptr ? unit->allocate_statement(size) : gc.allocate(size);
 		}
 
-		static void operator delete(void *ptr)
+		static void operator delete(void *ptr, std::size_t size)
 		{
-			gc.remove(ptr);
-			::operator delete(ptr);
+			compile_unit *unit = compile_unit::current();
+			if (unit != nullptr)
+				unit->deallocate_statement(ptr, size);
+			else
+				gc.deallocate(ptr, size);
 		}
 
 		statement_base() = default;
@@ -627,7 +713,11 @@ namespace cs {
 		statement_base(const statement_base &) = default;
 
 		statement_base(context_t c, token_base *eptr) : context(std::move(c)),
-			line_num(static_cast<token_endline *>(eptr)->get_line_num()) {}
+			line_num(static_cast<token_endline *>(eptr)->get_line_num())
+		{
+			if (current_process->profiling != nullptr)
+				current_process->profiling->add_statement(this);
+		}
 
 		virtual ~statement_base() = default;
 
@@ -636,12 +726,38 @@ namespace cs {
 			return line_num;
 		}
 
+		// Context which compiled this statement, imported packages have their own
+		const context_t &get_context() const noexcept
+		{
+			return context;
+		}
+
 		const std::string &get_file_path() const noexcept;
 
 		const std::string &get_package_name() const noexcept;
 
 		const std::string &get_raw_code() const noexcept;
 
+		void count_execution() noexcept
+		{
+			++exec_count;
+		}
+
+		std::size_t get_exec_count() const noexcept
+		{
+			return exec_count;
+		}
+
+		std::size_t get_branch_count() const noexcept
+		{
+			return branch_count;
+		}
+
+		std::size_t get_taken_count() const noexcept
+		{
+			return taken_count;
+		}
+
 		virtual statement_types get_type() const noexcept = 0;
 
 		virtual void run_impl() = 0;
@@ -649,7 +765,10 @@ namespace cs {
 		inline void run()
 		{
 			current_process->poll_event();
-			this->run_impl();
+			if (current_process->profiling != nullptr)
+				current_process->profiling->run_statement(this);
+			else
+				this->run_impl();
 		}
 
 		virtual void repl_run_impl()
@@ -667,23 +786,23 @@ namespace cs {
 		{
 			o << "<statement>\n";
 		}
+
+		// Statements not modelled by type_inference forget every fact
+		virtual void infer_types(type_inference &);
 	};
 
 	class method_base {
 	public:
-		static garbage_collector<method_base> gc;
+		static memory_arena<method_base> gc;
 
 		static void *operator new(std::size_t size)
 		{
-			void *ptr = ::operator new(size);
-			gc.add(ptr);
-			return ptr;
+			return gc.allocate(size);
 		}
 
-		static void operator delete(void *ptr)
+		static void operator delete(void *ptr, std::size_t size)
 		{
-			gc.remove(ptr);
-			::operator delete(ptr);
+			gc.deallocate(ptr, size);
 		}
 
 		method_base() = default;
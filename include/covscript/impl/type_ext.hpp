@@ -39,6 +39,24 @@ namespace cs_impl {
 			path_info(const char *n, int t) : name(n), type(t) {}
 		};
 	}
+	namespace pipeline_cs_ext {
+		struct pipeline final {
+			enum class stage_types {
+				map, filter, take, skip, take_while
+			};
+			struct stage final {
+				stage_types type;
+				cs::var func;
+				std::size_t count;
+			};
+			cs::var source;
+			std::vector<stage> stages;
+
+			pipeline() = delete;
+
+			explicit pipeline(cs::var src) : source(std::move(src)) {}
+		};
+	}
 
 	void init_extensions();
 
@@ -71,6 +89,7 @@ namespace cs_impl {
 	extern cs::namespace_t path_ext;
 	extern cs::namespace_t path_type_ext;
 	extern cs::namespace_t path_info_ext;
+	extern cs::namespace_t pipeline_ext;
 
 // Detach
 	template<>
@@ -407,12 +426,24 @@ namespace cs_impl {
 		return "cs::expression";
 	}
 
+	template<>
+	constexpr const char *get_name_of_type<cs::expression_t>()
+	{
+		return "cs::expression";
+	}
+
 	template<>
 	constexpr const char *get_name_of_type<path_cs_ext::path_info>()
 	{
 		return "cs::system::path_info";
 	}
 
+	template<>
+	constexpr const char *get_name_of_type<pipeline_cs_ext::pipeline>()
+	{
+		return "cs::pipeline";
+	}
+
 // Type Extensions
 
 	template<>
@@ -516,4 +547,10 @@ namespace cs_impl {
 	{
 		return path_info_ext;
 	}
+
+	template<>
+	cs::namespace_t &get_ext<pipeline_cs_ext::pipeline>()
+	{
+		return pipeline_ext;
+	}
 }
\ No newline at end of file
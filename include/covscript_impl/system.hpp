@@ -113,5 +113,48 @@ namespace cs_impl {
 		bool mkdir(std::string);
 
 		std::string get_current_dir();
+
+// Read-only view on the whole content of a file, memory-mapped when the platform allows
+		class file_view final {
+			const char *m_data = nullptr;
+			std::size_t m_size = 0;
+			bool m_mapped = false;
+			bool m_open = false;
+			std::string m_buff;
+		public:
+			file_view() = delete;
+
+			file_view(const file_view &) = delete;
+
+			explicit file_view(const std::string &);
+
+			~file_view();
+
+			bool is_open() const
+			{
+				return m_open;
+			}
+
+			const char *begin() const
+			{
+				return m_data;
+			}
+
+			const char *end() const
+			{
+				return m_data + m_size;
+			}
+		};
+	}
+	namespace process {
+// Run every job in a dedicated worker process and collect the payloads in job order.
+// Returns false if worker processes are not supported on this platform.
+		bool fork_join(std::size_t, const std::function<std::string(std::size_t)> &, std::vector<std::string> &);
+
+// Resident set size of current process in bytes, zero if unknown.
+		std::size_t resident_memory();
+
+// Identifier of current process given by the operating system.
+		std::size_t id();
 	}
 }
\ No newline at end of file
@@ -0,0 +1,286 @@
+/*
+* Covariant Script Module Cache
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Copyright (C) 2017-2022 Michael Lee(李登淳)
+*
+* This software is registered with the National Copyright Administration
+* of the People's Republic of China(Registration Number: 2020SR0408026)
+* and is protected by the Copyright Law of the People's Republic of China.
+*
+* Email:   lee@covariant.cn, mikecovlee@163.com
+* Github:  https://github.com/mikecovlee
+* Website: http://covscript.org.cn
+*/
+#include <covscript_impl/system.hpp>
+#include <covscript/impl/compiler.hpp>
+#include <cstdio>
+
+/*
+* Module cache stores the token stream of a source file together with its source lines,
+* so that a later compilation of the same content skips the lexer and preprocessor.
+* Files are keyed by the content hash, and the header records the language standard
+* and ABI versions so that caches from other interpreter builds are never loaded.
+*/
+
+namespace cs {
+	namespace module_cache {
+		static constexpr std::uint32_t magic = 0x434d5343;
+		static constexpr std::uint32_t format_version = 1;
+
+		std::uint64_t content_hash(const char *begin, const char *end)
+		{
+			// FNV-1a
+			std::uint64_t hash = 0xcbf29ce484222325ull;
+			for (; begin != end; ++begin) {
+				hash ^= static_cast<unsigned char>(*begin);
+				hash *= 0x100000001b3ull;
+			}
+			return hash;
+		}
+
+		std::string cache_file(std::uint64_t hash)
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "%016llx.csmc", static_cast<unsigned long long>(hash));
+			return current_process->module_cache_path + path_separator + name;
+		}
+
+		class writer final {
+			std::string m_data;
+		public:
+			template<typename T>
+			void put(T val)
+			{
+				m_data.append(reinterpret_cast<const char *>(&val), sizeof(T));
+			}
+
+			void put_str(const std::string &str)
+			{
+				put<std::uint64_t>(str.size());
+				m_data.append(str);
+			}
+
+			const std::string &data() const
+			{
+				return m_data;
+			}
+		};
+
+		class reader final {
+			std::string m_data;
+			std::size_t m_posit = 0;
+		public:
+			explicit reader(std::string data) : m_data(std::move(data)) {}
+
+			template<typename T>
+			T get()
+			{
+				T val;
+				if (m_posit + sizeof(T) > m_data.size())
+					throw internal_error("Corrupted module cache.");
+				m_data.copy(reinterpret_cast<char *>(&val), sizeof(T), m_posit);
+				m_posit += sizeof(T);
+				return val;
+			}
+
+			std::string get_str()
+			{
+				std::size_t size = get<std::uint64_t>();
+				if (m_posit + size > m_data.size())
+					throw internal_error("Corrupted module cache.");
+				std::string str = m_data.substr(m_posit, size);
+				m_posit += size;
+				return str;
+			}
+
+			bool eof() const
+			{
+				return m_posit == m_data.size();
+			}
+		};
+	}
+
+	bool compiler_type::load_token_cache(const char *begin, const char *end, std::deque<token_base *> &tokens)
+	{
+		std::uint64_t hash = module_cache::content_hash(begin, end);
+		std::ifstream in(module_cache::cache_file(hash), std::ios::binary);
+		if (!in)
+			return false;
+		module_cache::reader rd(std::string{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()});
+		std::deque<token_base *> result;
+		std::deque<string> lines;
+		try {
+			if (rd.get<std::uint32_t>() != module_cache::magic ||
+			        rd.get<std::uint32_t>() != module_cache::format_version ||
+			        rd.get<std::uint32_t>() != COVSCRIPT_STD_VERSION || rd.get<std::uint32_t>() != COVSCRIPT_ABI_VERSION ||
+			        rd.get<std::uint64_t>() != hash || rd.get<std::uint64_t>() != std::uint64_t(end - begin))
+				return false;
+			for (std::size_t i = 0, size = rd.get<std::uint64_t>(); i < size; ++i)
+				lines.emplace_back(rd.get_str());
+			for (std::size_t i = 0, size = rd.get<std::uint64_t>(); i < size; ++i) {
+				char type = rd.get<char>();
+				std::size_t line_num = rd.get<std::uint64_t>();
+				token_base *token = nullptr;
+				switch (type) {
+				case 'E':
+					token = new token_endline(line_num);
+					break;
+				case 'S':
+					token = new token_signal(static_cast<signal_types>(rd.get<std::uint32_t>()));
+					break;
+				case 'I':
+					token = new token_id(rd.get_str());
+					break;
+				case 'L': {
+					std::string data = rd.get_str();
+					token = new token_literal(data, rd.get_str());
+					break;
+				}
+				case 'n':
+					token = new_value(rd.get<number>());
+					break;
+				case 'c':
+					token = new_value(rd.get<char>());
+					break;
+				case 's':
+					token = new_value(rd.get_str());
+					break;
+				case 'T':
+					token = new token_value(var::make_constant<bool>(true));
+					break;
+				case 'F':
+					token = new token_value(var::make_constant<bool>(false));
+					break;
+				case 'p':
+					token = new token_value(null_pointer);
+					break;
+				case 'l':
+					token = new token_value(var::make_constant<constant_values>(constant_values::local_namepace));
+					break;
+				case 'g':
+					token = new token_value(var::make_constant<constant_values>(constant_values::global_namespace));
+					break;
+				default:
+					return false;
+				}
+				token->line_num = line_num;
+				result.push_back(token);
+			}
+			if (!rd.eof())
+				return false;
+		}
+		catch (const internal_error &) {
+			return false;
+		}
+		for (auto &it:lines)
+			context->file_buff.emplace_back(std::move(it));
+		for (auto &it:result)
+			tokens.push_back(it);
+		return true;
+	}
+
+	void compiler_type::save_token_cache(const char *begin, const char *end, const std::deque<token_base *> &tokens)
+	{
+		std::uint64_t hash = module_cache::content_hash(begin, end);
+		module_cache::writer wr;
+		wr.put<std::uint32_t>(module_cache::magic);
+		wr.put<std::uint32_t>(module_cache::format_version);
+		wr.put<std::uint32_t>(COVSCRIPT_STD_VERSION);
+		wr.put<std::uint32_t>(COVSCRIPT_ABI_VERSION);
+		wr.put<std::uint64_t>(hash);
+		wr.put<std::uint64_t>(end - begin);
+		wr.put<std::uint64_t>(context->file_buff.size());
+		for (auto &it:context->file_buff)
+			wr.put_str(it);
+		wr.put<std::uint64_t>(tokens.size());
+		for (auto &ptr:tokens) {
+			if (ptr == nullptr)
+				return;
+			switch (ptr->get_type()) {
+			case token_types::endline:
+				wr.put<char>('E');
+				wr.put<std::uint64_t>(ptr->get_line_num());
+				break;
+			case token_types::signal:
+				wr.put<char>('S');
+				wr.put<std::uint64_t>(ptr->get_line_num());
+				wr.put<std::uint32_t>(static_cast<std::uint32_t>(static_cast<token_signal *>(ptr)->get_signal()));
+				break;
+			case token_types::id:
+				wr.put<char>('I');
+				wr.put<std::uint64_t>(ptr->get_line_num());
+				wr.put_str(static_cast<token_id *>(ptr)->get_id().get_id());
+				break;
+			case token_types::literal:
+				wr.put<char>('L');
+				wr.put<std::uint64_t>(ptr->get_line_num());
+				wr.put_str(static_cast<token_literal *>(ptr)->get_data());
+				wr.put_str(static_cast<token_literal *>(ptr)->get_literal());
+				break;
+			case token_types::value: {
+				const var &val = static_cast<token_value *>(ptr)->get_value();
+				if (val.type() == typeid(number)) {
+					wr.put<char>('n');
+					wr.put<std::uint64_t>(ptr->get_line_num());
+					wr.put<number>(val.const_val<number>());
+				}
+				else if (val.type() == typeid(char)) {
+					wr.put<char>('c');
+					wr.put<std::uint64_t>(ptr->get_line_num());
+					wr.put<char>(val.const_val<char>());
+				}
+				else if (val.type() == typeid(string)) {
+					wr.put<char>('s');
+					wr.put<std::uint64_t>(ptr->get_line_num());
+					wr.put_str(val.const_val<string>());
+				}
+				else if (val.type() == typeid(boolean)) {
+					wr.put<char>(val.const_val<boolean>() ? 'T' : 'F');
+					wr.put<std::uint64_t>(ptr->get_line_num());
+				}
+				else if (val.type() == typeid(pointer)) {
+					wr.put<char>('p');
+					wr.put<std::uint64_t>(ptr->get_line_num());
+				}
+				else if (val.type() == typeid(constant_values)) {
+					wr.put<char>(val.const_val<constant_values>() == constant_values::local_namepace ? 'l' : 'g');
+					wr.put<std::uint64_t>(ptr->get_line_num());
+				}
+				else
+					return;
+				break;
+			}
+			default:
+				// Tokens beyond the lexer output can not be cached
+				return;
+			}
+		}
+		// Write to a temporary file of this process first, concurrent readers never see a partial cache
+		// and concurrent writers never truncate each other's file
+		std::string path = module_cache::cache_file(hash);
+		std::string tmp_path = path + "." + std::to_string(cs_impl::process::id()) + ".tmp";
+		bool written = false;
+		{
+			std::ofstream out(tmp_path, std::ios::binary);
+			if (!out)
+				return;
+			out.write(wr.data().data(), wr.data().size());
+			written = static_cast<bool>(out);
+		}
+		// Nothing is left behind if the write or the rename fails
+		if (!written || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+			std::remove(tmp_path.c_str());
+	}
+}
@@ -321,8 +321,16 @@ namespace cs {
 				throw exception(it->get_line_num(), it->get_file_path(), it->get_raw_code(), e.what());
 			}
 		}
-		return new statement_switch(static_cast<token_expr *>(raw.front().at(1))->get_tree(), cases, dptr, context,
-		                            raw.front().back());
+		tree_type<token_base *> &tree = static_cast<token_expr *>(raw.front().at(1))->get_tree();
+		token_base *ptr = tree.root().data();
+		if (ptr != nullptr && ptr->get_type() == token_types::value) {
+			const var &key = static_cast<token_value *>(ptr)->get_value();
+			if (cases.count(key) > 0)
+				return cases[key];
+			else
+				return dptr;
+		}
+		return new statement_switch(tree, cases, dptr, context, raw.front().back());
 	}
 
 	statement_base *method_case::translate(const context_t &context, const std::deque<std::deque<token_base *>> &raw)
@@ -546,6 +554,7 @@ namespace cs {
 		}
 		std::deque<statement_base *> body;
 		context->compiler->translate({raw.begin() + 1, raw.end()}, body);
+		context->compiler->infer_types(body);
 #ifdef CS_DEBUGGER
 		std::string decl="function "+name+"(";
 		if(args.size()!=0) {
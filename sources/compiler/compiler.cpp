@@ -74,9 +74,11 @@ namespace cs {
 		o << "< Signal = \"";
 		switch (mType) {
 		case signal_types::add_:
+		case signal_types::add_num_:
 			o << "+";
 			break;
 		case signal_types::addasi_:
+		case signal_types::addasi_str_:
 			o << "+=";
 			break;
 		case signal_types::sub_:
@@ -191,6 +193,7 @@ namespace cs {
 			o << "[call]";
 			break;
 		case signal_types::access_:
+		case signal_types::access_arr_:
 			o << "[access]";
 			break;
 		case signal_types::typeid_:
@@ -295,6 +298,27 @@ namespace cs {
 		return true;
 	}
 
+	bool token_flat::dump(std::ostream &o) const
+	{
+		static const char *op_names[] = {"", "", "+", "-", "*", "/", "%", "^", "-x", "^2", "<", ">", "<=", ">="};
+		o << "< FlatExpression = {";
+		for (auto &node:mNodes) {
+			switch (node.op) {
+			case opcode::push_number:
+				o << " " << node.value;
+				break;
+			case opcode::push_var:
+				o << " " << mIds[node.index].get_id();
+				break;
+			default:
+				o << " " << op_names[static_cast<std::size_t>(node.op)];
+				break;
+			}
+		}
+		o << " } >";
+		return true;
+	}
+
 	const mapping<std::string, signal_types> compiler_type::signal_map = {
 		{";",   signal_types::endline_},
 		{"+",   signal_types::add_},
@@ -704,9 +728,11 @@ namespace cs {
 					decl+=")";
 				function func(context, decl, ret, args, std::deque<statement_base *> {ret}, is_vargs, true);
 #else
-				function func(context, args, std::deque<statement_base *> {ret}, is_vargs, true);
+				function func(context, ret, args, std::deque<statement_base *> {ret}, is_vargs, true);
 #endif
 				func.add_reserve_var("self");
+				// Folded into a token of the unit, so the owning context has to drop this reference, see compile_unit
+				func.hold_unit(compile_unit::hold_from_inside(compile_unit::current()));
 				var lambda = var::make<object_method>(var(), var::make_protect<callable>(func));
 				lambda.val<object_method>().object = lambda;
 				lambda.protect();
@@ -859,7 +885,7 @@ namespace cs {
 					token_base *orig_ptr = it.data();
 					try {
 						const var &v = context->instance->parse_dot(a, rptr);
-						if (v.is_protect())
+						if (v.is_protect() || is_pure_visitor(a, rptr))
 							it.data() = new_value(v);
 					}
 					catch (...) {
@@ -971,6 +997,164 @@ namespace cs {
 				it.data() = oldt;
 			}
 		}
+		else if (token->get_type() == token_types::signal && optimizable(it.left()) && it.left().data() != nullptr) {
+			// Short-circuit: false && x => false, true || x => true
+			signal_types sig = static_cast<token_signal *>(token)->get_signal();
+			const var &lval = static_cast<token_value *>(it.left().data())->get_value();
+			if ((sig == signal_types::and_ || sig == signal_types::or_) && lval.type() == typeid(boolean) &&
+			        lval.const_val<boolean>() == (sig == signal_types::or_)) {
+				token_base *lptr = it.left().data();
+				tree.erase_left(it);
+				tree.erase_right(it);
+				it.data() = lptr;
+			}
+		}
+	}
+
+	bool compiler_type::is_pure_visitor(const var &a, token_base *b)
+	{
+		if (a.type() == typeid(constant_values) || a.type() == typeid(namespace_t) || a.type() == typeid(type_t) ||
+		        a.type() == typeid(structure))
+			return false;
+		const var &member = a.get_ext()->get_var(static_cast<token_id *>(b)->get_id());
+		return member.type() == typeid(callable) &&
+		       member.const_val<callable>().type() == callable::types::member_visitor_fold;
+	}
+
+	bool compiler_type::flatten_node(tree_type<token_base *>::iterator it, token_flat &flat, std::size_t &ops,
+	                                 std::size_t &depth, bool predicate)
+	{
+		if (!it.usable() || it.data() == nullptr)
+			return false;
+		token_base *token = it.data();
+		switch (token->get_type()) {
+		default:
+			return false;
+		case token_types::value: {
+			const var &val = static_cast<token_value *>(token)->get_value();
+			if (val.type() != typeid(number))
+				return false;
+			flat.get_nodes().push_back({token_flat::opcode::push_number, 0, val.const_val<number>()});
+			depth = 1;
+			return true;
+		}
+		case token_types::id:
+			flat.get_nodes().push_back({token_flat::opcode::push_var, flat.get_ids().size(), 0});
+			flat.get_ids().push_back(static_cast<token_id *>(token)->get_id());
+			depth = 1;
+			return true;
+		case token_types::flat: {
+			// Parenthesized sub-expressions were flattened on their own before being merged
+			auto *child = static_cast<token_flat *>(token);
+			if (child->is_predicate())
+				return false;
+			std::size_t base = flat.get_ids().size();
+			for (auto node:child->get_nodes()) {
+				if (node.op == token_flat::opcode::push_var)
+					node.index += base;
+				else if (node.op != token_flat::opcode::push_number)
+					++ops;
+				flat.get_nodes().push_back(node);
+			}
+			for (auto &id:child->get_ids())
+				flat.get_ids().push_back(id);
+			depth = child->get_depth();
+			return true;
+		}
+		case token_types::signal:
+			break;
+		}
+		token_flat::opcode op;
+		switch (static_cast<token_signal *>(token)->get_signal()) {
+		default:
+			return false;
+		case signal_types::add_:
+			op = token_flat::opcode::add;
+			break;
+		case signal_types::sub_:
+			op = token_flat::opcode::sub;
+			break;
+		case signal_types::mul_:
+			op = token_flat::opcode::mul;
+			break;
+		case signal_types::div_:
+			op = token_flat::opcode::div;
+			break;
+		case signal_types::mod_:
+			op = token_flat::opcode::mod;
+			break;
+		case signal_types::pow_:
+			op = token_flat::opcode::pow;
+			break;
+		case signal_types::minus_:
+			op = token_flat::opcode::minus;
+			break;
+		case signal_types::und_:
+			op = token_flat::opcode::und;
+			break;
+		case signal_types::abo_:
+			op = token_flat::opcode::abo;
+			break;
+		case signal_types::ueq_:
+			op = token_flat::opcode::ueq;
+			break;
+		case signal_types::aeq_:
+			op = token_flat::opcode::aeq;
+			break;
+		}
+		if (op >= token_flat::opcode::und && !predicate)
+			return false;
+		std::size_t ldepth = 0, rdepth = 0;
+		// Strength reduction: x ^ 2 => x * x
+		if (op == token_flat::opcode::pow && it.right().data() != nullptr &&
+		        it.right().data()->get_type() == token_types::value) {
+			const var &exp = static_cast<token_value *>(it.right().data())->get_value();
+			if (exp.type() == typeid(number) && exp.const_val<number>() == 2) {
+				if (!flatten_node(it.left(), flat, ops, depth))
+					return false;
+				flat.get_nodes().push_back({token_flat::opcode::square, 0, 0});
+				// Worth flattening on its own, so count it twice
+				ops += 2;
+				return true;
+			}
+		}
+		if (op == token_flat::opcode::minus) {
+			if (it.left().data() != nullptr)
+				return false;
+		}
+		else if (!flatten_node(it.left(), flat, ops, ldepth))
+			return false;
+		if (!flatten_node(it.right(), flat, ops, rdepth))
+			return false;
+		flat.get_nodes().push_back({op, 0, 0});
+		++ops;
+		if (op == token_flat::opcode::minus)
+			depth = rdepth;
+		else
+			depth = ldepth > rdepth + 1 ? ldepth : rdepth + 1;
+		return true;
+	}
+
+	void compiler_type::flatten_expr(tree_type<token_base *> &tree, tree_type<token_base *>::iterator it)
+	{
+		if (!it.usable() || it.data() == nullptr || it.data()->get_type() != token_types::signal)
+			return;
+		token_flat flat;
+		std::size_t ops = 0, depth = 0;
+		if (flatten_node(it, flat, ops, depth, true)) {
+			// A single operator gains nothing over the tree walk
+			if (ops < 2)
+				return;
+			if (depth <= token_flat::max_depth) {
+				flat.set_depth(depth);
+				it.data() = new token_flat(std::move(flat));
+				tree.erase_left(it);
+				tree.erase_right(it);
+				return;
+			}
+		}
+		flatten_expr(tree, it.left());
+		flatten_expr(tree, it.right());
 	}
 
 	void compiler_type::try_fix_this_deduction(cs::tree_type<cs::token_base *>::iterator it)
@@ -1127,13 +1311,42 @@ namespace cs {
 		std::size_t method_line_num = 0, line_num = 0;
 		std::deque<std::deque<token_base *>> tmp;
 		stack_type<method_base *> methods;
+		// File-level function bodies are only split at block level and generated on first call
+		bool lazy = raw && current_process->lazy_compile && context->instance->storage.is_initial();
+		std::size_t lazy_level = 0;
+		std::deque<std::deque<token_base *>> lazy_block;
 		for (auto &it:lines) {
 			std::deque<token_base *> line = it;
 			line_num = static_cast<token_endline *>(line.back())->get_line_num();
 			try {
+				if (lazy_level > 0) {
+					method_base *m = this->match_skeleton(line);
+					if (m == nullptr)
+						throw compile_error("Unknown grammar.");
+					if (m->get_type() == method_types::block)
+						++lazy_level;
+					else if (m->get_target_type() == statement_types::end_ && --lazy_level == 0) {
+						if (static_cast<token_action *>(line.front())->get_action() != action_types::endblock_)
+							throw compile_error("Wrong grammar for function definition, expect end.");
+						line_num = method_line_num;
+						statement_base *sptr = methods.top()->translate(context, tmp);
+						static_cast<statement_function *>(sptr)->defer_block(std::move(lazy_block));
+						lazy_block.clear();
+						methods.pop();
+						tmp.clear();
+						statements.push_back(sptr);
+						continue;
+					}
+					lazy_block.push_back(it);
+					continue;
+				}
 				if (raw)
 					context->compiler->process_line(line);
-				method_base *m = this->match(line);
+				method_base *m = nullptr;
+				{
+					step_scope step("match_grammar");
+					m = this->match(line);
+				}
 				switch (m->get_type()) {
 				case method_types::null:
 					throw compile_error("Null type of grammar.");
@@ -1183,6 +1396,18 @@ namespace cs {
 				case method_types::block: {
 					if (methods.empty())
 						method_line_num = static_cast<token_endline *>(line.back())->get_line_num();
+					if (lazy && methods.empty() && m->get_target_type() == statement_types::function_) {
+						// Still check the declaration now, only the body waits
+						context->instance->storage.add_domain();
+						context->instance->storage.add_set();
+						m->preprocess(context, {line});
+						context->instance->storage.remove_set();
+						context->instance->storage.remove_domain();
+						methods.push(m);
+						tmp.push_back(line);
+						lazy_level = 1;
+						break;
+					}
 					methods.push(m);
 					if (raw) {
 						context->instance->storage.add_domain();
@@ -1207,4 +1432,41 @@ namespace cs {
 		if (!methods.empty())
 			throw compile_error("Lack of the \"end\" signal.");
 	}
-}
\ No newline at end of file
+
+	void compiler_type::code_gen_deferred(const context_t &cxt, const std::vector<std::string> &args,
+	                                      const std::deque<std::deque<token_base *>> &ast,
+	                                      std::deque<statement_base *> &code)
+	{
+		domain_manager &storage = cxt->instance->storage;
+		std::vector<domain_type> domains;
+		std::vector<set_t<string>> sets;
+		std::vector<var> pool;
+		// May run in the middle of another unit or a call chain, so set their state aside
+		storage.detach_scopes(domains, sets);
+		std::swap(pool, constant_pool);
+		context_t prev = swap_context(cxt);
+		bool lambda = inside_lambda;
+		inside_lambda = false;
+		auto restore = [&]() {
+			inside_lambda = lambda;
+			swap_context(prev);
+			std::swap(pool, constant_pool);
+			storage.attach_scopes(domains, sets);
+		};
+		try {
+			runtime_type::frame_guard frame(cxt->instance.get(), nullptr, nullptr);
+			storage.add_domain();
+			storage.add_set();
+			for (auto &name:args)
+				storage.add_record(name);
+			translator.translate(cxt, ast, code, true);
+			infer_types(code);
+			utilize_metadata();
+		}
+		catch (...) {
+			restore();
+			throw;
+		}
+		restore();
+	}
+}
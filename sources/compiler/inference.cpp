@@ -0,0 +1,691 @@
+/*
+* Covariant Script Type Inference
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Copyright (C) 2017-2022 Michael Lee(李登淳)
+*
+* This software is registered with the National Copyright Administration
+* of the People's Republic of China(Registration Number: 2020SR0408026)
+* and is protected by the Copyright Law of the People's Republic of China.
+*
+* Email:   lee@covariant.cn, mikecovlee@163.com
+* Github:  https://github.com/mikecovlee
+* Website: http://covscript.org.cn
+*/
+#include <covscript/impl/codegen.hpp>
+
+namespace cs {
+	using fact_t = type_inference::fact_t;
+
+	static bool is_type(fact_t type, const std::type_info &info)
+	{
+		return type != nullptr && *type == info;
+	}
+
+	// Arguments of these types can not bring script code into a native function
+	static bool is_plain(fact_t type)
+	{
+		return is_type(type, typeid(number)) || is_type(type, typeid(boolean)) || is_type(type, typeid(string)) ||
+		       is_type(type, typeid(char));
+	}
+
+	static namespace_t *builtin_ext(fact_t type)
+	{
+		if (is_type(type, typeid(string)))
+			return &cs_impl::get_ext<string>();
+		else if (is_type(type, typeid(array)))
+			return &cs_impl::get_ext<array>();
+		else if (is_type(type, typeid(char)))
+			return &cs_impl::get_ext<char>();
+		else if (is_type(type, typeid(list)))
+			return &cs_impl::get_ext<list>();
+		else if (is_type(type, typeid(hash_set)))
+			return &cs_impl::get_ext<hash_set>();
+		else if (is_type(type, typeid(hash_map)))
+			return &cs_impl::get_ext<hash_map>();
+		else if (is_type(type, typeid(pair)))
+			return &cs_impl::get_ext<pair>();
+		else
+			return nullptr;
+	}
+
+	static fact_t builtin_type(const type_id &id)
+	{
+		static const std::type_info *types[] = {&typeid(number), &typeid(boolean), &typeid(string), &typeid(array),
+		                                        &typeid(list), &typeid(hash_set), &typeid(hash_map), &typeid(pair)
+		                                       };
+		if (id.type_hash != 0)
+			return nullptr;
+		for (auto type:types)
+			if (id.type_idx == std::type_index(*type))
+				return type;
+		return nullptr;
+	}
+
+	static const callable *find_member(fact_t type, token_base *name)
+	{
+		namespace_t *ext = builtin_ext(type);
+		if (ext == nullptr || name == nullptr || name->get_type() != token_types::id)
+			return nullptr;
+		const std::string &id = static_cast<token_id *>(name)->get_id();
+		if (!(*ext)->get_domain().exist(id))
+			return nullptr;
+		const var &member = (*ext)->get_var(id);
+		return member.type() == typeid(callable) ? &member.const_val<callable>() : nullptr;
+	}
+
+	static bool is_native(const callable &func)
+	{
+		return func.get_raw_data().target<function>() == nullptr;
+	}
+
+	static bool is_visitor(const callable &func)
+	{
+		return func.type() == callable::types::member_visitor || func.type() == callable::types::member_visitor_fold;
+	}
+
+	// Only CNI functions declare what they return
+	static fact_t return_type(const callable &func)
+	{
+		const cni *ptr = func.get_raw_data().target<cni>();
+		if (ptr == nullptr || ptr->return_type() == typeid(void) || ptr->return_type() == typeid(var))
+			return nullptr;
+		return &ptr->return_type();
+	}
+
+	bool type_inference::same_state(const state_type &a, const state_type &b)
+	{
+		if (a.reachable != b.reachable || a.facts.size() != b.facts.size())
+			return false;
+		for (auto ait = a.facts.begin(), bit = b.facts.begin(); ait != a.facts.end(); ++ait, ++bit)
+			if (ait->first != bit->first || *ait->second != *bit->second)
+				return false;
+		return true;
+	}
+
+	void type_inference::merge(state_type &a, const state_type &b)
+	{
+		if (!b.reachable)
+			return;
+		if (!a.reachable) {
+			a = b;
+			return;
+		}
+		for (auto it = a.facts.begin(); it != a.facts.end();) {
+			auto found = b.facts.find(it->first);
+			if (found == b.facts.end() || *found->second != *it->second)
+				it = a.facts.erase(it);
+			else
+				++it;
+		}
+	}
+
+	void type_inference::forget(state_type &state, std::size_t depth) const
+	{
+		for (std::size_t i = depth; i < m_scopes.size(); ++i)
+			for (auto &name:m_scopes[i])
+				state.facts.erase(name);
+	}
+
+	fact_t type_inference::lookup(const std::string &name) const
+	{
+		auto found = m_state.facts.find(name);
+		return found != m_state.facts.end() ? found->second : nullptr;
+	}
+
+	void type_inference::assign(const std::string &name, fact_t type)
+	{
+		if (type == nullptr || m_aliased.count(name) > 0)
+			m_state.facts.erase(name);
+		else
+			m_state.facts[name] = type;
+	}
+
+	void type_inference::alias(tree_type<token_base *>::iterator it)
+	{
+		if (!it.usable() || it.data() == nullptr)
+			return;
+		token_base *token = it.data();
+		switch (token->get_type()) {
+		default:
+			break;
+		case token_types::id: {
+			const std::string &name = static_cast<token_id *>(token)->get_id();
+			m_aliased.insert(name);
+			m_state.facts.erase(name);
+			return;
+		}
+		case token_types::expr:
+			alias(static_cast<token_expr *>(token)->get_tree().root());
+			return;
+		case token_types::parallel:
+			for (auto &tree:static_cast<token_parallel *>(token)->get_parallel())
+				alias(tree.root());
+			return;
+		}
+		alias(it.left());
+		alias(it.right());
+	}
+
+	void type_inference::specialize(tree_type<token_base *>::iterator it, signal_types signal)
+	{
+		if (m_emit && static_cast<token_signal *>(it.data())->get_signal() != signal)
+			it.data() = new token_signal(signal, it.data()->get_line_num());
+	}
+
+	void type_inference::jump(bool is_break)
+	{
+		if (m_loops.empty()) {
+			clobber();
+			return;
+		}
+		if (m_state.reachable) {
+			loop_type &loop = m_loops.back();
+			state_type state = m_state;
+			forget(state, loop.depth);
+			merge(is_break ? loop.breaks : loop.continues, state);
+		}
+		terminate();
+	}
+
+	void type_inference::leave_scope()
+	{
+		for (auto &name:m_scopes.back())
+			m_state.facts.erase(name);
+		m_scopes.pop_back();
+	}
+
+	void type_inference::declare(const std::string &name, fact_t type)
+	{
+		m_scopes.back().push_back(name);
+		assign(name, type);
+	}
+
+	void type_inference::define(tree_type<token_base *>::iterator it, bool link)
+	{
+		token_base *token = it.data();
+		if (token == nullptr)
+			return;
+		if (token->get_type() == token_types::parallel) {
+			for (auto &tree:static_cast<token_parallel *>(token)->get_parallel())
+				define(tree.root(), link);
+			return;
+		}
+		if (token->get_type() != token_types::signal)
+			return;
+		switch (static_cast<token_signal *>(token)->get_signal()) {
+		default:
+			clobber();
+			break;
+		case signal_types::asi_: {
+			fact_t type = infer(it.right());
+			if (link)
+				alias(it);
+			declare(static_cast<token_id *>(it.left().data())->get_id(), type);
+			break;
+		}
+		case signal_types::bind_: {
+			infer(it.right());
+			std::function<void(tree_type<token_base *>::iterator)> bind;
+			bind = [&bind, this](tree_type<token_base *>::iterator it) {
+				for (auto &tree:static_cast<token_parallel *>(it.data())->get_parallel()) {
+					if (tree.root().data()->get_type() == token_types::parallel)
+						bind(tree.root());
+					else
+						declare(static_cast<token_id *>(tree.root().data())->get_id(), nullptr);
+				}
+			};
+			bind(it.left());
+			if (link)
+				alias(it);
+			break;
+		}
+		}
+	}
+
+	fact_t type_inference::infer_call(tree_type<token_base *>::iterator it)
+	{
+		token_base *func = it.left().data();
+		token_base *args = it.right().data();
+		const callable *target = nullptr;
+		if (func != nullptr && func->get_type() == token_types::value) {
+			const var &val = static_cast<token_value *>(func)->get_value();
+			if (val.type() == typeid(callable))
+				target = &val.const_val<callable>();
+			else if (val.type() == typeid(object_method) &&
+			         val.const_val<object_method>().callable.type() == typeid(callable))
+				target = &val.const_val<object_method>().callable.const_val<callable>();
+		}
+		else if (func != nullptr && func->get_type() == token_types::signal &&
+		         static_cast<token_signal *>(func)->get_signal() == signal_types::dot_) {
+			// Methods of builtin types
+			target = find_member(infer(it.left().left()), it.left().right().data());
+			if (target != nullptr && is_visitor(*target))
+				target = nullptr;
+		}
+		else
+			infer(it.left());
+		bool plain = true;
+		if (args != nullptr && args->get_type() == token_types::arglist) {
+			for (auto &tree:static_cast<token_arglist *>(args)->get_arglist()) {
+				token_base *ptr = tree.root().data();
+				if (ptr != nullptr && ptr->get_type() == token_types::expand) {
+					infer(static_cast<token_expand *>(ptr)->get_tree().root());
+					plain = false;
+				}
+				else if (!is_plain(infer(tree.root())))
+					plain = false;
+			}
+		}
+		if (target == nullptr || !is_native(*target)) {
+			clobber();
+			return nullptr;
+		}
+		// Native functions may still call back into script code through their arguments
+		if (!plain)
+			clobber();
+		return return_type(*target);
+	}
+
+	fact_t type_inference::infer(tree_type<token_base *>::iterator it)
+	{
+		if (!it.usable() || it.data() == nullptr)
+			return nullptr;
+		token_base *token = it.data();
+		switch (token->get_type()) {
+		default:
+			return nullptr;
+		case token_types::id:
+			return lookup(static_cast<token_id *>(token)->get_id());
+		case token_types::value:
+			return &static_cast<token_value *>(token)->get_value().type();
+		case token_types::literal:
+			// Custom literals are script functions
+			clobber();
+			return nullptr;
+		case token_types::expr:
+			return infer(static_cast<token_expr *>(token)->get_tree().root());
+		case token_types::flat: {
+			auto *flat = static_cast<token_flat *>(token);
+			for (auto &id:flat->get_ids())
+				if (!is_type(lookup(id.get_id()), typeid(number)))
+					return nullptr;
+			return flat->is_predicate() ? &typeid(boolean) : &typeid(number);
+		}
+		case token_types::array:
+			for (auto &tree:static_cast<token_array *>(token)->get_array()) {
+				token_base *ptr = tree.root().data();
+				if (ptr != nullptr && ptr->get_type() == token_types::expand)
+					infer(static_cast<token_expand *>(ptr)->get_tree().root());
+				else
+					infer(tree.root());
+			}
+			return &typeid(array);
+		case token_types::parallel: {
+			fact_t type = nullptr;
+			for (auto &tree:static_cast<token_parallel *>(token)->get_parallel())
+				type = infer(tree.root());
+			return type;
+		}
+		case token_types::signal:
+			break;
+		}
+		switch (static_cast<token_signal *>(token)->get_signal()) {
+		default:
+			clobber();
+			return nullptr;
+		case signal_types::add_:
+		case signal_types::add_num_: {
+			fact_t a = infer(it.left()), b = infer(it.right());
+			if (is_type(a, typeid(number)) && is_type(b, typeid(number))) {
+				specialize(it, signal_types::add_num_);
+				return a;
+			}
+			return is_type(a, typeid(string)) ? a : nullptr;
+		}
+		case signal_types::sub_:
+		case signal_types::mul_:
+		case signal_types::div_:
+		case signal_types::mod_:
+		case signal_types::pow_: {
+			fact_t a = infer(it.left()), b = infer(it.right());
+			return is_type(a, typeid(number)) && is_type(b, typeid(number)) ? a : nullptr;
+		}
+		case signal_types::minus_: {
+			fact_t b = infer(it.right());
+			return is_type(b, typeid(number)) ? b : nullptr;
+		}
+		case signal_types::addasi_:
+		case signal_types::addasi_str_: {
+			// Succeeding compound assignments keep the type of their left operand
+			fact_t a = infer(it.left());
+			infer(it.right());
+			if (is_type(a, typeid(string)))
+				specialize(it, signal_types::addasi_str_);
+			return a;
+		}
+		case signal_types::subasi_:
+		case signal_types::mulasi_:
+		case signal_types::divasi_:
+		case signal_types::modasi_:
+		case signal_types::powasi_: {
+			fact_t a = infer(it.left());
+			infer(it.right());
+			return a;
+		}
+		case signal_types::inc_:
+		case signal_types::dec_: {
+			tree_type<token_base *>::iterator operand = it.left().data() != nullptr ? it.left() : it.right();
+			infer(operand);
+			if (operand.data() != nullptr && operand.data()->get_type() == token_types::id)
+				assign(static_cast<token_id *>(operand.data())->get_id(), &typeid(number));
+			return &typeid(number);
+		}
+		case signal_types::asi_: {
+			token_base *lhs = it.left().data();
+			if (lhs != nullptr && lhs->get_type() == token_types::id) {
+				fact_t type = infer(it.right());
+				assign(static_cast<token_id *>(lhs)->get_id(), type);
+				return type;
+			}
+			infer(it.left());
+			return infer(it.right());
+		}
+		case signal_types::lnkasi_: {
+			alias(it.left());
+			alias(it.right());
+			// Resolved as an lvalue, which only knows the generic signals
+			bool emit = m_emit;
+			m_emit = false;
+			infer(it.left());
+			m_emit = emit;
+			infer(it.right());
+			return nullptr;
+		}
+		case signal_types::addr_:
+			alias(it.right());
+			infer(it.right());
+			return &typeid(pointer);
+		case signal_types::bind_: {
+			fact_t type = infer(it.right());
+			alias(it.left());
+			return type;
+		}
+		case signal_types::dot_: {
+			const callable *member = find_member(infer(it.left()), it.right().data());
+			return member != nullptr && is_visitor(*member) ? return_type(*member) : nullptr;
+		}
+		case signal_types::arrow_:
+		case signal_types::escape_:
+		case signal_types::typeid_:
+			infer(it.left());
+			infer(it.right());
+			return nullptr;
+		case signal_types::new_:
+		case signal_types::gcnew_: {
+			// Constructors of structures run their initializers, the ones of builtin types are native
+			fact_t type = nullptr;
+			token_base *target = it.right().data();
+			if (target != nullptr && target->get_type() == token_types::value &&
+			        static_cast<token_value *>(target)->get_value().type() == typeid(type_t))
+				type = builtin_type(static_cast<token_value *>(target)->get_value().const_val<type_t>().id);
+			else
+				infer(it.right());
+			if (type == nullptr)
+				clobber();
+			if (static_cast<token_signal *>(token)->get_signal() == signal_types::gcnew_)
+				return &typeid(pointer);
+			return type;
+		}
+		case signal_types::und_:
+		case signal_types::abo_:
+		case signal_types::ueq_:
+		case signal_types::aeq_:
+		case signal_types::equ_:
+		case signal_types::neq_:
+		case signal_types::not_:
+			infer(it.left());
+			infer(it.right());
+			return &typeid(boolean);
+		case signal_types::and_:
+		case signal_types::or_: {
+			infer(it.left());
+			state_type skipped = m_state;
+			infer(it.right());
+			merge(m_state, skipped);
+			return &typeid(boolean);
+		}
+		case signal_types::choice_: {
+			infer(it.left());
+			tree_type<token_base *>::iterator branches = it.right();
+			state_type other = m_state;
+			fact_t a = infer(branches.left());
+			std::swap(m_state, other);
+			fact_t b = infer(branches.right());
+			merge(m_state, other);
+			return a != nullptr && b != nullptr && *a == *b ? a : nullptr;
+		}
+		case signal_types::pair_:
+			infer(it.left());
+			infer(it.right());
+			return &typeid(pair);
+		case signal_types::fcall_:
+			return infer_call(it);
+		case signal_types::access_:
+		case signal_types::access_arr_: {
+			fact_t a = infer(it.left());
+			infer(it.right());
+			if (is_type(a, typeid(array)))
+				specialize(it, signal_types::access_arr_);
+			return is_type(a, typeid(string)) ? &typeid(char) : nullptr;
+		}
+		}
+	}
+
+	void type_inference::infer_statements(std::deque<statement_base *> &block)
+	{
+		for (auto &ptr:block)
+			ptr->infer_types(*this);
+	}
+
+	void type_inference::infer_block(std::deque<statement_base *> &block)
+	{
+		enter_scope();
+		infer_statements(block);
+		leave_scope();
+	}
+
+	void type_inference::infer_branches(tree_type<token_base *>::iterator cond, std::deque<statement_base *> &taken,
+	                                    std::deque<statement_base *> *otherwise)
+	{
+		infer(cond);
+		state_type other = m_state;
+		infer_block(taken);
+		std::swap(m_state, other);
+		if (otherwise != nullptr)
+			infer_block(*otherwise);
+		merge(m_state, other);
+	}
+
+	type_inference::state_type
+	type_inference::iterate(const state_type &start, const std::function<void()> &head,
+	                        const std::function<void()> &body, const std::function<void()> &tail, bool exit_head,
+	                        bool exit_tail, state_type &exit)
+	{
+		m_state = start;
+		m_loops.push_back(loop_type{m_scopes.size(), unreachable(), unreachable()});
+		if (head)
+			head();
+		if (exit_head)
+			merge(exit, m_state);
+		body();
+		merge(m_state, m_loops.back().continues);
+		if (tail)
+			tail();
+		if (exit_tail)
+			merge(exit, m_state);
+		merge(exit, m_loops.back().breaks);
+		m_loops.pop_back();
+		return m_state;
+	}
+
+	void type_inference::infer_loop(const std::function<void()> &head, const std::function<void()> &body,
+	                                const std::function<void()> &tail, bool exit_head, bool exit_tail)
+	{
+		state_type entry = m_state, start = entry, exit = unreachable();
+		// Facts at the head of the loop only ever shrink, so this settles quickly
+		bool emit = m_emit;
+		m_emit = false;
+		for (std::size_t count = 0;;) {
+			state_type next = iterate(start, head, body, tail, exit_head, exit_tail, exit);
+			merge(next, entry);
+			if (same_state(next, start))
+				break;
+			start = std::move(next);
+			if (++count == max_iterations) {
+				start.facts.clear();
+				break;
+			}
+		}
+		m_emit = emit;
+		exit = unreachable();
+		iterate(start, head, body, tail, exit_head, exit_tail, exit);
+		m_state = std::move(exit);
+	}
+
+	void compiler_type::infer_types(std::deque<statement_base *> &body)
+	{
+		if (disable_optimizer || no_optimize)
+			return;
+		step_scope step("infer_types");
+		type_inference inference;
+		inference.infer_statements(body);
+	}
+
+	void statement_base::infer_types(type_inference &inference)
+	{
+		inference.clobber();
+	}
+
+	void statement_expression::infer_types(type_inference &inference)
+	{
+		inference.infer(mTree.root());
+	}
+
+	void statement_var::infer_types(type_inference &inference)
+	{
+		inference.define(mTree.root(), link);
+	}
+
+	void statement_constant::infer_types(type_inference &inference)
+	{
+		inference.define(mTree.root(), false);
+	}
+
+	void statement_break::infer_types(type_inference &inference)
+	{
+		inference.jump(true);
+	}
+
+	void statement_continue::infer_types(type_inference &inference)
+	{
+		inference.jump(false);
+	}
+
+	void statement_block::infer_types(type_inference &inference)
+	{
+		inference.infer_block(mBlock);
+	}
+
+	void statement_if::infer_types(type_inference &inference)
+	{
+		inference.infer_branches(mTree.root(), mBlock, nullptr);
+	}
+
+	void statement_ifelse::infer_types(type_inference &inference)
+	{
+		inference.infer_branches(mTree.root(), mBlock, &mElseBlock);
+	}
+
+	void statement_while::infer_types(type_inference &inference)
+	{
+		inference.infer_loop([&] {
+			inference.infer(mTree.root());
+		}, [&] {
+			inference.infer_block(mBlock);
+		}, nullptr, true, false);
+	}
+
+	void statement_loop::infer_types(type_inference &inference)
+	{
+		inference.infer_loop(nullptr, [&] {
+			inference.infer_block(mBlock);
+		}, nullptr, false, false);
+	}
+
+	void statement_loop_until::infer_types(type_inference &inference)
+	{
+		// The condition sees the variables of the body
+		inference.infer_loop(nullptr, [&] {
+			inference.enter_scope();
+			inference.infer_statements(mBlock);
+		}, [&] {
+			inference.infer(mExpr.root());
+			inference.leave_scope();
+		}, false, true);
+	}
+
+	void statement_for::infer_types(type_inference &inference)
+	{
+		inference.enter_scope();
+		inference.define(mParallel[0].root(), false);
+		inference.infer_loop([&] {
+			inference.infer(mParallel[1].root());
+		}, [&] {
+			inference.infer_block(mBlock);
+		}, [&] {
+			inference.infer(mParallel[2].root());
+		}, true, false);
+		inference.leave_scope();
+	}
+
+	void statement_foreach::infer_types(type_inference &inference)
+	{
+		fact_t type = inference.infer(mObj.root()), element = nullptr;
+		if (is_type(type, typeid(range_type)))
+			element = &typeid(number);
+		else if (is_type(type, typeid(string)))
+			element = &typeid(char);
+		else if (is_type(type, typeid(hash_map)))
+			element = &typeid(pair);
+		inference.infer_loop(nullptr, [&] {
+			inference.enter_scope();
+			inference.declare(mIt, element);
+			inference.infer_statements(mBlock);
+			inference.leave_scope();
+		}, nullptr, true, false);
+	}
+
+	void statement_return::infer_types(type_inference &inference)
+	{
+		inference.infer(mTree.root());
+		inference.terminate();
+	}
+
+	void statement_throw::infer_types(type_inference &inference)
+	{
+		inference.infer(mTree.root());
+		inference.terminate();
+	}
+}
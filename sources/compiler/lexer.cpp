@@ -24,37 +24,33 @@
 * Website: http://covscript.org.cn
 */
 #include <covscript/impl/compiler.hpp>
-#include <codecvt>
 #include <cwctype>
 #include <climits>
+#include <cstring>
 
 namespace cs {
 	namespace codecvt {
+		/*
+		* Charsets decode the source bytes in place, ASCII bytes never reach them.
+		* Every supported encoding is a superset of ASCII, so the lexer handles
+		* the ASCII range through the classification table below and only calls
+		* back into the charset for multi-byte characters.
+		*/
 		class charset {
 		public:
 			virtual ~charset() = default;
 
-			virtual std::u32string local2wide(const std::deque<char> &) = 0;
-
-			virtual std::string wide2local(const std::u32string &) = 0;
+			// Decode a character which begins with a non-ASCII byte and advance the iterator
+			virtual char32_t next(const char *&, const char *) = 0;
 
 			virtual bool is_identifier(char32_t) = 0;
 		};
 
 		class ascii final : public charset {
 		public:
-			std::u32string local2wide(const std::deque<char> &local) override
+			char32_t next(const char *&it, const char *) override
 			{
-				return std::u32string(local.begin(), local.end());
-			}
-
-			std::string wide2local(const std::u32string &str) override
-			{
-				std::string local;
-				local.reserve(str.size());
-				for (auto ch:str)
-					local.push_back(ch);
-				return std::move(local);
+				return static_cast<unsigned char>(*it++);
 			}
 
 			bool is_identifier(char32_t ch) override
@@ -64,86 +60,63 @@ namespace cs {
 		};
 
 		class utf8 final : public charset {
-			std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> cvt;
-
-			static constexpr std::uint32_t ascii_max = 0x7F;
 		public:
-			std::u32string local2wide(const std::deque<char> &local) override
+			char32_t next(const char *&it, const char *end) override
 			{
-				std::string str(local.begin(), local.end());
-				return cvt.from_bytes(str);
-			}
-
-			std::string wide2local(const std::u32string &str) override
-			{
-				return cvt.to_bytes(str);
+				unsigned char head = *it++;
+				std::size_t tail_count = 0;
+				char32_t ch = 0;
+				if ((head & 0xE0) == 0xC0) {
+					tail_count = 1;
+					ch = head & 0x1F;
+				}
+				else if ((head & 0xF0) == 0xE0) {
+					tail_count = 2;
+					ch = head & 0x0F;
+				}
+				else if ((head & 0xF8) == 0xF0) {
+					tail_count = 3;
+					ch = head & 0x07;
+				}
+				else
+					throw compile_error("Codecvt: Bad encoding.");
+				for (std::size_t i = 0; i < tail_count; ++i) {
+					if (it == end || (static_cast<unsigned char>(*it) & 0xC0) != 0x80)
+						throw compile_error("Codecvt: Bad encoding.");
+					ch = ch << 6 | (static_cast<unsigned char>(*it++) & 0x3F);
+				}
+				static constexpr char32_t min_value[] = {0, 0x80, 0x800, 0x10000};
+				if (ch < min_value[tail_count] || ch > 0x10FFFF || (ch >= 0xD800 && ch <= 0xDFFF))
+					throw compile_error("Codecvt: Bad encoding.");
+				return ch;
 			}
 
 			bool is_identifier(char32_t ch) override
 			{
-				if (compiler_type::issignal(ch))
-					return false;
 				/**
 				 * Chinese Character in Unicode Charset
 				 * Basic:    0x4E00 - 0x9FA5
 				 * Extended: 0x9FA6 - 0x9FEF
 				 * Special:  0x3007
 				 */
-				if (ch > ascii_max)
-					return (ch >= 0x4E00 && ch <= 0x9FA5) || (ch >= 0x9FA6 && ch <= 0x9FEF) || ch == 0x3007;
-				else
-					return ch == '_' || std::iswalnum(ch);
+				return (ch >= 0x4E00 && ch <= 0x9FA5) || (ch >= 0x9FA6 && ch <= 0x9FEF) || ch == 0x3007;
 			}
 		};
 
 		class gbk final : public charset {
-			static inline char32_t set_zero(char32_t ch)
-			{
-				return ch & 0x0000ffff;
-			}
-
-			static constexpr std::uint8_t u8_blck_begin = 0x80;
 			static constexpr std::uint32_t u32_blck_begin = 0x8000;
 		public:
-			std::u32string local2wide(const std::deque<char> &local) override
+			char32_t next(const char *&it, const char *end) override
 			{
-				std::u32string wide;
-				uint32_t head = 0;
-				bool read_next = true;
-				for (auto it = local.begin(); it != local.end();) {
-					if (read_next) {
-						head = *(it++);
-						if (head & u8_blck_begin)
-							read_next = false;
-						else
-							wide.push_back(set_zero(head));
-					}
-					else {
-						std::uint8_t tail = *(it++);
-						wide.push_back(set_zero(head << 8 | tail));
-						read_next = true;
-					}
-				}
-				if (!read_next)
+				std::uint32_t head = static_cast<unsigned char>(*it++);
+				if (it == end)
 					throw compile_error("Codecvt: Bad encoding.");
-				return std::move(wide);
-			}
-
-			std::string wide2local(const std::u32string &wide) override
-			{
-				std::string local;
-				for (auto &ch:wide) {
-					if (ch & u32_blck_begin)
-						local.push_back(ch >> 8);
-					local.push_back(ch);
-				}
-				return std::move(local);
+				std::uint32_t tail = static_cast<unsigned char>(*it++);
+				return (head << 8 | tail) & 0x0000ffff;
 			}
 
 			bool is_identifier(char32_t ch) override
 			{
-				if (compiler_type::issignal(ch))
-					return false;
 				/**
 				 * Chinese Character in GBK Charset
 				 * GBK/2: 0xB0A1 - 0xF7FE
@@ -155,16 +128,45 @@ namespace cs {
 					return (ch >= 0xB0A1 && ch <= 0xF7FE) || (ch >= 0x8140 && ch <= 0xA0FE) ||
 					       (ch >= 0xAA40 && ch <= 0xFEA0) || ch == 0xA996;
 				else
-					return ch == '_' || std::iswalnum(ch);
+					return false;
+			}
+		};
+
+		// Classification of ASCII characters, one table lookup replaces the chain of ctype calls
+		enum ascii_class : unsigned char {
+			class_space = 1, class_digit = 2, class_identifier = 4, class_signal = 8
+		};
+
+		struct ascii_table final {
+			unsigned char data[128] = {0};
+
+			ascii_table()
+			{
+				for (int ch = 0; ch < 128; ++ch) {
+					if (std::iswspace(ch))
+						data[ch] |= class_space;
+					if (std::iswdigit(ch))
+						data[ch] |= class_digit;
+					if (ch == '_' || std::iswalnum(ch))
+						data[ch] |= class_identifier;
+					if (compiler_type::issignal(ch))
+						data[ch] |= class_signal;
+				}
+			}
+
+			inline bool is(char32_t ch, ascii_class type) const
+			{
+				return ch < 128 && (data[ch] & type);
 			}
 		};
 	}
 
-	void compiler_type::process_char_buff(const std::deque<char> &raw_buff, std::deque<token_base *> &tokens,
+	void compiler_type::process_char_buff(const char *begin, const char *end, std::deque<token_base *> &tokens,
 	                                      charset encoding)
 	{
-		if (raw_buff.empty())
+		if (begin == end)
 			throw compile_error("Received empty character buffer.");
+		static const codecvt::ascii_table table;
 		std::unique_ptr<codecvt::charset> cvt = nullptr;
 		switch (encoding) {
 		case charset::ascii:
@@ -177,270 +179,206 @@ namespace cs {
 			cvt = std::make_unique<codecvt::gbk>();
 			break;
 		}
-		std::u32string buff = cvt->local2wide(raw_buff);
-		std::u32string tmp;
-		token_types type = token_types::null;
-		bool inside_char = false;
-		bool inside_str = false;
-		bool escape = false;
-		for (auto it = buff.begin(); it != buff.end();) {
-			if (inside_char) {
-				if (escape) {
-					tmp += escape_map.match(*it);
-					escape = false;
-				}
-				else if (*it == '\\') {
-					escape = true;
-				}
-				else if (*it == '\'') {
-					if (tmp.empty())
-						throw compile_error("Do not allow empty character.");
-					if (tmp.size() > 1)
-						throw compile_error("Char must be a single character.");
-					if (tmp[0] > CHAR_MAX)
-						throw compile_error("Do not support unicode character. Please using string instead.");
-					tokens.push_back(new_value((char) tmp[0]));
-					tmp.clear();
-					inside_char = false;
-				}
-				else {
-					tmp += *it;
-				}
-				++it;
-				continue;
+		auto next = [&](const char *&it) -> char32_t {
+			if (static_cast<unsigned char>(*it) < 0x80)
+				return *it++;
+			else
+				return cvt->next(it, end);
+		};
+		auto is_identifier = [&](char32_t ch) -> bool {
+			if (ch < 0x80)
+				return table.is(ch, codecvt::class_identifier);
+			else
+				return cvt->is_identifier(ch);
+		};
+		// Scan a run of identifier characters, returns the end of the run
+		auto scan_identifier = [&](const char *it) -> const char * {
+			while (it != end) {
+				const char *posit = it;
+				if (!is_identifier(next(posit)))
+					break;
+				it = posit;
 			}
-			if (inside_str) {
-				if (escape) {
-					tmp += escape_map.match(*it);
-					escape = false;
-				}
-				else if (*it == '\\') {
-					escape = true;
-				}
-				else if (*it == '\"') {
-					inside_str = false;
-					if (cvt->is_identifier(*(it + 1))) {
-						tokens.push_back(new token_literal(cvt->wide2local(tmp), ""));
-						type = token_types::literal;
+			return it;
+		};
+		auto new_signal = [&tokens](const std::string &sig) {
+			tokens.push_back(new token_signal(signal_map.match(sig)));
+		};
+		std::string tmp;
+		for (const char *it = begin; it != end;) {
+			const char *start = it;
+			char32_t ch = next(it);
+			if (ch == '\"') {
+				// Keep the original bytes of the content, only escapes need translation
+				bool escape = false;
+				for (tmp.clear();; ) {
+					if (it == end)
+						throw compile_error("Lack of the \".");
+					const char *posit = it;
+					ch = next(it);
+					if (escape) {
+						tmp.push_back(static_cast<char>(escape_map.match(ch)));
+						escape = false;
 					}
+					else if (ch == '\\')
+						escape = true;
+					else if (ch == '\"')
+						break;
 					else
-						tokens.push_back(new_value(cvt->wide2local(tmp)));
-					tmp.clear();
+						tmp.append(posit, it);
 				}
-				else {
-					tmp += *it;
+				const char *posit = it;
+				if (it != end && is_identifier(next(posit))) {
+					const char *literal_end = scan_identifier(it);
+					tokens.push_back(new token_literal(tmp, std::string(it, literal_end)));
+					it = literal_end;
 				}
-				++it;
-				continue;
+				else
+					tokens.push_back(new_value(tmp));
 			}
-			if (*it == '#')
-				break;
-			switch (type) {
-			default:
-				break;
-			case token_types::null:
-				if (*it == '\"') {
-					inside_str = true;
-					++it;
-					continue;
-				}
-				if (*it == '\'') {
-					inside_char = true;
-					++it;
-					continue;
-				}
-				if (std::iswspace(*it)) {
-					++it;
-					continue;
-				}
-				if (issignal(*it)) {
-					type = token_types::signal;
-					continue;
-				}
-				if (std::iswdigit(*it)) {
-					type = token_types::value;
-					continue;
-				}
-				if (cvt->is_identifier(*it)) {
-					type = token_types::id;
-					continue;
-				}
-				throw compile_error(std::string("Uknown character: " + cvt->wide2local(std::u32string(1, *it))));
-				break;
-			case token_types::id:
-				if (cvt->is_identifier(*it)) {
-					tmp += *it;
-					++it;
-					continue;
-				}
-				type = token_types::null;
-				if (reserved_map.exist(cvt->wide2local(tmp))) {
-					tokens.push_back(reserved_map.match(cvt->wide2local(tmp))());
-					tmp.clear();
-					break;
-				}
-				tokens.push_back(new token_id(cvt->wide2local(tmp)));
-				tmp.clear();
-				break;
-			case token_types::literal:
-				if (cvt->is_identifier(*it)) {
-					tmp += *it;
-					++it;
-					continue;
+			else if (ch == '\'') {
+				bool escape = false;
+				std::size_t count = 0;
+				char32_t value = 0;
+				while (true) {
+					if (it == end)
+						throw compile_error("Lack of the \'.");
+					ch = next(it);
+					if (escape) {
+						value = escape_map.match(ch);
+						++count;
+						escape = false;
+					}
+					else if (ch == '\\')
+						escape = true;
+					else if (ch == '\'')
+						break;
+					else {
+						value = ch;
+						++count;
+					}
 				}
-				type = token_types::null;
-				static_cast<token_literal *>(tokens.back())->m_literal = cvt->wide2local(tmp);
-				tmp.clear();
+				if (count == 0)
+					throw compile_error("Do not allow empty character.");
+				if (count > 1)
+					throw compile_error("Char must be a single character.");
+				if (value > CHAR_MAX)
+					throw compile_error("Do not support unicode character. Please using string instead.");
+				tokens.push_back(new_value((char) value));
+			}
+			else if (ch == '#')
 				break;
-			case token_types::signal: {
-				if (issignal(*it)) {
-					tmp += *it;
+			else if (ch < 0x80 ? table.is(ch, codecvt::class_space) : std::iswspace(ch))
+				continue;
+			else if (table.is(ch, codecvt::class_signal)) {
+				while (it != end && table.is(*it, codecvt::class_signal))
 					++it;
-					continue;
-				}
-				type = token_types::null;
-				std::u32string sig;
-				for (auto &ch:tmp) {
-					if (!signal_map.exist(cvt->wide2local(sig + ch))) {
-						tokens.push_back(new token_signal(signal_map.match(cvt->wide2local(sig))));
-						sig = ch;
+				// Split the run of signal characters greedily
+				std::string sig;
+				for (const char *posit = start; posit != it; ++posit) {
+					if (!signal_map.exist(sig + *posit)) {
+						new_signal(sig);
+						sig = *posit;
 					}
 					else
-						sig += ch;
+						sig += *posit;
 				}
 				if (!sig.empty())
-					tokens.push_back(new token_signal(signal_map.match(cvt->wide2local(sig))));
-				tmp.clear();
-				break;
+					new_signal(sig);
 			}
-			case token_types::value:
-				if (std::iswdigit(*it) || *it == '.') {
-					tmp += *it;
+			else if (table.is(ch, codecvt::class_digit)) {
+				while (it != end && (table.is(*it, codecvt::class_digit) || *it == '.'))
 					++it;
-					continue;
-				}
-				type = token_types::null;
-				tokens.push_back(new_value(parse_number(cvt->wide2local(tmp))));
-				tmp.clear();
-				break;
+				tokens.push_back(new_value(parse_number(std::string(start, it))));
 			}
-		}
-		if (inside_char)
-			throw compile_error("Lack of the \'.");
-		if (inside_str)
-			throw compile_error("Lack of the \".");
-		if (tmp.empty())
-			return;
-		switch (type) {
-		default:
-			break;
-		case token_types::id:
-			if (reserved_map.exist(cvt->wide2local(tmp))) {
-				tokens.push_back(reserved_map.match(cvt->wide2local(tmp))());
-				tmp.clear();
-				break;
-			}
-			tokens.push_back(new token_id(cvt->wide2local(tmp)));
-			break;
-		case token_types::literal:
-			static_cast<token_literal *>(tokens.back())->m_literal = cvt->wide2local(tmp);
-			break;
-		case token_types::signal: {
-			std::u32string sig;
-			for (auto &ch:tmp) {
-				if (!signal_map.exist(cvt->wide2local(sig + ch))) {
-					tokens.push_back(new token_signal(signal_map.match(cvt->wide2local(sig))));
-					sig = ch;
-				}
+			else if (is_identifier(ch)) {
+				it = scan_identifier(it);
+				std::string id(start, it);
+				if (reserved_map.exist(id))
+					tokens.push_back(reserved_map.match(id)());
 				else
-					sig += ch;
+					tokens.push_back(new token_id(id));
 			}
-			if (!sig.empty())
-				tokens.push_back(new token_signal(signal_map.match(cvt->wide2local(sig))));
-			break;
-		}
-		case token_types::value:
-			tokens.push_back(new_value(parse_number(cvt->wide2local(tmp))));
-			break;
+			else
+				throw compile_error(std::string("Uknown character: " + std::string(start, it)));
 		}
 	}
 
 	class compiler_type::preprocessor final {
 		std::size_t last_line_num = 1, line_num = 1;
-		bool is_annotation = false;
-		bool is_command = false;
 		bool multi_line = false;
-		bool empty_buff = true;
-		bool empty_line = true;
-		std::deque<char> buff;
-		std::string command;
-		std::string line;
 
 		void new_empty_line(const context_t &context)
 		{
 			context->file_buff.emplace_back();
-			empty_line = true;
 			++line_num;
 		}
 
-		void process_endline(const context_t &context, compiler_type &compiler, std::deque<token_base *> &tokens,
-		                     charset &encoding)
+		void process_command(const context_t &context, std::deque<token_base *> &tokens, charset &encoding,
+		                     std::string command)
 		{
-			if (is_annotation) {
-				is_annotation = false;
-				new_empty_line(context);
-				return;
+			if (command == "begin" && !multi_line)
+				multi_line = true;
+			else if (command == "end" && multi_line) {
+				tokens.push_back(new token_endline(last_line_num));
+				multi_line = false;
 			}
-			if (is_command) {
-				is_command = false;
-				if (command == "begin" && !multi_line)
-					multi_line = true;
-				else if (command == "end" && multi_line) {
-					tokens.push_back(new token_endline(last_line_num));
-					multi_line = false;
-				}
-				else {
-					auto pos = command.find(':');
-					std::string arg;
-					if (pos != std::string::npos) {
-						arg = command.substr(pos + 1);
-						command = command.substr(0, pos);
-					}
-					if (command == "charset") {
-						if (arg == "ascii")
-							encoding = charset::ascii;
-						else if (arg == "utf8")
-							encoding = charset::utf8;
-						else if (arg == "gbk")
-							encoding = charset::gbk;
-						else
-							throw exception(line_num, context->file_path, "@" + command + ": " + arg,
-							                "Unavailable encoding.");
-					}
-					else if (command == "require") {
-						std::string version_str = CS_GET_VERSION_STR(COVSCRIPT_STD_VERSION);
-						if (arg > version_str)
-							throw exception(line_num, context->file_path, "@" + command + ": " + arg,
-							                "Newer Language Standard required: " + arg + ", now on " + version_str);
-					}
+			else {
+				auto pos = command.find(':');
+				std::string arg;
+				if (pos != std::string::npos) {
+					arg = command.substr(pos + 1);
+					command = command.substr(0, pos);
+				}
+				if (command == "charset") {
+					if (arg == "ascii")
+						encoding = charset::ascii;
+					else if (arg == "utf8")
+						encoding = charset::utf8;
+					else if (arg == "gbk")
+						encoding = charset::gbk;
 					else
-						throw exception(line_num, context->file_path, "@" + command + (arg.empty() ? "" : ": " + arg),
-						                "Wrong grammar for preprocessor command.");
+						throw exception(line_num, context->file_path, "@" + command + ": " + arg,
+						                "Unavailable encoding.");
+				}
+				else if (command == "require") {
+					std::string version_str = CS_GET_VERSION_STR(COVSCRIPT_STD_VERSION);
+					if (arg > version_str)
+						throw exception(line_num, context->file_path, "@" + command + ": " + arg,
+						                "Newer Language Standard required: " + arg + ", now on " + version_str);
 				}
-				command.clear();
+				else
+					throw exception(line_num, context->file_path, "@" + command + (arg.empty() ? "" : ": " + arg),
+					                "Wrong grammar for preprocessor command.");
+			}
+		}
+
+		void process_line(const context_t &context, compiler_type &compiler, std::deque<token_base *> &tokens,
+		                  charset &encoding, const char *begin, const char *end)
+		{
+			while (begin != end && std::isspace(static_cast<unsigned char>(*begin)))
+				++begin;
+			if (begin == end || *begin == '#') {
+				new_empty_line(context);
+				return;
 			}
-			if (empty_buff) {
+			if (*begin == '@') {
+				std::string command;
+				for (++begin; begin != end; ++begin)
+					if (!std::isspace(static_cast<unsigned char>(*begin)))
+						command.push_back(*begin);
+				process_command(context, tokens, encoding, std::move(command));
 				new_empty_line(context);
 				return;
 			}
 			try {
-				compiler.process_char_buff(buff, tokens, encoding);
+				compiler.process_char_buff(begin, end, tokens, encoding);
 			}
 			catch (const cs::exception &e) {
 				throw e;
 			}
 			catch (const std::exception &e) {
-				throw exception(line_num, context->file_path, line, e.what());
+				throw exception(line_num, context->file_path, std::string(begin, end), e.what());
 			}
 			for (auto it = tokens.rbegin(); it != tokens.rend(); ++it) {
 				if (*it != nullptr) {
@@ -453,50 +391,23 @@ namespace cs {
 			}
 			if (!multi_line)
 				tokens.push_back(new token_endline(line_num));
-			context->file_buff.emplace_back(line);
+			context->file_buff.emplace_back(begin, end);
 			last_line_num = line_num++;
-			buff.clear();
-			line.clear();
-			empty_buff = true;
-			empty_line = true;
 		}
 
 	public:
-		explicit preprocessor(const context_t &context, compiler_type &compiler, const std::deque<char> &char_buff,
+		explicit preprocessor(const context_t &context, compiler_type &compiler, const char *begin, const char *end,
 		                      std::deque<token_base *> &tokens, charset encoding)
 		{
-			for (auto &ch:char_buff) {
-				if (ch == '\n') {
-					process_endline(context, compiler, tokens, encoding);
-					continue;
-				}
-				if (is_annotation)
-					continue;
-				if (is_command) {
-					if (!std::isspace(ch))
-						command.push_back(ch);
-					continue;
-				}
-				if (empty_line && !std::isspace(ch)) {
-					switch (ch) {
-					case '#':
-						is_annotation = true;
-						continue;
-					case '@':
-						is_command = true;
-						continue;
-					default:
-						empty_buff = false;
-						empty_line = false;
-						break;
-					}
-				}
-				if (!empty_buff) {
-					buff.push_back(ch);
-					line.push_back(ch);
-				}
+			// memchr is vectorized by the C library, lines are located without touching every byte in C++ code
+			while (begin != end) {
+				const char *line_end = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+				if (line_end == nullptr)
+					break;
+				process_line(context, compiler, tokens, encoding, begin, line_end);
+				begin = line_end + 1;
 			}
-			process_endline(context, compiler, tokens, encoding);
+			process_line(context, compiler, tokens, encoding, begin, end);
 			if (multi_line)
 				throw compile_error("Lack of the @end command.");
 		}
@@ -514,6 +425,7 @@ namespace cs {
 				ptr = new token_endline(ptr->get_line_num());
 			if (ptr->get_type() == token_types::action || ptr->get_type() == token_types::endline) {
 				if (!expr.empty()) {
+					step_scope step("match_grammar");
 					translator.match_grammar(context, expr);
 					for (auto &it:expr)
 						tokens.push_back(it);
@@ -537,10 +449,10 @@ namespace cs {
 			ast.push_back(tmp);
 	}
 
-	void compiler_type::translate_into_tokens(const std::deque<char> &char_buff, std::deque<token_base *> &tokens,
+	void compiler_type::translate_into_tokens(const char *begin, const char *end, std::deque<token_base *> &tokens,
 	        charset encoding)
 	{
-		preprocessor(context, *this, char_buff, tokens, encoding);
+		preprocessor(context, *this, begin, end, tokens, encoding);
 	}
 
 	void compiler_type::process_empty_brackets(std::deque<token_base *> &tokens)
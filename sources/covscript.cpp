@@ -81,7 +81,7 @@ std::ostream &operator<<(std::ostream &out, const cs_impl::any &val)
 }
 
 namespace cs_impl {
-	default_allocator<any::proxy> any::allocator;
+	default_allocator<any::proxy> any::allocator(any::proxy_name);
 	cs::namespace_t member_visitor_ext = cs::make_shared_namespace<cs::name_space>();
 	cs::namespace_t except_ext = cs::make_shared_namespace<cs::name_space>();
 	cs::namespace_t array_ext = cs::make_shared_namespace<cs::name_space>();
@@ -110,6 +110,7 @@ namespace cs_impl {
 	cs::namespace_t path_ext = cs::make_shared_namespace<cs::name_space>();
 	cs::namespace_t path_type_ext = cs::make_shared_namespace<cs::name_space>();
 	cs::namespace_t path_info_ext = cs::make_shared_namespace<cs::name_space>();
+	cs::namespace_t pipeline_ext = cs::make_shared_namespace<cs::name_space>();
 }
 
 namespace cs {
@@ -136,8 +137,11 @@ namespace cs {
 
 	std::size_t struct_builder::mCount = 0;
 
+	std::size_t domain_type::mCount = 0;
+
 	void copy_no_return(var &val)
 	{
+		++current_process->copy_count;
 		if (!val.is_rvalue()) {
 			val.clone();
 			val.detach();
@@ -148,6 +152,7 @@ namespace cs {
 
 	var copy(var val)
 	{
+		++current_process->copy_count;
 		if (!val.is_rvalue()) {
 			val.clone();
 			val.detach();
@@ -192,11 +197,39 @@ namespace cs {
 
 	garbage_collector<cov::dll> extension::gc;
 
-	garbage_collector<token_base> token_base::gc;
+	memory_arena<token_base> token_base::gc;
+
+	memory_arena<statement_base> statement_base::gc;
+
+	memory_arena<method_base> method_base::gc;
+
+	compile_unit *compile_unit::m_current = nullptr;
 
-	garbage_collector<statement_base> statement_base::gc;
+	std::size_t compile_unit::m_token_count = 0;
 
-	garbage_collector<method_base> method_base::gc;
+	std::size_t compile_unit::m_statement_count = 0;
+
+	std::size_t compile_unit::m_bytes = 0;
+
+	compile_unit::~compile_unit()
+	{
+		// Statements refer to the tokens of their unit, so they go first
+		for (auto it = m_statements.rbegin(); it != m_statements.rend(); ++it)
+			(*it)->~statement_base();
+		for (auto it = m_tokens.rbegin(); it != m_tokens.rend(); ++it)
+			(*it)->~token_base();
+		m_statement_count -= m_statements.size();
+		m_token_count -= m_tokens.size();
+		m_bytes -= m_size;
+	}
+
+	void compile_unit::release(compile_unit *unit)
+	{
+		if (current_process->profiling != nullptr)
+			current_process->profiling->keep_unit(unit);
+		else
+			delete unit;
+	}
 
 #ifdef COVSCRIPT_PLATFORM_WIN32
 
@@ -335,201 +368,289 @@ namespace cs {
 		a.swap(b, true);
 	}
 
+	// Grammar and builtin symbols never change after start-up, so they are built once per process and every
+	// new context copies them. Like the rest of the runtime, the template is not meant to be shared across threads.
+	struct context_template final {
+		translator_type grammar;
+		domain_manager buildin;
+	};
+
+	static const context_template &get_context_template()
+	{
+		static std::unique_ptr<context_template> instance;
+		if (!instance) {
+			// Only a complete template is kept, a failed build is started over by the next call
+			std::unique_ptr<context_template> building = std::make_unique<context_template>();
+			context_template &tmpl = *building;
+			// Shared by every context, never part of the unit being compiled
+			compile_unit::scope scope(nullptr);
+			cs_impl::init_extensions();
+			// Grammar
+			tmpl.grammar
+			// Expression Grammar
+			.add_method({new token_expr(tree_type<token_base *>()), new token_endline(0)},
+			new method_expression)
+			// Import Grammar
+			.add_method({new token_action(action_types::import_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_import)
+			.add_method({new token_action(action_types::import_), new token_expr(tree_type<token_base *>()),
+				            new token_action(action_types::as_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_import_as)
+			// Package Grammar
+			.add_method({new token_action(action_types::package_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_package)
+			// Involve Grammar
+			.add_method({new token_action(action_types::using_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_involve)
+			// Var Grammar
+			.add_method({new token_action(action_types::var_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_var)
+			.add_method({new token_action(action_types::link_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_link)
+			.add_method({new token_action(action_types::constant_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)},
+			new method_constant)
+			// End Grammar
+			.add_method({new token_action(action_types::endblock_), new token_endline(0)}, new method_end)
+			// Block Grammar
+			.add_method({new token_action(action_types::block_), new token_endline(0)}, new method_block)
+			// Namespace Grammar
+			.add_method({new token_action(action_types::namespace_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_namespace)
+			// If Grammar
+			.add_method({new token_action(action_types::if_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_if)
+			// Else Grammar
+			.add_method({new token_action(action_types::else_), new token_endline(0)}, new method_else)
+			// Switch Grammar
+			.add_method({new token_action(action_types::switch_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_switch)
+			// Case Grammar
+			.add_method({new token_action(action_types::case_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_case)
+			// Default Grammar
+			.add_method({new token_action(action_types::default_), new token_endline(0)},
+			new method_default)
+			// While Grammar
+			.add_method({new token_action(action_types::while_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_while)
+			// Until Grammar
+			.add_method({new token_action(action_types::until_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_until)
+			// Loop Grammar
+			.add_method({new token_action(action_types::loop_), new token_endline(0)}, new method_loop)
+			// For Grammar
+			.add_method({new token_action(action_types::for_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_for)
+			.add_method({new token_action(action_types::for_), new token_expr(tree_type<token_base *>()),
+				            new token_action(action_types::do_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_for_do)
+			.add_method({new token_action(action_types::foreach_), new token_expr(tree_type<token_base *>()),
+				            new token_action(action_types::in_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_foreach)
+			.add_method({new token_action(action_types::foreach_), new token_expr(tree_type<token_base *>()),
+				            new token_action(action_types::in_), new token_expr(tree_type<token_base *>()),
+				            new token_action(action_types::do_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_foreach_do)
+			// Break Grammar
+			.add_method({new token_action(action_types::break_), new token_endline(0)}, new method_break)
+			// Continue Grammar
+			.add_method({new token_action(action_types::continue_), new token_endline(0)},
+			new method_continue)
+			// Function Grammar
+			.add_method({new token_action(action_types::function_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_function)
+			.add_method({new token_action(action_types::function_), new token_expr(tree_type<token_base *>()),
+				            new token_action(action_types::override_), new token_endline(0)},
+			new method_function)
+			// Return Grammar
+			.add_method({new token_action(action_types::return_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_return)
+			.add_method({new token_action(action_types::return_), new token_endline(0)},
+			new method_return_no_value)
+			// Struct Grammar
+			.add_method({new token_action(action_types::struct_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_struct)
+			.add_method({new token_action(action_types::struct_), new token_expr(tree_type<token_base *>()),
+				            new token_action(action_types::extends_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_struct)
+			// Try Grammar
+			.add_method({new token_action(action_types::try_), new token_endline(0)}, new method_try)
+			// Catch Grammar
+			.add_method({new token_action(action_types::catch_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_catch)
+			// Throw Grammar
+			.add_method({new token_action(action_types::throw_), new token_expr(tree_type<token_base *>()),
+				            new token_endline(0)}, new method_throw);
+			// Builtin Symbols
+			tmpl.buildin
+			// Internal Types
+			.add_buildin_type("char", []() -> var { return var::make<char>('\0'); }, typeid(char),
+			                  cs_impl::char_ext)
+			.add_buildin_type("number", []() -> var { return var::make<number>(0); }, typeid(number))
+			.add_buildin_type("boolean", []() -> var { return var::make<boolean>(true); }, typeid(boolean))
+			.add_buildin_type("pointer", []() -> var { return var::make<pointer>(null_pointer); }, typeid(pointer))
+			.add_buildin_type("string", []() -> var { return var::make<string>(); }, typeid(string),
+			                  cs_impl::string_ext)
+			.add_buildin_type("list", []() -> var { return var::make<list>(); }, typeid(list), cs_impl::list_ext)
+			.add_buildin_type("array", []() -> var { return var::make<array>(); }, typeid(array),
+			                  cs_impl::array_ext)
+			.add_buildin_type("pair", []() -> var { return var::make<pair>(number(0), number(0)); }, typeid(pair),
+			                  cs_impl::pair_ext)
+			.add_buildin_type("hash_set", []() -> var { return var::make<hash_set>(); }, typeid(hash_set),
+			                  cs_impl::hash_set_ext)
+			.add_buildin_type("hash_map", []() -> var { return var::make<hash_map>(); }, typeid(hash_map),
+			                  cs_impl::hash_map_ext)
+			// Add Internal Functions to storage
+			.add_buildin_var("range", var::make_protect<callable>(range, callable::types::request_fold))
+			.add_buildin_var("to_integer", make_cni(to_integer, true))
+			.add_buildin_var("to_string", make_cni(to_string, true))
+			.add_buildin_var("type", make_cni(type, true))
+			.add_buildin_var("clone", make_cni(clone))
+			.add_buildin_var("move", make_cni(move))
+			.add_buildin_var("swap", make_cni(swap, true))
+			// Add extensions to storage
+			.add_buildin_var("exception", make_namespace(cs_impl::except_ext))
+			.add_buildin_var("iostream", make_namespace(cs_impl::iostream_ext))
+			.add_buildin_var("system", make_namespace(cs_impl::system_ext))
+			.add_buildin_var("runtime", make_namespace(cs_impl::runtime_ext))
+			.add_buildin_var("math", make_namespace(cs_impl::math_ext));
+			// Grammar tokens and methods have to outlive every collect_garbage()
+			token_base::gc.retain();
+			method_base::gc.retain();
+			instance = std::move(building);
+		}
+		return *instance;
+	}
+
 	context_t create_context(const array &args)
 	{
-		cs_impl::init_extensions();
+		const context_template &tmpl = get_context_template();
 		context_t context = std::make_shared<context_type>();
 		context->compiler = std::make_shared<compiler_type>(context);
 		context->instance = std::make_shared<instance_type>(context, current_process->stack_size);
 		context->cmd_args = cs::var::make_constant<cs::array>(args);
-		// Init Grammars
-		(*context->compiler)
-		// Expression Grammar
-		.add_method({new token_expr(tree_type<token_base *>()), new token_endline(0)},
-		new method_expression)
-		// Import Grammar
-		.add_method({new token_action(action_types::import_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_import)
-		.add_method({new token_action(action_types::import_), new token_expr(tree_type<token_base *>()),
-			            new token_action(action_types::as_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_import_as)
-		// Package Grammar
-		.add_method({new token_action(action_types::package_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_package)
-		// Involve Grammar
-		.add_method({new token_action(action_types::using_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_involve)
-		// Var Grammar
-		.add_method({new token_action(action_types::var_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_var)
-		.add_method({new token_action(action_types::link_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_link)
-		.add_method({new token_action(action_types::constant_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)},
-		new method_constant)
-		// End Grammar
-		.add_method({new token_action(action_types::endblock_), new token_endline(0)}, new method_end)
-		// Block Grammar
-		.add_method({new token_action(action_types::block_), new token_endline(0)}, new method_block)
-		// Namespace Grammar
-		.add_method({new token_action(action_types::namespace_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_namespace)
-		// If Grammar
-		.add_method({new token_action(action_types::if_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_if)
-		// Else Grammar
-		.add_method({new token_action(action_types::else_), new token_endline(0)}, new method_else)
-		// Switch Grammar
-		.add_method({new token_action(action_types::switch_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_switch)
-		// Case Grammar
-		.add_method({new token_action(action_types::case_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_case)
-		// Default Grammar
-		.add_method({new token_action(action_types::default_), new token_endline(0)},
-		new method_default)
-		// While Grammar
-		.add_method({new token_action(action_types::while_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_while)
-		// Until Grammar
-		.add_method({new token_action(action_types::until_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_until)
-		// Loop Grammar
-		.add_method({new token_action(action_types::loop_), new token_endline(0)}, new method_loop)
-		// For Grammar
-		.add_method({new token_action(action_types::for_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_for)
-		.add_method({new token_action(action_types::for_), new token_expr(tree_type<token_base *>()),
-			            new token_action(action_types::do_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_for_do)
-		.add_method({new token_action(action_types::foreach_), new token_expr(tree_type<token_base *>()),
-			            new token_action(action_types::in_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_foreach)
-		.add_method({new token_action(action_types::foreach_), new token_expr(tree_type<token_base *>()),
-			            new token_action(action_types::in_), new token_expr(tree_type<token_base *>()),
-			            new token_action(action_types::do_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_foreach_do)
-		// Break Grammar
-		.add_method({new token_action(action_types::break_), new token_endline(0)}, new method_break)
-		// Continue Grammar
-		.add_method({new token_action(action_types::continue_), new token_endline(0)},
-		new method_continue)
-		// Function Grammar
-		.add_method({new token_action(action_types::function_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_function)
-		.add_method({new token_action(action_types::function_), new token_expr(tree_type<token_base *>()),
-			            new token_action(action_types::override_), new token_endline(0)},
-		new method_function)
-		// Return Grammar
-		.add_method({new token_action(action_types::return_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_return)
-		.add_method({new token_action(action_types::return_), new token_endline(0)},
-		new method_return_no_value)
-		// Struct Grammar
-		.add_method({new token_action(action_types::struct_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_struct)
-		.add_method({new token_action(action_types::struct_), new token_expr(tree_type<token_base *>()),
-			            new token_action(action_types::extends_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_struct)
-		// Try Grammar
-		.add_method({new token_action(action_types::try_), new token_endline(0)}, new method_try)
-		// Catch Grammar
-		.add_method({new token_action(action_types::catch_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_catch)
-		// Throw Grammar
-		.add_method({new token_action(action_types::throw_), new token_expr(tree_type<token_base *>()),
-			            new token_endline(0)}, new method_throw);
-		// Init Runtime
-		context->instance->storage
-		// Internal Types
-		.add_buildin_type("char", []() -> var { return var::make<char>('\0'); }, typeid(char),
-		                  cs_impl::char_ext)
-		.add_buildin_type("number", []() -> var { return var::make<number>(0); }, typeid(number))
-		.add_buildin_type("boolean", []() -> var { return var::make<boolean>(true); }, typeid(boolean))
-		.add_buildin_type("pointer", []() -> var { return var::make<pointer>(null_pointer); }, typeid(pointer))
-		.add_buildin_type("string", []() -> var { return var::make<string>(); }, typeid(string),
-		                  cs_impl::string_ext)
-		.add_buildin_type("list", []() -> var { return var::make<list>(); }, typeid(list), cs_impl::list_ext)
-		.add_buildin_type("array", []() -> var { return var::make<array>(); }, typeid(array),
-		                  cs_impl::array_ext)
-		.add_buildin_type("pair", []() -> var { return var::make<pair>(number(0), number(0)); }, typeid(pair),
-		                  cs_impl::pair_ext)
-		.add_buildin_type("hash_set", []() -> var { return var::make<hash_set>(); }, typeid(hash_set),
-		                  cs_impl::hash_set_ext)
-		.add_buildin_type("hash_map", []() -> var { return var::make<hash_map>(); }, typeid(hash_map),
-		                  cs_impl::hash_map_ext)
-		// Context
-		.add_buildin_var("context", var::make_constant<context_t>(context))
-		// Add Internal Functions to storage
-		.add_buildin_var("range", var::make_protect<callable>(range, callable::types::request_fold))
-		.add_buildin_var("to_integer", make_cni(to_integer, true))
-		.add_buildin_var("to_string", make_cni(to_string, true))
-		.add_buildin_var("type", make_cni(type, true))
-		.add_buildin_var("clone", make_cni(clone))
-		.add_buildin_var("move", make_cni(move))
-		.add_buildin_var("swap", make_cni(swap, true))
-		// Add extensions to storage
-		.add_buildin_var("exception", make_namespace(cs_impl::except_ext))
-		.add_buildin_var("iostream", make_namespace(cs_impl::iostream_ext))
-		.add_buildin_var("system", make_namespace(cs_impl::system_ext))
-		.add_buildin_var("runtime", make_namespace(cs_impl::runtime_ext))
-		.add_buildin_var("math", make_namespace(cs_impl::math_ext));
+		context->compiler->copy_grammar(tmpl.grammar);
+		context->instance->storage.involve_buildin(tmpl.buildin)
+		.add_buildin_var("context", var::make_constant<context_t>(context));
 		return context;
 	}
 
 	context_t create_subcontext(const context_t &cxt)
 	{
-		cs_impl::init_extensions();
+		const context_template &tmpl = get_context_template();
 		context_t context = std::make_shared<context_type>();
 		context->instance = std::make_shared<instance_type>(context, current_process->stack_size);
 		context->compiler = cxt->compiler;
 		context->cmd_args = cxt->cmd_args;
-		// Init Runtime
-		context->instance->storage
-		// Internal Types
-		.add_buildin_type("char", []() -> var { return var::make<char>('\0'); }, typeid(char),
-		                  cs_impl::char_ext)
-		.add_buildin_type("number", []() -> var { return var::make<number>(0); }, typeid(number))
-		.add_buildin_type("boolean", []() -> var { return var::make<boolean>(true); }, typeid(boolean))
-		.add_buildin_type("pointer", []() -> var { return var::make<pointer>(null_pointer); }, typeid(pointer))
-		.add_buildin_type("string", []() -> var { return var::make<string>(); }, typeid(string),
-		                  cs_impl::string_ext)
-		.add_buildin_type("list", []() -> var { return var::make<list>(); }, typeid(list), cs_impl::list_ext)
-		.add_buildin_type("array", []() -> var { return var::make<array>(); }, typeid(array),
-		                  cs_impl::array_ext)
-		.add_buildin_type("pair", []() -> var { return var::make<pair>(number(0), number(0)); }, typeid(pair),
-		                  cs_impl::pair_ext)
-		.add_buildin_type("hash_set", []() -> var { return var::make<hash_set>(); }, typeid(hash_set),
-		                  cs_impl::hash_set_ext)
-		.add_buildin_type("hash_map", []() -> var { return var::make<hash_map>(); }, typeid(hash_map),
-		                  cs_impl::hash_map_ext)
-		// Context
-		.add_buildin_var("context", var::make_constant<context_t>(context))
-		// Add Internal Functions to storage
-		.add_buildin_var("range", var::make_protect<callable>(range, callable::types::request_fold))
-		.add_buildin_var("to_integer", make_cni(to_integer, true))
-		.add_buildin_var("to_string", make_cni(to_string, true))
-		.add_buildin_var("type", make_cni(type, true))
-		.add_buildin_var("clone", make_cni(clone))
-		.add_buildin_var("move", make_cni(move))
-		.add_buildin_var("swap", make_cni(swap, true))
-		// Add extensions to storage
-		.add_buildin_var("exception", make_namespace(cs_impl::except_ext))
-		.add_buildin_var("iostream", make_namespace(cs_impl::iostream_ext))
-		.add_buildin_var("system", make_namespace(cs_impl::system_ext))
-		.add_buildin_var("runtime", make_namespace(cs_impl::runtime_ext))
-		.add_buildin_var("math", make_namespace(cs_impl::math_ext));
+		context->instance->storage.involve_buildin(tmpl.buildin)
+		.add_buildin_var("context", var::make_constant<context_t>(context));
 		return context;
 	}
 
+	// Reset a context to a fork of the origin, reusing what it has already allocated
+	static void fork_into(const context_t &context, const context_t &origin)
+	{
+		context->file_buff.clear();
+		context->file_path = "<Unknown>";
+		context->package_name.clear();
+		context->cmd_args = origin->cmd_args;
+		context->instance->fork(*origin->instance);
+		context->instance->storage.get_global().add_var("context", var::make_constant<context_t>(context));
+	}
+
+	// Drop the code compiled by a context, along with the packages it imported
+	static void release_units(const context_t &context)
+	{
+		for (auto &package:context->compiler->packages) {
+			package->instance->storage.clear_all_data();
+			package->instance->context = nullptr;
+		}
+		context->compiler->packages.clear();
+		for (auto &unit:context->compiler->units)
+			unit->release_anchors();
+		context->compiler->units.clear();
+	}
+
+	// Break the reference cycles of a context, its compile units go with the last reference
+	static void release_context(context_t &context)
+	{
+		context->instance->storage.clear_all_data();
+		release_units(context);
+		context->compiler->modules.clear();
+		context->compiler->swap_context(nullptr);
+		context->instance->context = nullptr;
+		context->compiler = nullptr;
+		context->instance = nullptr;
+		context = nullptr;
+	}
+
+	context_t fork_context(const context_t &cxt)
+	{
+		context_t context = std::make_shared<context_type>();
+		context->compiler = std::make_shared<compiler_type>(context, *cxt->compiler);
+		context->instance = std::make_shared<instance_type>(context, current_process->stack_size);
+		fork_into(context, cxt);
+		return context;
+	}
+
+	context_pool::~context_pool()
+	{
+		for (auto &context:m_idle)
+			release_context(context);
+	}
+
+	context_t context_pool::acquire()
+	{
+		if (m_idle.empty())
+			return fork_context(m_origin);
+		context_t context = std::move(m_idle.back());
+		m_idle.pop_back();
+		return context;
+	}
+
+	void context_pool::release(context_t &context)
+	{
+		if (!context)
+			return;
+		if (m_idle.size() < m_capacity) {
+			context->compiler->swap_context(context);
+			release_units(context);
+			context->compiler->fork(*m_origin->compiler);
+			fork_into(context, m_origin);
+			m_idle.push_back(std::move(context));
+		}
+		else
+			release_context(context);
+		context = nullptr;
+	}
+
 	void collect_garbage()
 	{
+		trace_scope trace("collect_garbage", std::string());
 		statement_base::gc.collect();
 		method_base::gc.collect();
 		token_base::gc.collect();
 		extension::gc.collect();
 	}
 
+	runtime_stats get_runtime_stats()
+	{
+		runtime_stats stats;
+		stats.values = var::proxy_stats();
+		for (auto it:allocator_registry()) {
+			if (it != &var::proxy_stats())
+				stats.types.push_back(*it);
+		}
+		stats.domain_count = domain_type::created_count();
+		stats.copy_count = current_process->copy_count;
+		stats.token_nodes = token_base::gc.node_count() + compile_unit::token_count();
+		stats.statement_nodes = statement_base::gc.node_count() + compile_unit::statement_count();
+		stats.method_nodes = method_base::gc.node_count();
+		stats.resident_memory = cs_impl::process::resident_memory();
+		return stats;
+	}
+
 	void collect_garbage(context_t &context)
 	{
 		while (!current_process->stack.empty())
@@ -538,25 +659,24 @@ namespace cs {
 		while(!current_process->stack_backtrace.empty())
 			current_process->stack_backtrace.pop_no_return();
 #endif
-		if (context) {
-			context->instance->storage.clear_all_data();
-			context->compiler->modules.clear();
-			context->compiler->swap_context(nullptr);
-			context->instance->context = nullptr;
-			context->compiler = nullptr;
-			context->instance = nullptr;
-			context = nullptr;
-		}
+		if (context)
+			release_context(context);
 		collect_garbage();
 	}
 
 	cs::var eval(const context_t &context, const std::string &expr)
 	{
+		unit_t unit = compile_unit::create();
+		compile_unit::scope scope(unit.get());
 		tree_type<cs::token_base *> tree;
 		std::deque<char> buff;
 		for (auto &ch:expr)
 			buff.push_back(ch);
 		context->compiler->build_expr(buff, tree);
+		// Lambdas may outlive the evaluation, their unit goes with the context
+		if (unit->has_anchors())
+			context->compiler->units.push_back(unit);
+		fork_guard fork(context->instance.get());
 		return context->instance->parse_expr(tree.root());
 	}
 }
\ No newline at end of file
@@ -29,7 +29,9 @@
 #include <covscript_impl/system.hpp>
 #include <covscript/covscript.hpp>
 #include <iostream>
+#include <sstream>
 #include <chrono>
+#include <map>
 
 #ifdef COVSCRIPT_PLATFORM_WIN32
 
@@ -134,25 +136,130 @@ int covscript_args(int args_size, char *args[])
 	return index;
 }
 
+using callback_t = std::function<bool(const std::string &)>;
+
+class function_map_t final {
+	cs::map_t<std::string, callback_t> m_map;
+public:
+	function_map_t() = default;
+
+	template<typename T>
+	void add_func(const std::string &name, const std::string &shortcut, T &&func)
+	{
+		m_map.emplace(name, std::forward<T>(func));
+		m_map.emplace(shortcut, std::forward<T>(func));
+	}
+
+	bool exist(const std::string &name)
+	{
+		return m_map.count(name) > 0;
+	}
+
+	bool call(const std::string &name, const std::string &cmd)
+	{
+		return m_map.at(name)(cmd);
+	}
+};
+
+std::size_t time()
+{
+	static std::chrono::time_point<std::chrono::high_resolution_clock> timer(std::chrono::high_resolution_clock::now());
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+	           std::chrono::high_resolution_clock::now() - timer).count();
+}
+
+std::string path;
+cs::context_t context;
+std::ofstream log_stream;
+
+bool quit_sig = false;
+bool exec_by_step = false;
+std::size_t current_level = 0;
+bool step_into_function = false;
+// Statement the debugger stopped at, expressions are evaluated in its context
+const cs::statement_base *current_stmt = nullptr;
+
+function_map_t func_map;
+
 class breakpoint_recorder final {
 	struct breakpoint final {
 		std::size_t id = 0;
-		variant_impl::variant<std::size_t, std::string, cs::var> data;
+		variant_impl::variant<std::string, cs::var> data;
 
 		template<typename T>
 		breakpoint(std::size_t _id, T &&_data):id(_id), data(std::forward<T>(_data)) {}
 	};
 
+	struct line_breakpoint final {
+		// Empty file means the debugging script
+		std::string file;
+		std::size_t line_num = 0;
+		std::string condition;
+		// Stop from the hit_count-th hit on, hits only count when the condition holds
+		std::size_t hit_count = 0;
+		std::size_t hits = 0;
+		// Compiled on first hit, in the context of the statement which was hit
+		cs::expression_t tree;
+		const cs::context_type *compiled_in = nullptr;
+	};
+
 	static std::size_t m_id;
 	std::forward_list<breakpoint> m_breakpoints;
+	std::map<std::size_t, line_breakpoint> m_lines;
 	cs::map_t<std::string, std::pair<std::size_t, bool>> m_pending;
+	// Line bitmaps of every file path seen, keyed by address of the path in its context
+	cs::map_t<const std::string *, std::vector<bool>> m_bitmaps;
+	const std::string *m_last_file = nullptr;
+	const std::vector<bool> *m_last_bitmap = nullptr;
+
+	static bool match_file(const std::string &file, const std::string &stmt_file)
+	{
+		if (file.empty())
+			return stmt_file == path;
+		if (stmt_file.size() < file.size() || stmt_file.compare(stmt_file.size() - file.size(), file.size(), file) != 0)
+			return false;
+		if (stmt_file.size() == file.size())
+			return true;
+		char sep = stmt_file[stmt_file.size() - file.size() - 1];
+		return sep == '/' || sep == '\\';
+	}
+
+	const std::vector<bool> &get_bitmap(const std::string *file)
+	{
+		auto it = m_bitmaps.find(file);
+		if (it != m_bitmaps.end())
+			return it->second;
+		std::vector<bool> bitmap;
+		for (auto &it:m_lines) {
+			if (match_file(it.second.file, *file)) {
+				if (bitmap.size() <= it.second.line_num)
+					bitmap.resize(it.second.line_num + 1, false);
+				bitmap[it.second.line_num] = true;
+			}
+		}
+		return m_bitmaps.emplace(file, std::move(bitmap)).first->second;
+	}
+
+	void clear_bitmaps()
+	{
+		m_bitmaps.clear();
+		m_last_file = nullptr;
+		m_last_bitmap = nullptr;
+	}
+
 public:
 
 	breakpoint_recorder() = default;
 
-	std::size_t add_line(std::size_t line_num)
+	std::size_t add_line(const std::string &file, std::size_t line_num, const std::string &condition,
+	                     std::size_t hit_count)
 	{
-		m_breakpoints.emplace_front(++m_id, line_num);
+		line_breakpoint &b = m_lines[++m_id];
+		b.file = file;
+		b.line_num = line_num;
+		b.condition = condition;
+		b.hit_count = hit_count;
+		clear_bitmaps();
 		return m_id;
 	}
 
@@ -197,6 +304,10 @@ public:
 
 	void remove(std::size_t id)
 	{
+		if (m_lines.erase(id) > 0) {
+			clear_bitmaps();
+			return;
+		}
 		m_breakpoints.remove_if([this, id](const breakpoint &b) -> bool {
 			if (b.id == id && b.data.type() == typeid(cs::var))
 				b.data.get<cs::var>().const_val<cs::callable>().get_raw_data().target<cs::function>()->set_debugger_state(
@@ -213,17 +324,72 @@ public:
 			m_pending.erase(it);
 	}
 
-	bool exist(std::size_t line_num) const
+	// One bit test per statement, file paths are compared once per context
+	bool exist(const cs::statement_base *stmt)
 	{
-		for (auto &b:m_breakpoints)
-			if (b.data.type() == typeid(std::size_t) && b.data.get<std::size_t>() == line_num)
-				return true;
-		return false;
+		const std::string *file = &stmt->get_file_path();
+		if (file != m_last_file) {
+			m_last_bitmap = &get_bitmap(file);
+			m_last_file = file;
+		}
+		std::size_t line_num = stmt->get_line_num();
+		return line_num < m_last_bitmap->size() && (*m_last_bitmap)[line_num];
+	}
+
+	// Evaluates conditions and counts hits of every breakpoint at the line of stmt
+	bool hit(const cs::statement_base *stmt)
+	{
+		bool result = false;
+		for (auto &it:m_lines) {
+			line_breakpoint &b = it.second;
+			if (b.line_num != stmt->get_line_num() || !match_file(b.file, stmt->get_file_path()))
+				continue;
+			if (!b.condition.empty()) {
+				try {
+					// Locals of a package function live in the instance of that package
+					const cs::context_t &cxt = stmt->get_context();
+					if (b.compiled_in != cxt.get()) {
+						std::deque<char> buff(b.condition.begin(), b.condition.end());
+						cxt->compiler->build_expr(buff, b.tree);
+						b.compiled_in = cxt.get();
+					}
+					const cs::var &cond = cxt->instance->parse_expr(b.tree.root());
+					if (cond.type() != typeid(cs::boolean))
+						throw cs::runtime_error("Condition must be a boolean, provided " + cond.get_type_name() + ".");
+					if (!cond.const_val<cs::boolean>())
+						continue;
+				}
+				catch (const std::exception &e) {
+					if (std::strstr(e.what(), "CS_SIGINT") != nullptr ||
+					        std::strstr(e.what(), "CS_DEBUGGER_EXIT") != nullptr)
+						throw;
+					std::cout << "\nEvaluation of breakpoint " << it.first << " condition failed: " << e.what()
+					          << std::endl;
+					result = true;
+					continue;
+				}
+			}
+			if (++b.hits >= b.hit_count)
+				result = true;
+		}
+		return result;
 	}
 
 	void list() const
 	{
 		std::cout << "ID\tBreakpoint\n" << std::endl;
+		for (auto &it:m_lines) {
+			const line_breakpoint &b = it.second;
+			std::cout << it.first << "\t";
+			std::cout << "line " << b.line_num;
+			if (!b.file.empty())
+				std::cout << " of \"" << b.file << "\"";
+			if (b.hit_count > 1)
+				std::cout << ", hit " << b.hit_count;
+			if (!b.condition.empty())
+				std::cout << ", if " << b.condition;
+			std::cout << ", hits " << b.hits << std::endl;
+		}
 		for (auto &b:m_breakpoints) {
 			std::cout << b.id << "\t";
 			if (b.data.type() == typeid(cs::var)) {
@@ -231,15 +397,20 @@ public:
 				std::cout << "line " << func->get_raw_statement()->get_line_num() << ", " << func->get_declaration()
 				          << std::endl;
 			}
-			else if (b.data.type() == typeid(std::string))
-				std::cout << "\"" << b.data.get<std::string>() << "\"(pending)" << std::endl;
 			else
-				std::cout << "line " << b.data.get<std::size_t>() << std::endl;
+				std::cout << "\"" << b.data.get<std::string>() << "\"(pending)" << std::endl;
 		}
 	}
 
 	void reset()
 	{
+		// Bitmaps are keyed by addresses and trees refer to tokens of the finished instance
+		clear_bitmaps();
+		for (auto &it:m_lines) {
+			it.second.hits = 0;
+			it.second.tree = cs::expression_t();
+			it.second.compiled_in = nullptr;
+		}
 		for (auto &it:m_pending) {
 			it.second.second = true;
 			for (auto &b:m_breakpoints) {
@@ -252,50 +423,7 @@ public:
 	}
 };
 
-using callback_t = std::function<bool(const std::string &)>;
-
-class function_map_t final {
-	cs::map_t<std::string, callback_t> m_map;
-public:
-	function_map_t() = default;
-
-	template<typename T>
-	void add_func(const std::string &name, const std::string &shortcut, T &&func)
-	{
-		m_map.emplace(name, std::forward<T>(func));
-		m_map.emplace(shortcut, std::forward<T>(func));
-	}
-
-	bool exist(const std::string &name)
-	{
-		return m_map.count(name) > 0;
-	}
-
-	bool call(const std::string &name, const std::string &cmd)
-	{
-		return m_map.at(name)(cmd);
-	}
-};
-
-std::size_t time()
-{
-	static std::chrono::time_point<std::chrono::high_resolution_clock> timer(std::chrono::high_resolution_clock::now());
-	return std::chrono::duration_cast<std::chrono::milliseconds>(
-	           std::chrono::high_resolution_clock::now() - timer).count();
-}
-
 std::size_t breakpoint_recorder::m_id = 0;
-
-std::string path;
-cs::context_t context;
-std::ofstream log_stream;
-
-bool quit_sig = false;
-bool exec_by_step = false;
-std::size_t current_level = 0;
-bool step_into_function = false;
-
-function_map_t func_map;
 breakpoint_recorder breakpoints;
 
 void reset_status()
@@ -303,6 +431,7 @@ void reset_status()
 	exec_by_step = false;
 	current_level = 0;
 	step_into_function = false;
+	current_stmt = nullptr;
 	breakpoints.reset();
 }
 
@@ -369,7 +498,7 @@ bool covscript_debugger()
 
 void cs_debugger_step_callback(cs::statement_base *stmt)
 {
-	if (!exec_by_step && stmt->get_file_path() == path && breakpoints.exist(stmt->get_line_num())) {
+	if (!exec_by_step && breakpoints.exist(stmt) && breakpoints.hit(stmt)) {
 		std::cout << "\nHit breakpoint, at \"" << stmt->get_file_path() << "\", line " << stmt->get_line_num()
 		          << std::endl;
 		current_level = cs::current_process->stack.size();
@@ -379,7 +508,9 @@ void cs_debugger_step_callback(cs::statement_base *stmt)
 		std::cout << stmt->get_line_num() << "\t" << stmt->get_raw_code() << std::endl;
 		current_level = cs::current_process->stack.size();
 		step_into_function = false;
+		current_stmt = stmt;
 		while (covscript_debugger());
+		current_stmt = nullptr;
 	}
 }
 
@@ -503,6 +634,8 @@ void covscript_main(int args_size, char *args[])
 			std::cout << "continue                 c    Continue execute program until next breakpint gets hit\n";
 			std::cout << "backtrace               bt    Show stack backtrace\n";
 			std::cout << "break [line|function]    b    Set breakpoint at specific line or function\n";
+			std::cout << "      [file:]line [hit n] [if condition]\n";
+			std::cout << "                              Break at the n-th hit where condition holds\n";
 			std::cout << "lsbreak                 lb    List all breakpoints\n";
 			std::cout << "rmbreak [id]            rb    Remove specific breakpoint\n";
 			std::cout << "print [expression]       p    Evaluate the value of expression\n";
@@ -532,17 +665,36 @@ void covscript_main(int args_size, char *args[])
 			if (context.get() == nullptr)
 				throw cs::runtime_error("Please launch a interpreter instance first.");
 			for (auto &func:cs::current_process->stack_backtrace)
-				std::cout << func << std::endl;
+				std::cout << func->get_declaration() << std::endl;
 			std::cout << "function main()" << std::endl;
 			return true;
 		});
 		func_map.add_func("break", "b", [](const std::string &cmd) -> bool {
-			bool is_line = true;
-			for (auto &ch:cmd)
-			{
-				if (!std::isspace(ch) && !std::isdigit(ch)) {
+			// [FILE:]LINE [hit COUNT] [if CONDITION]
+			std::string location, file, condition;
+			std::size_t hit_count = 0;
+			std::istringstream ss(cmd);
+			ss >> location;
+			std::size_t colon = location.rfind(':');
+			if (colon != std::string::npos)
+				file = location.substr(0, colon);
+			bool is_line = !location.empty() && colon + 1 < location.size();
+			for (std::size_t i = colon + 1; is_line && i < location.size(); ++i)
+				if (!std::isdigit(location[i]))
 					is_line = false;
-					break;
+			if (is_line)
+			{
+				std::string word;
+				while (ss >> word) {
+					if (word == "hit" && hit_count == 0 && condition.empty() && ss >> hit_count && hit_count > 0)
+						continue;
+					if (word == "if") {
+						std::getline(ss >> std::ws, condition);
+						if (!condition.empty())
+							break;
+					}
+					std::cout << "Invalid option: \"" << cmd << "\"" << std::endl;
+					return true;
 				}
 			}
 			std::size_t id = 0;
@@ -570,7 +722,7 @@ void covscript_main(int args_size, char *args[])
 			else
 			{
 				try {
-					id = breakpoints.add_line(std::stoul(cmd));
+					id = breakpoints.add_line(file, std::stoul(location.substr(colon + 1)), condition, hit_count);
 				}
 				catch (...) {
 					std::cout << "Invalid option: \"" << cmd << "\"" << std::endl;
@@ -670,8 +822,9 @@ void covscript_main(int args_size, char *args[])
 				cs::expression_t tree;
 				for (auto &ch:cmd)
 					buff.push_back(ch);
-				context->compiler->build_expr(buff, tree);
-				std::cout << context->instance->parse_expr(tree.root()) << std::endl;
+				const cs::context_t &cxt = current_stmt != nullptr ? current_stmt->get_context() : context;
+				cxt->compiler->build_expr(buff, tree);
+				std::cout << cxt->instance->parse_expr(tree.root()) << std::endl;
 			}
 			catch (std::exception &e)
 			{
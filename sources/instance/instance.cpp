@@ -24,6 +24,7 @@
 * Website: http://covscript.org.cn
 */
 #include <covscript_impl/system.hpp>
+#include <covscript/impl/statement.hpp>
 #include <covscript/covscript.hpp>
 
 namespace cs {
@@ -46,8 +47,10 @@ namespace cs {
 	{
 		if (context->compiler->modules.count(path) > 0)
 			return context->compiler->modules[path];
+		trace_scope trace("import", path);
 		if (cs_impl::file_system::is_exe(path)) {
 			// is extension file
+			trace_scope trace_dll("dlopen", path);
 			namespace_t module = std::make_shared<extension>(path);
 			context->compiler->modules.emplace(path, module);
 			return module;
@@ -55,6 +58,7 @@ namespace cs {
 		else {
 			// is package file
 			context_t rt = create_subcontext(context);
+			context->compiler->packages.push_back(rt);
 			namespace_t module = std::make_shared<name_space>();
 			context->compiler->modules.emplace(path, module);
 			rt->compiler->swap_context(rt);
@@ -92,7 +96,9 @@ namespace cs {
 			if (context->compiler->modules.count(package_path) > 0)
 				return context->compiler->modules[package_path];
 			if (std::ifstream(package_path + ".csp")) {
+				trace_scope trace("import", package_path + ".csp");
 				context_t rt = create_subcontext(context);
+				context->compiler->packages.push_back(rt);
 				namespace_t module = std::make_shared<name_space>();
 				context->compiler->modules.emplace(package_path, module);
 				rt->compiler->swap_context(rt);
@@ -113,6 +119,8 @@ namespace cs {
 				return module;
 			}
 			else if (std::ifstream(package_path + ".cse")) {
+				trace_scope trace("import", package_path + ".cse");
+				trace_scope trace_dll("dlopen", package_path + ".cse");
 				namespace_t module = std::make_shared<extension>(package_path + ".cse");
 				context->compiler->modules.emplace(package_path, module);
 				return module;
@@ -124,23 +132,28 @@ namespace cs {
 	void instance_type::compile(const std::string &path)
 	{
 		context->file_path = path;
-		// Read from file
-		std::deque<char> buff;
-		std::ifstream in(path, std::ios::binary);
-		if (!in.is_open())
+		// Map the file, the lexer works on the bytes in place
+		std::unique_ptr<cs_impl::file_system::file_view> file;
+		{
+			trace_scope trace("read", path);
+			file.reset(new cs_impl::file_system::file_view(path));
+		}
+		if (!file->is_open())
 			throw fatal_error(path + ": No such file or directory");
-		for (int ch = in.get(); in; ch = in.get())
-			buff.push_back(ch);
 		std::deque<std::deque<token_base *>> ast;
-		// Compile
+		// Compile, the statements live as long as the unit is held by the compiler
+		unit_t unit = compile_unit::create();
+		context->compiler->units.push_back(unit);
+		compile_unit::scope scope(unit.get());
 		context->compiler->clear_metadata();
-		context->compiler->build_ast(buff, ast);
+		context->compiler->build_ast(file->begin(), file->end(), ast);
 		context->compiler->code_gen(ast, statements);
 		context->compiler->utilize_metadata();
 	}
 
 	void instance_type::interpret()
 	{
+		fork_guard fork(this);
 		// Run the instruction
 		for (auto &ptr:statements) {
 			try {
@@ -158,6 +171,151 @@ namespace cs {
 		}
 	}
 
+	instance_type *instance_type::running_fork = nullptr;
+
+	/*
+	* Plain values reachable from the globals of an origin and its packages get a copy of their own, constants,
+	* functions and types are shared. A value reached more than once, through a namespace, an alias or using,
+	* is copied once, so the package functions and the namespace members of a fork agree with each other.
+	*/
+	class global_forker final {
+		struct package_globals final {
+			instance_t instance;
+			map_t<std::string, std::size_t> names;
+			std::vector<std::pair<std::size_t, var>> overlay;
+		};
+		std::vector<package_globals> m_packages;
+		map_t<const name_space *, var> m_namespaces;
+
+		var fork_namespace(const var &val)
+		{
+			const namespace_t &origin = val.const_val<namespace_t>();
+			if (m_namespaces.count(origin.get()) > 0)
+				return m_namespaces[origin.get()];
+			// Shared until forked, a namespace reaching itself sees the origin
+			m_namespaces.emplace(origin.get(), val);
+			namespace_t ns;
+			for (auto &it:origin->get_domain()) {
+				const var &member = origin->get_domain().get_var_by_id(it.second);
+				var forked = fork_value(it.first, member);
+				if (forked.is_same(member))
+					continue;
+				if (!ns)
+					ns = std::make_shared<name_space>(origin->get_domain());
+				ns->get_domain().get_var_by_id(it.second) = forked;
+			}
+			if (ns)
+				m_namespaces[origin.get()] = make_namespace(ns);
+			return m_namespaces[origin.get()];
+		}
+
+	public:
+		// Plain globals of the packages are copied first, namespaces found later refer to them by name
+		explicit global_forker(const std::vector<context_t> &packages)
+		{
+			for (auto &package:packages) {
+				if (package->instance == nullptr)
+					continue;
+				m_packages.push_back({package->instance, {}, {}});
+				package_globals &globals = m_packages.back();
+				const domain_manager &storage = globals.instance->storage;
+				for (auto &it:storage.get_global()) {
+					const var &val = storage.get_global().get_var_by_id(it.second);
+					if (!val.usable() || val.is_protect() || val.type() == typeid(namespace_t) ||
+					        storage.is_buildin(it.first))
+						continue;
+					globals.names.emplace(it.first, globals.overlay.size());
+					globals.overlay.emplace_back(it.second, copy(val));
+				}
+			}
+			for (auto &globals:m_packages) {
+				const domain_manager &storage = globals.instance->storage;
+				for (auto &it:storage.get_global()) {
+					const var &val = storage.get_global().get_var_by_id(it.second);
+					if (!val.usable() || val.type() != typeid(namespace_t) || storage.is_buildin(it.first))
+						continue;
+					var forked = fork_namespace(val);
+					if (!forked.is_same(val))
+						globals.overlay.emplace_back(it.second, forked);
+				}
+			}
+		}
+
+		var fork_value(const std::string &name, const var &val)
+		{
+			if (!val.usable())
+				return val;
+			if (val.type() == typeid(namespace_t))
+				return fork_namespace(val);
+			if (val.is_protect())
+				return val;
+			for (auto &globals:m_packages) {
+				if (globals.names.count(name) == 0)
+					continue;
+				auto &slot = globals.overlay[globals.names[name]];
+				if (globals.instance->storage.get_global().get_var_by_id(slot.first).is_same(val))
+					return slot.second;
+			}
+			return copy(val);
+		}
+
+		namespace_t forked_namespace(const namespace_t &ns)
+		{
+			if (m_namespaces.count(ns.get()) > 0)
+				return m_namespaces[ns.get()].const_val<namespace_t>();
+			return ns;
+		}
+
+		void overlay(std::vector<std::pair<instance_t, std::vector<std::pair<std::size_t, var>>>> &out)
+		{
+			for (auto &globals:m_packages) {
+				if (!globals.overlay.empty())
+					out.emplace_back(globals.instance, std::move(globals.overlay));
+			}
+		}
+	};
+
+	void instance_type::fork(const instance_type &origin)
+	{
+		statements.clear();
+		return_fcall = false;
+		break_block = false;
+		continue_block = false;
+		frame.names = nullptr;
+		frame.args = nullptr;
+		fork_overlay.clear();
+		copy_string_literals(origin);
+		global_forker forker(origin.context->compiler->packages);
+		storage.fork_global(origin.storage, [&](const std::string &name, const var &val) {
+			return forker.fork_value(name, val);
+		});
+		// Both scopes share the same layout, slots holding a copy are put in place of the origin ones while running
+		std::vector<std::pair<std::size_t, var>> globals;
+		for (auto &it:origin.storage.get_global()) {
+			const var &val = storage.get_global().get_var_by_id(it.second);
+			if (!val.is_same(origin.storage.get_global().get_var_by_id(it.second)))
+				globals.emplace_back(it.second, val);
+		}
+		if (!globals.empty())
+			fork_overlay.emplace_back(origin.context->instance, std::move(globals));
+		forker.overlay(fork_overlay);
+		// Imports in the fork reach the forked packages as well
+		for (auto &it:context->compiler->modules)
+			it.second = forker.forked_namespace(it.second);
+	}
+
+	void instance_type::swap_overlay()
+	{
+		for (auto &entry:fork_overlay) {
+			// Released origins have nothing left to swap with
+			if (entry.first->context == nullptr)
+				continue;
+			domain_type &global = entry.first->storage.get_global();
+			for (auto &slot:entry.second)
+				global.get_var_by_id(slot.first).swap(slot.second);
+		}
+	}
+
 	void instance_type::dump_ast(std::ostream &stream)
 	{
 		stream << "< Covariant Script AST Dump >\n< BeginMetaData >\n< Version: " << current_process->version
@@ -177,6 +335,638 @@ namespace cs {
 		stream << std::flush;
 	}
 
+	// Ahead-of-time translation of single-return package functions: numbers and booleans run unboxed, strings and
+	// arrays go through the runtime, and operands of unknown type stay a cs::var checked where it is used
+	enum class aot_types {
+		unsupported, number, boolean, string, array, value
+	};
+
+	struct aot_code final {
+		aot_types type = aot_types::unsupported;
+		std::string code;
+		// Set if the code is a parameter read as is, its uses decide the type it is passed as
+		const std::string *param = nullptr;
+	};
+
+	// Parameter and result types of every function that is still a candidate for translation
+	struct aot_signature final {
+		std::vector<aot_types> args;
+		aot_types result = aot_types::number;
+	};
+
+	using aot_signatures = map_t<std::string, aot_signature>;
+
+	struct aot_scope final {
+		const aot_signatures &sigs;
+		const std::vector<std::string> &args;
+		const std::vector<aot_types> &types;
+		// Type each parameter is used as: unsupported while unused, value if used as different types
+		std::vector<aot_types> demands;
+	};
+
+	// Helpers of the generated code, a value of another type makes the entry run the script function instead
+	static const char *aot_runtime =
+	    "\tstruct cs_aot_fallback final {\n\t};\n\n"
+	    "\tinline cs::number cs_aot_num(const cs::var &val)\n\t{\n"
+	    "\t\tif (val.type() != typeid(cs::number))\n\t\t\tthrow cs_aot_fallback();\n"
+	    "\t\treturn val.const_val<cs::number>();\n\t}\n\n"
+	    "\tinline bool cs_aot_bool(const cs::var &val)\n\t{\n"
+	    "\t\tif (val.type() != typeid(cs::boolean))\n\t\t\tthrow cs_aot_fallback();\n"
+	    "\t\treturn val.const_val<cs::boolean>();\n\t}\n\n"
+	    "\tinline const cs::string &cs_aot_str(const cs::var &val)\n\t{\n"
+	    "\t\tif (val.type() != typeid(cs::string))\n\t\t\tthrow cs_aot_fallback();\n"
+	    "\t\treturn val.const_val<cs::string>();\n\t}\n\n"
+	    "\tinline const cs::array &cs_aot_arr(const cs::var &val)\n\t{\n"
+	    "\t\tif (val.type() != typeid(cs::array))\n\t\t\tthrow cs_aot_fallback();\n"
+	    "\t\treturn val.const_val<cs::array>();\n\t}\n\n"
+	    "\tinline cs::string cs_aot_to_string(const cs::var &val)\n\t{\n"
+	    "\t\tif (!val.usable())\n\t\t\tthrow cs_aot_fallback();\n"
+	    "\t\treturn val.to_string();\n\t}\n\n"
+	    "\t// Growing the array and out of range errors are left to the script\n"
+	    "\tinline cs::var cs_aot_at(const cs::array &arr, cs::number idx)\n\t{\n"
+	    "\t\tcs::number size = static_cast<cs::number>(arr.size());\n"
+	    "\t\tif (!(idx >= 0 ? idx < size : -idx <= size))\n\t\t\tthrow cs_aot_fallback();\n"
+	    "\t\treturn arr[static_cast<std::size_t>(idx >= 0 ? idx : size + idx)];\n\t}\n\n"
+	    "\tinline cs::number cs_aot_size(const cs::var &val)\n\t{\n"
+	    "\t\tif (val.type() == typeid(cs::string))\n\t\t\treturn static_cast<cs::number>(val.const_val<cs::string>().size());\n"
+	    "\t\tif (val.type() == typeid(cs::array))\n\t\t\treturn static_cast<cs::number>(val.const_val<cs::array>().size());\n"
+	    "\t\tthrow cs_aot_fallback();\n\t}\n";
+
+	static const char *aot_type_name(aot_types type)
+	{
+		switch (type) {
+		case aot_types::number:
+			return "cs::number";
+		case aot_types::boolean:
+			return "cs::boolean";
+		case aot_types::string:
+			return "cs::string";
+		case aot_types::array:
+			return "cs::array";
+		default:
+			return "cs::var";
+		}
+	}
+
+	static std::string aot_declare(aot_types type, const std::string &name)
+	{
+		if (type == aot_types::number || type == aot_types::boolean)
+			return std::string(aot_type_name(type)) + " " + name;
+		return std::string("const ") + aot_type_name(type) + " &" + name;
+	}
+
+	static std::string aot_arg_name(const std::string &name)
+	{
+		return "arg_" + name;
+	}
+
+	static std::string aot_func_name(const std::string &name)
+	{
+		return "cs_aot_" + name;
+	}
+
+	static std::string aot_script_name(const std::string &name)
+	{
+		return "__aot_script_" + name;
+	}
+
+	static std::size_t aot_arg_index(const aot_scope &scope, const std::string &name)
+	{
+		return std::find(scope.args.begin(), scope.args.end(), name) - scope.args.begin();
+	}
+
+	static aot_code aot_param(const aot_scope &scope, const std::string &name)
+	{
+		std::size_t idx = aot_arg_index(scope, name);
+		if (idx == scope.args.size())
+			return aot_code();
+		return aot_code{scope.types[idx], aot_arg_name(name), &scope.args[idx]};
+	}
+
+	static aot_code aot_box(const aot_code &code)
+	{
+		if (code.type == aot_types::unsupported || code.type == aot_types::value)
+			return code;
+		return aot_code{aot_types::value, std::string("cs::var::make<") + aot_type_name(code.type) + ">(" + code.code + ")"};
+	}
+
+	// Typed code never turns into another type, values are checked when a typed one is needed
+	static aot_code aot_convert(aot_scope &scope, const aot_code &code, aot_types type)
+	{
+		if (code.type == aot_types::unsupported || code.type == type)
+			return code;
+		if (type == aot_types::value)
+			return aot_box(code);
+		if (code.type != aot_types::value)
+			return aot_code();
+		if (code.param != nullptr) {
+			aot_types &demand = scope.demands[aot_arg_index(scope, *code.param)];
+			demand = demand == aot_types::unsupported || demand == type ? type : aot_types::value;
+		}
+		static const char *helpers[] = {nullptr, "cs_aot_num", "cs_aot_bool", "cs_aot_str", "cs_aot_arr"};
+		return aot_code{type, std::string(helpers[static_cast<std::size_t>(type)]) + "(" + code.code + ")"};
+	}
+
+	static bool aot_number(number value, std::string &code)
+	{
+		if (!std::isfinite(value))
+			return false;
+		std::ostringstream ss;
+		ss << std::setprecision(std::numeric_limits<number>::max_digits10) << value;
+		// Keep integral constants floating, "2L" would be a long
+		if (ss.str().find_first_of(".en") == std::string::npos)
+			ss << ".0";
+		ss << 'L';
+		code = value < 0 ? "(" + ss.str() + ")" : ss.str();
+		return true;
+	}
+
+	static std::string aot_string(const std::string &str)
+	{
+		std::ostringstream ss;
+		ss << "cs::string(\"";
+		for (unsigned char ch:str) {
+			// Question marks are escaped against trigraphs, octal escapes always have three digits
+			if (ch == '"' || ch == '\\' || ch == '?')
+				ss << '\\' << ch;
+			else if (std::isprint(ch))
+				ss << ch;
+			else
+				ss << '\\' << std::oct << std::setw(3) << std::setfill('0') << static_cast<int>(ch) << std::dec;
+		}
+		ss << "\", " << str.size() << ")";
+		return ss.str();
+	}
+
+	static aot_code aot_expr(aot_scope &, tree_type<token_base *>::iterator);
+
+	static aot_code aot_flat(aot_scope &scope, token_flat *flat)
+	{
+		static const char *operators[] = {nullptr, nullptr, "+", "-", "*", "/", nullptr, nullptr, nullptr, nullptr,
+		                                  "<", ">", "<=", ">="
+		                                 };
+		std::vector<std::string> stack;
+		for (auto &node:flat->get_nodes()) {
+			switch (node.op) {
+			case token_flat::opcode::push_number: {
+				std::string code;
+				if (!aot_number(node.value, code))
+					return aot_code();
+				stack.push_back(std::move(code));
+				break;
+			}
+			case token_flat::opcode::push_var: {
+				aot_code arg = aot_convert(scope, aot_param(scope, flat->get_ids()[node.index].get_id()),
+				                           aot_types::number);
+				if (arg.type != aot_types::number)
+					return aot_code();
+				stack.push_back(std::move(arg.code));
+				break;
+			}
+			case token_flat::opcode::minus:
+				stack.back() = "(-" + stack.back() + ")";
+				break;
+			case token_flat::opcode::square:
+				stack.back() = "(" + stack.back() + " * " + stack.back() + ")";
+				break;
+			default: {
+				std::string rhs = std::move(stack.back());
+				stack.pop_back();
+				std::string &lhs = stack.back();
+				if (node.op == token_flat::opcode::mod)
+					lhs = "std::fmod(" + lhs + ", " + rhs + ")";
+				else if (node.op == token_flat::opcode::pow)
+					lhs = "std::pow(" + lhs + ", " + rhs + ")";
+				else
+					lhs = "(" + lhs + " " + operators[static_cast<std::size_t>(node.op)] + " " + rhs + ")";
+			}
+			}
+		}
+		if (stack.size() != 1)
+			return aot_code();
+		return aot_code{flat->is_predicate() ? aot_types::boolean : aot_types::number, std::move(stack.back())};
+	}
+
+	static aot_code aot_operator(aot_scope &scope, const aot_code &left, const aot_code &right, const char *op,
+	                             aot_types operand, aot_types result)
+	{
+		aot_code lhs = aot_convert(scope, left, operand), rhs = aot_convert(scope, right, operand);
+		if (lhs.type != operand || rhs.type != operand)
+			return aot_code();
+		return aot_code{result, "(" + lhs.code + " " + op + " " + rhs.code + ")"};
+	}
+
+	static aot_code aot_binary(aot_scope &scope, tree_type<token_base *>::iterator it, const char *op,
+	                           aot_types operand, aot_types result)
+	{
+		return aot_operator(scope, aot_expr(scope, it.left()), aot_expr(scope, it.right()), op, operand, result);
+	}
+
+	static aot_code aot_call(aot_scope &scope, tree_type<token_base *>::iterator it, const std::string &func)
+	{
+		aot_code lhs = aot_convert(scope, aot_expr(scope, it.left()), aot_types::number);
+		aot_code rhs = aot_convert(scope, aot_expr(scope, it.right()), aot_types::number);
+		if (lhs.type != aot_types::number || rhs.type != aot_types::number)
+			return aot_code();
+		return aot_code{aot_types::number, func + "(" + lhs.code + ", " + rhs.code + ")"};
+	}
+
+	// A string on the left appends anything like runtime_type::parse_add, otherwise both sides are numbers
+	static aot_code aot_add(aot_scope &scope, tree_type<token_base *>::iterator it)
+	{
+		aot_code lhs = aot_expr(scope, it.left()), rhs = aot_expr(scope, it.right());
+		if (lhs.type == aot_types::value && rhs.type == aot_types::string)
+			lhs = aot_convert(scope, lhs, aot_types::string);
+		if (lhs.type != aot_types::string)
+			return aot_operator(scope, lhs, rhs, "+", aot_types::number, aot_types::number);
+		if (rhs.type == aot_types::unsupported)
+			return aot_code();
+		if (rhs.type != aot_types::string)
+			rhs.code = "cs_aot_to_string(" + aot_box(rhs).code + ")";
+		return aot_code{aot_types::string, "(" + lhs.code + " + " + rhs.code + ")"};
+	}
+
+	// Strings are ordered like numbers when either side is one
+	static aot_code aot_compare(aot_scope &scope, tree_type<token_base *>::iterator it, const char *op)
+	{
+		aot_code lhs = aot_expr(scope, it.left()), rhs = aot_expr(scope, it.right());
+		aot_types type = lhs.type == aot_types::string || rhs.type == aot_types::string ? aot_types::string
+		                 : aot_types::number;
+		lhs = aot_convert(scope, lhs, type);
+		rhs = aot_convert(scope, rhs, type);
+		if (lhs.type != type || rhs.type != type)
+			return aot_code();
+		return aot_code{aot_types::boolean, "(" + lhs.code + " " + op + " " + rhs.code + ")"};
+	}
+
+	// Values of different or unknown types are compared by the runtime, like runtime_type::parse_equ
+	static aot_code aot_equal(aot_scope &scope, tree_type<token_base *>::iterator it, bool equal)
+	{
+		aot_code lhs = aot_expr(scope, it.left()), rhs = aot_expr(scope, it.right());
+		if (lhs.type == aot_types::unsupported || rhs.type == aot_types::unsupported)
+			return aot_code();
+		if (lhs.type == rhs.type && lhs.type != aot_types::array && lhs.type != aot_types::value)
+			return aot_code{aot_types::boolean, "(" + lhs.code + (equal ? " == " : " != ") + rhs.code + ")"};
+		return aot_code{aot_types::boolean, std::string(equal ? "" : "!") + aot_box(lhs).code + ".compare(" +
+		                aot_box(rhs).code + ")"};
+	}
+
+	static aot_code aot_expr(aot_scope &scope, tree_type<token_base *>::iterator it)
+	{
+		token_base *token = it.data();
+		if (token == nullptr)
+			return aot_code();
+		switch (token->get_type()) {
+		default:
+			return aot_code();
+		case token_types::value: {
+			const var &val = static_cast<token_value *>(token)->get_value();
+			if (val.type() == typeid(boolean))
+				return aot_code{aot_types::boolean, val.const_val<boolean>() ? "true" : "false"};
+			if (val.type() == typeid(string))
+				return aot_code{aot_types::string, aot_string(val.const_val<string>())};
+			aot_code code{aot_types::number, std::string()};
+			if (val.type() != typeid(number) || !aot_number(val.const_val<number>(), code.code))
+				return aot_code();
+			return code;
+		}
+		case token_types::id:
+			return aot_param(scope, static_cast<token_id *>(token)->get_id().get_id());
+		case token_types::expr:
+			return aot_expr(scope, static_cast<token_expr *>(token)->get_tree().root());
+		case token_types::array: {
+			std::string code = "cs::array{";
+			for (auto &tree:static_cast<token_array *>(token)->get_array()) {
+				aot_code elem = aot_convert(scope, aot_expr(scope, tree.root()), aot_types::value);
+				if (elem.type != aot_types::value)
+					return aot_code();
+				if (code.back() != '{')
+					code += ", ";
+				code += elem.code;
+			}
+			return aot_code{aot_types::array, code + "}"};
+		}
+		case token_types::flat:
+			return aot_flat(scope, static_cast<token_flat *>(token));
+		case token_types::signal:
+			break;
+		}
+		switch (static_cast<token_signal *>(token)->get_signal()) {
+		default:
+			return aot_code();
+		case signal_types::add_:
+		case signal_types::add_num_:
+			return aot_add(scope, it);
+		case signal_types::sub_:
+			return aot_binary(scope, it, "-", aot_types::number, aot_types::number);
+		case signal_types::mul_:
+			return aot_binary(scope, it, "*", aot_types::number, aot_types::number);
+		case signal_types::div_:
+			return aot_binary(scope, it, "/", aot_types::number, aot_types::number);
+		case signal_types::mod_:
+			return aot_call(scope, it, "std::fmod");
+		case signal_types::pow_:
+			return aot_call(scope, it, "std::pow");
+		case signal_types::und_:
+			return aot_compare(scope, it, "<");
+		case signal_types::abo_:
+			return aot_compare(scope, it, ">");
+		case signal_types::ueq_:
+			return aot_compare(scope, it, "<=");
+		case signal_types::aeq_:
+			return aot_compare(scope, it, ">=");
+		case signal_types::equ_:
+			return aot_equal(scope, it, true);
+		case signal_types::neq_:
+			return aot_equal(scope, it, false);
+		case signal_types::and_:
+			return aot_binary(scope, it, "&&", aot_types::boolean, aot_types::boolean);
+		case signal_types::or_:
+			return aot_binary(scope, it, "||", aot_types::boolean, aot_types::boolean);
+		case signal_types::minus_: {
+			aot_code code = aot_convert(scope, aot_expr(scope, it.right()), aot_types::number);
+			if (code.type != aot_types::number)
+				return aot_code();
+			return aot_code{aot_types::number, "(-" + code.code + ")"};
+		}
+		case signal_types::not_: {
+			aot_code code = aot_convert(scope, aot_expr(scope, it.right()), aot_types::boolean);
+			if (code.type != aot_types::boolean)
+				return aot_code();
+			return aot_code{aot_types::boolean, "(!" + code.code + ")"};
+		}
+		case signal_types::choice_: {
+			tree_type<token_base *>::iterator branch = it.right();
+			token_base *pair = branch.data();
+			if (pair == nullptr || pair->get_type() != token_types::signal ||
+			        static_cast<token_signal *>(pair)->get_signal() != signal_types::pair_)
+				return aot_code();
+			aot_code cond = aot_convert(scope, aot_expr(scope, it.left()), aot_types::boolean);
+			aot_code lhs = aot_expr(scope, branch.left()), rhs = aot_expr(scope, branch.right());
+			if (cond.type != aot_types::boolean || lhs.type == aot_types::unsupported ||
+			        rhs.type == aot_types::unsupported)
+				return aot_code();
+			// A value meeting a typed branch is checked against it, different types are boxed
+			if (lhs.type != rhs.type) {
+				aot_types type = lhs.type == aot_types::value ? rhs.type : rhs.type == aot_types::value ? lhs.type
+				                 : aot_types::value;
+				lhs = aot_convert(scope, lhs, type);
+				rhs = aot_convert(scope, rhs, type);
+			}
+			return aot_code{lhs.type, "(" + cond.code + " ? " + lhs.code + " : " + rhs.code + ")"};
+		}
+		case signal_types::access_:
+		case signal_types::access_arr_: {
+			aot_code arr = aot_convert(scope, aot_expr(scope, it.left()), aot_types::array);
+			aot_code idx = aot_convert(scope, aot_expr(scope, it.right()), aot_types::number);
+			if (arr.type != aot_types::array || idx.type != aot_types::number)
+				return aot_code();
+			return aot_code{aot_types::value, "cs_aot_at(" + arr.code + ", " + idx.code + ")"};
+		}
+		case signal_types::dot_: {
+			token_base *member = it.right().data();
+			if (member == nullptr || member->get_type() != token_types::id ||
+			        static_cast<token_id *>(member)->get_id().get_id() != "size")
+				return aot_code();
+			aot_code obj = aot_expr(scope, it.left());
+			if (obj.type == aot_types::string || obj.type == aot_types::array)
+				return aot_code{aot_types::number, "static_cast<cs::number>(" + obj.code + ".size())"};
+			if (obj.type == aot_types::value)
+				return aot_code{aot_types::number, "cs_aot_size(" + obj.code + ")"};
+			return aot_code();
+		}
+		case signal_types::fcall_: {
+			token_base *func = it.left().data();
+			if (func == nullptr || func->get_type() != token_types::id || it.right().data() == nullptr)
+				return aot_code();
+			const std::string &name = static_cast<token_id *>(func)->get_id().get_id();
+			// Arguments shadow package functions of the same name
+			if (aot_arg_index(scope, name) != scope.args.size() || scope.sigs.count(name) == 0)
+				return aot_code();
+			auto &arglist = static_cast<token_arglist *>(it.right().data())->get_arglist();
+			const aot_signature &sig = scope.sigs.at(name);
+			if (arglist.size() != sig.args.size())
+				return aot_code();
+			std::string code = aot_func_name(name) + "(";
+			for (std::size_t i = 0; i < arglist.size(); ++i) {
+				aot_code arg = aot_convert(scope, aot_expr(scope, arglist[i].root()), sig.args[i]);
+				if (arg.type != sig.args[i])
+					return aot_code();
+				if (i > 0)
+					code += ", ";
+				code += arg.code;
+			}
+			return aot_code{sig.result, code + ")"};
+		}
+		}
+	}
+
+	static statement_return *aot_return(statement_function *func)
+	{
+		const auto &block = func->get_block();
+		if (func->get_function().is_vargs() || block.size() != 1 ||
+		        block.front()->get_type() != statement_types::return_)
+			return nullptr;
+		return static_cast<statement_return *>(block.front());
+	}
+
+	// Rename the function declared on the line, the wrapper binds its name to the native entry
+	static bool aot_rename(std::string &line, const std::string &name, const std::string &target)
+	{
+		std::size_t pos = line.find("function");
+		if (pos == std::string::npos)
+			return false;
+		pos += 8;
+		std::size_t begin = line.find_first_not_of(" \t", pos);
+		if (begin == pos || begin == std::string::npos || line.compare(begin, name.size(), name) != 0)
+			return false;
+		std::size_t end = begin + name.size();
+		if (end < line.size() && (std::isalnum(static_cast<unsigned char>(line[end])) || line[end] == '_'))
+			return false;
+		line.replace(begin, name.size(), target);
+		return true;
+	}
+
+	void instance_type::dump_aot(const std::string &dir)
+	{
+		static const std::string wrapper_mark = "# Covariant Script AOT wrapper";
+		if (context->package_name.empty())
+			throw fatal_error("AOT translation requires a package.");
+		const std::string &name = context->package_name;
+		std::string ext_name = name + "_aot";
+		std::string wrapper_path = dir + path_separator + name + ".csp";
+		// Only a wrapper generated earlier may be replaced, never the package itself
+		{
+			std::ifstream wrapper(wrapper_path);
+			std::string line;
+			if (wrapper && (!std::getline(wrapper, line) || line.compare(0, wrapper_mark.size(), wrapper_mark) != 0))
+				throw fatal_error("AOT output would overwrite \"" + wrapper_path + "\".");
+		}
+		std::vector<statement_function *> funcs;
+		std::vector<std::string> skipped;
+		for (auto &ptr:statements) {
+			switch (ptr->get_type()) {
+			case statement_types::package_:
+			case statement_types::import_:
+				break;
+			case statement_types::function_:
+				funcs.push_back(static_cast<statement_function *>(ptr));
+				break;
+			default:
+				skipped.push_back("statement at line " + std::to_string(ptr->get_line_num()));
+			}
+		}
+		// Calls may only target functions that translate themselves, so shrink the candidates until stable.
+		// Results are assumed to be numbers at first and change at most once, a candidate changing its
+		// result again is dropped. Parameters start as values and are typed at most once, when all of
+		// their uses need the same type.
+		aot_signatures sigs;
+		for (auto &func:funcs) {
+			if (aot_return(func) != nullptr)
+				sigs.emplace(func->get_name(), aot_signature{
+				    std::vector<aot_types>(func->get_args().size(), aot_types::value), aot_types::number});
+		}
+		set_t<std::string> retyped;
+		map_t<std::string, aot_code> translated;
+		for (bool changed = true; changed;) {
+			changed = false;
+			translated.clear();
+			for (auto &func:funcs) {
+				statement_return *ret = aot_return(func);
+				if (ret == nullptr || sigs.count(func->get_name()) == 0)
+					continue;
+				aot_signature &sig = sigs.at(func->get_name());
+				aot_scope scope{sigs, func->get_args(), sig.args,
+				                std::vector<aot_types>(sig.args.size(), aot_types::unsupported)};
+				aot_code code = aot_expr(scope, ret->get_tree().root());
+				if (code.type == aot_types::unsupported ||
+				        (code.type != sig.result && retyped.count(func->get_name()) > 0)) {
+					sigs.erase(func->get_name());
+					changed = true;
+					continue;
+				}
+				bool stable = true;
+				if (code.type != sig.result) {
+					sig.result = code.type;
+					retyped.insert(func->get_name());
+					stable = false;
+				}
+				for (std::size_t i = 0; i < sig.args.size(); ++i) {
+					if (sig.args[i] == aot_types::value && scope.demands[i] != aot_types::unsupported &&
+					        scope.demands[i] != aot_types::value) {
+						sig.args[i] = scope.demands[i];
+						stable = false;
+					}
+				}
+				if (stable)
+					translated.emplace(func->get_name(), std::move(code));
+				else
+					changed = true;
+			}
+		}
+		// The wrapper is the package source with the translated functions renamed
+		std::vector<std::string> source;
+		{
+			std::ifstream in(context->file_path);
+			for (std::string line; std::getline(in, line);)
+				source.push_back(line);
+		}
+		std::vector<statement_function *> entries;
+		for (auto &func:funcs) {
+			if (translated.count(func->get_name()) == 0)
+				skipped.push_back("function " + func->get_name());
+			else if (func->get_line_num() == 0 || func->get_line_num() > source.size() ||
+			         !aot_rename(source[func->get_line_num() - 1], func->get_name(), aot_script_name(func->get_name())))
+				skipped.push_back("function " + func->get_name() + ", declaration not found in the source");
+			else
+				entries.push_back(func);
+		}
+		auto signature = [&sigs](statement_function *func) {
+			const aot_signature &sig = sigs.at(func->get_name());
+			std::string decl = std::string(aot_type_name(sig.result)) + " " + aot_func_name(func->get_name()) + "(";
+			for (std::size_t i = 0; i < sig.args.size(); ++i) {
+				if (i > 0)
+					decl += ", ";
+				decl += aot_declare(sig.args[i], aot_arg_name(func->get_args()[i]));
+			}
+			return decl + ")";
+		};
+		std::ofstream stream(dir + path_separator + ext_name + ".cpp");
+		stream << "/*\n* Covariant Script AOT Extension\n*\n* Translated from package \"" << name
+		       << "\" by Covariant Script " << current_process->version << "\n* Build into " << ext_name
+		       << ".cse and install it next to the generated " << name << ".csp\n*/\n";
+		stream << "#include <covscript/cni.hpp>\n#include <covscript/dll.hpp>\n#include <cmath>\n\n";
+		stream << "CNI_ROOT_NAMESPACE {\n" << aot_runtime << "\n";
+		for (auto &func:funcs) {
+			if (translated.count(func->get_name()) > 0)
+				stream << "\t" << signature(func) << ";\n";
+		}
+		for (auto &func:funcs) {
+			if (translated.count(func->get_name()) > 0)
+				stream << "\n\t" << signature(func) << "\n\t{\n\t\treturn " << translated[func->get_name()].code
+				       << ";\n\t}\n";
+		}
+		// Entries take arguments of any type, the native code only runs if they have the translated types
+		for (auto &func:entries) {
+			const aot_signature &sig = sigs.at(func->get_name());
+			const std::vector<std::string> &args = func->get_args();
+			std::string params, checks, natives, forwards;
+			for (std::size_t i = 0; i < args.size(); ++i) {
+				std::string arg = aot_arg_name(args[i]);
+				params += (i > 0 ? ", " : "") + aot_declare(aot_types::value, arg);
+				forwards += ", " + arg;
+				natives += i > 0 ? ", " : "";
+				if (sig.args[i] == aot_types::value) {
+					natives += arg;
+					continue;
+				}
+				checks += std::string(checks.empty() ? "" : " && ") + arg + ".type() == typeid(" +
+				          aot_type_name(sig.args[i]) + ")";
+				natives += arg + ".const_val<" + aot_type_name(sig.args[i]) + ">()";
+			}
+			aot_code call = aot_box(aot_code{sig.result, aot_func_name(func->get_name()) + "(" + natives + ")"});
+			stream << "\n\tcs::var cs_aot_entry_" << func->get_name() << "(const cs::var &fallback)\n\t{\n"
+			       << "\t\treturn cs::make_cni([fallback](" << params << ") -> cs::var {\n\t\t\ttry {\n";
+			if (checks.empty())
+				stream << "\t\t\t\treturn " << call.code << ";\n";
+			else
+				stream << "\t\t\t\tif (" << checks << ")\n\t\t\t\t\treturn " << call.code << ";\n";
+			stream << "\t\t\t}\n\t\t\tcatch (const cs_aot_fallback &) {\n\t\t\t}\n"
+			       << "\t\t\treturn cs::invoke(fallback" << forwards << ");\n\t\t}, true);\n\t}\n\n"
+			       << "\tCNI_V(" << func->get_name() << ", cs_aot_entry_" << func->get_name() << ")\n";
+		}
+		stream << "}\n";
+		if (!skipped.empty()) {
+			stream << "\n// Not translated, left to the script in the wrapper package:\n";
+			for (auto &it:skipped)
+				stream << "//   " << it << "\n";
+		}
+		stream << std::flush;
+		std::ofstream wrapper(wrapper_path);
+		wrapper << wrapper_mark << " of package \"" << name << "\", translated by Covariant Script "
+		        << current_process->version << "\n# Install next to " << ext_name
+		        << ".cse in place of the package\n";
+		// The package declaration compiles into no statement, so the entries are bound after its line
+		bool bound = entries.empty();
+		for (auto &line:source) {
+			wrapper << line << "\n";
+			std::size_t pos = line.find_first_not_of(" \t");
+			if (bound || pos == std::string::npos || line.compare(pos, 7, "package") != 0 ||
+			        line.find_first_of(" \t", pos) != pos + 7)
+				continue;
+			bound = true;
+			wrapper << "import " << ext_name << "\n";
+			for (auto &func:entries) {
+				std::string args;
+				for (auto &arg:func->get_args())
+					args += (args.empty() ? "" : ", ") + arg;
+				wrapper << "var " << func->get_name() << " = " << ext_name << "." << func->get_name() << "([](" << args
+				        << ") -> " << aot_script_name(func->get_name()) << "(" << args << "))\n";
+			}
+		}
+		wrapper << std::flush;
+	}
+
 	void instance_type::check_declar_var(tree_type<token_base *>::iterator it, bool regist)
 	{
 		if (it.data() == nullptr)
@@ -407,22 +1197,37 @@ namespace cs {
 		std::deque<char> buff;
 		for (auto &ch:code)
 			buff.push_back(ch);
+		if (methods.empty())
+			unit = compile_unit::create();
+		// Held here as well, reset_status() drops the member
+		unit_t current_unit = unit;
+		compile_unit::scope scope(current_unit.get());
+		// Once a lambda holds the unit, it is released along with the context
+		auto keep_unit = [this, &current_unit] {
+			auto &units = context->compiler->units;
+			if (current_unit->has_anchors() && (units.empty() || units.back() != current_unit))
+				units.push_back(current_unit);
+		};
 		try {
 			std::deque<std::deque<token_base *>> ast;
 			context->compiler->clear_metadata();
 			context->compiler->build_line(buff, ast, 1, encoding);
 			for (auto &line:ast)
 				interpret(code, line);
+			keep_unit();
 		}
 		catch (const lang_error &le) {
+			keep_unit();
 			reset_status();
 			throw fatal_error(std::string("Uncaught exception: ") + le.what());
 		}
 		catch (const cs::exception &e) {
+			keep_unit();
 			reset_status();
 			throw e;
 		}
 		catch (const std::exception &e) {
+			keep_unit();
 			reset_status();
 			throw exception(line_num, context->file_path, code, e.what());
 		}
@@ -0,0 +1,635 @@
+/*
+* Covariant Script Profiler
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* Copyright (C) 2017-2022 Michael Lee(李登淳)
+*
+* This software is registered with the National Copyright Administration
+* of the People's Republic of China(Registration Number: 2020SR0408026)
+* and is protected by the Copyright Law of the People's Republic of China.
+*
+* Email:   lee@covariant.cn, mikecovlee@163.com
+* Github:  https://github.com/mikecovlee
+* Website: http://covscript.org.cn
+*/
+#include <covscript/impl/statement.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+
+namespace cs {
+	static std::string function_name(const statement_base *decl)
+	{
+		if (decl == nullptr)
+			return "<main>";
+		else if (decl->get_type() == statement_types::function_)
+			return static_cast<const statement_function *>(decl)->get_name();
+		else
+			return "<lambda>";
+	}
+
+	static std::string profile_label(const statement_base *decl, const statement_base *current)
+	{
+		std::string name = function_name(decl);
+		// Expression-bodied functions run without statements, report their declaration instead
+		const statement_base *line = current != nullptr ? current : decl;
+		if (line == nullptr)
+			return name;
+		return name + "@" + line->get_file_path() + ":" + std::to_string(line->get_line_num());
+	}
+
+	void sampling_profiler::take_sample()
+	{
+		std::size_t weight = m_ticks.exchange(0);
+		std::vector<const statement_base *> stack;
+		stack.reserve(m_frames.size() * 2);
+		++m_sample_id;
+		for (auto &frame:m_frames) {
+			stack.push_back(frame.decl);
+			stack.push_back(frame.current);
+			const statement_base *line = frame.current != nullptr ? frame.current : frame.decl;
+			if (line == nullptr)
+				continue;
+			line_record &record = m_lines[line];
+			// Recursive frames share lines, count each line once per sample
+			if (record.last_sample != m_sample_id) {
+				record.last_sample = m_sample_id;
+				record.total += weight;
+			}
+		}
+		const frame_type &top = m_frames.back();
+		const statement_base *line = top.current != nullptr ? top.current : top.decl;
+		if (line != nullptr)
+			m_lines[line].self += weight;
+		m_stacks[std::move(stack)] += weight;
+		m_samples += weight;
+	}
+
+	profiler::~profiler()
+	{
+		stop();
+		for (auto unit:m_units)
+			delete unit;
+	}
+
+	void profiler::start()
+	{
+		current_process->profiling = this;
+	}
+
+	void profiler::stop()
+	{
+		if (current_process->profiling == this)
+			current_process->profiling = nullptr;
+	}
+
+	void sampling_profiler::start()
+	{
+		if (m_running)
+			return;
+		profiler::start();
+		m_running = true;
+		m_timer = std::thread([this] {
+			while (m_running)
+			{
+				std::this_thread::sleep_for(m_interval);
+				m_ticks.fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+	}
+
+	void sampling_profiler::stop()
+	{
+		if (!m_running)
+			return;
+		m_running = false;
+		m_timer.join();
+		profiler::stop();
+	}
+
+	void sampling_profiler::run_statement(statement_base *stmt)
+	{
+		poll_sample();
+		m_frames.back().current = stmt;
+		stmt->run_impl();
+	}
+
+	void sampling_profiler::dump_folded(std::ostream &out) const
+	{
+		for (auto &it:m_stacks) {
+			const auto &stack = it.first;
+			for (std::size_t i = 0; i < stack.size(); i += 2) {
+				if (i != 0)
+					out << ';';
+				out << profile_label(stack[i], stack[i + 1]);
+			}
+			out << ' ' << it.second << '\n';
+		}
+		out.flush();
+	}
+
+	void sampling_profiler::dump_lines(std::ostream &out) const
+	{
+		std::vector<std::pair<const statement_base *, line_record>> lines(m_lines.begin(), m_lines.end());
+		std::stable_sort(lines.begin(), lines.end(), [](const std::pair<const statement_base *, line_record> &lhs,
+		const std::pair<const statement_base *, line_record> &rhs) {
+			return lhs.second.self > rhs.second.self || (lhs.second.self == rhs.second.self && lhs.second.total > rhs.second.total);
+		});
+		out << "# Samples: " << m_samples << ", Interval: " << m_interval.count() << "us\n";
+		out << "#   Self  Self%   Total Total%  Location\n";
+		const double scale = m_samples != 0 ? 100.0 / m_samples : 0;
+		for (auto &it:lines) {
+			const statement_base *stmt = it.first;
+			out << std::setw(8) << it.second.self << ' ' << std::setw(5) << std::fixed << std::setprecision(1)
+			    << it.second.self * scale << "% " << std::setw(7) << it.second.total << ' ' << std::setw(5)
+			    << it.second.total * scale << "%  " << stmt->get_file_path() << ':' << stmt->get_line_num();
+			const std::string &code = stmt->get_raw_code();
+			std::size_t pos = code.find_first_not_of(" \t");
+			if (pos != std::string::npos)
+				out << "  " << code.substr(pos);
+			out << '\n';
+		}
+		out.flush();
+	}
+
+	void sampling_profiler::report(const std::string &path) const
+	{
+		std::ofstream folded(path);
+		dump_folded(folded);
+		std::ofstream lines(path + ".lines");
+		dump_lines(lines);
+	}
+
+	void instrument_profiler::enter(std::vector<entry_type> &entries, record_type &record, std::size_t depth)
+	{
+		++record.count;
+		++record.active;
+		entries.push_back({&record, clock_type::now(), var::proxy_stats().alloc_count});
+		entries.back().depth = depth;
+	}
+
+	void instrument_profiler::leave(entry_type &entry, std::chrono::nanoseconds &duration, std::size_t &allocations)
+	{
+		duration = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - entry.start);
+		allocations = var::proxy_stats().alloc_count - entry.start_allocations;
+		record_type &record = *entry.record;
+		record.exclusive += duration - entry.children;
+		record.exclusive_allocations += allocations - entry.children_allocations;
+		if (--record.active == 0) {
+			record.inclusive += duration;
+			record.allocations += allocations;
+		}
+	}
+
+	void instrument_profiler::leave_statement()
+	{
+		std::chrono::nanoseconds duration;
+		std::size_t allocations;
+		leave(m_stmts.back(), duration, allocations);
+		std::size_t depth = m_stmts.back().depth;
+		m_stmts.pop_back();
+		// Nested statements of the same function are children, the caller's statement is not
+		if (!m_stmts.empty() && m_stmts.back().depth == depth) {
+			m_stmts.back().children += duration;
+			m_stmts.back().children_allocations += allocations;
+		}
+	}
+
+	void instrument_profiler::run_statement(statement_base *stmt)
+	{
+		enter(m_stmts, m_lines[stmt], m_calls.size());
+		try {
+			stmt->run_impl();
+		}
+		catch (...) {
+			leave_statement();
+			throw;
+		}
+		leave_statement();
+	}
+
+	void instrument_profiler::push_frame(const statement_base *decl)
+	{
+		enter(m_calls, m_functions[decl], m_calls.size());
+	}
+
+	void instrument_profiler::pop_frame()
+	{
+		if (m_calls.empty())
+			return;
+		std::chrono::nanoseconds duration;
+		std::size_t allocations;
+		leave(m_calls.back(), duration, allocations);
+		m_calls.pop_back();
+		if (!m_calls.empty()) {
+			m_calls.back().children += duration;
+			m_calls.back().children_allocations += allocations;
+		}
+		if (!m_stmts.empty()) {
+			m_stmts.back().children += duration;
+			m_stmts.back().children_allocations += allocations;
+		}
+	}
+
+	static std::string json_string(const std::string &str)
+	{
+		std::string json = "\"";
+		for (char ch:str) {
+			switch (ch) {
+			case '"':
+				json += "\\\"";
+				break;
+			case '\\':
+				json += "\\\\";
+				break;
+			case '\t':
+				json += "\\t";
+				break;
+			case '\r':
+				json += "\\r";
+				break;
+			case '\n':
+				json += "\\n";
+				break;
+			default:
+				if (static_cast<unsigned char>(ch) < 0x20) {
+					char buff[8];
+					std::snprintf(buff, sizeof(buff), "\\u%04x", ch);
+					json += buff;
+				}
+				else
+					json += ch;
+			}
+		}
+		return json + "\"";
+	}
+
+	template<typename T>
+	static std::vector<std::pair<const statement_base *, T>> sort_by_exclusive(const std::map<const statement_base *, T> &map)
+	{
+		std::vector<std::pair<const statement_base *, T>> records(map.begin(), map.end());
+		std::stable_sort(records.begin(), records.end(), [](const std::pair<const statement_base *, T> &lhs,
+		const std::pair<const statement_base *, T> &rhs) {
+			return lhs.second.exclusive > rhs.second.exclusive;
+		});
+		return records;
+	}
+
+	void instrument_profiler::dump_json(std::ostream &out) const
+	{
+		auto write_record = [&out](const record_type &record) {
+			out << ", \"count\": " << record.count << ", \"inclusive_ns\": " << record.inclusive.count()
+			    << ", \"exclusive_ns\": " << record.exclusive.count() << ", \"allocations\": " << record.allocations
+			    << ", \"exclusive_allocations\": " << record.exclusive_allocations << "}";
+		};
+		bool first = true;
+		out << "{\n  \"functions\": [";
+		for (auto &it:sort_by_exclusive(m_functions)) {
+			out << (first ? "\n" : ",\n") << "    {\"name\": " << json_string(function_name(it.first)) << ", \"file\": "
+			    << json_string(it.first->get_file_path()) << ", \"line\": " << it.first->get_line_num();
+			write_record(it.second);
+			first = false;
+		}
+		first = true;
+		out << "\n  ],\n  \"lines\": [";
+		for (auto &it:sort_by_exclusive(m_lines)) {
+			out << (first ? "\n" : ",\n") << "    {\"file\": " << json_string(it.first->get_file_path()) << ", \"line\": "
+			    << it.first->get_line_num();
+			write_record(it.second);
+			first = false;
+		}
+		out << "\n  ]\n}" << std::endl;
+	}
+
+	void instrument_profiler::dump_text(std::ostream &out) const
+	{
+		auto write_record = [&out](const record_type &record) {
+			out << std::setw(10) << record.count << std::fixed << std::setprecision(3)
+			    << std::setw(12) << record.inclusive.count() / 1e6 << std::setw(12) << record.exclusive.count() / 1e6
+			    << std::setw(10) << record.allocations << std::setw(10) << record.exclusive_allocations << "  ";
+		};
+		out << "Functions:\n";
+		out << "     Calls    Incl(ms)    Excl(ms)    Allocs  ExAllocs  Function\n";
+		for (auto &it:sort_by_exclusive(m_functions)) {
+			write_record(it.second);
+			out << function_name(it.first) << " (" << it.first->get_file_path() << ':' << it.first->get_line_num() << ")\n";
+		}
+		out << "\nLines:\n";
+		out << "      Hits    Incl(ms)    Excl(ms)    Allocs  ExAllocs  Location\n";
+		for (auto &it:sort_by_exclusive(m_lines)) {
+			write_record(it.second);
+			out << it.first->get_file_path() << ':' << it.first->get_line_num();
+			const std::string &code = it.first->get_raw_code();
+			std::size_t pos = code.find_first_not_of(" \t");
+			if (pos != std::string::npos)
+				out << "  " << code.substr(pos);
+			out << '\n';
+		}
+		out.flush();
+	}
+
+	void instrument_profiler::report(const std::string &path) const
+	{
+		std::ofstream json(path);
+		dump_json(json);
+		std::ofstream text(path + ".txt");
+		dump_text(text);
+	}
+
+	void trace_profiler::run_statement(statement_base *stmt)
+	{
+		stmt->run_impl();
+	}
+
+	void trace_profiler::pop_frame()
+	{
+		if (m_calls.empty())
+			return;
+		clock_type::duration duration = clock_type::now() - m_calls.back().second;
+		// Names are resolved now, statements may be collected before the report
+		if (duration >= m_threshold) {
+			const statement_base *decl = m_calls.back().first;
+			m_events.push_back({function_name(decl), "call", decl->get_file_path(), decl->get_line_num(),
+			                    m_calls.back().second, duration});
+		}
+		m_calls.pop_back();
+	}
+
+	void trace_profiler::begin_phase(const char *name, const std::string &detail)
+	{
+		m_phases.push_back(m_events.size());
+		m_events.push_back({detail.empty() ? name : std::string(name) + " " + detail, "phase", detail, 0,
+		                    clock_type::now(), clock_type::duration::zero()});
+	}
+
+	void trace_profiler::end_phase()
+	{
+		if (m_phases.empty())
+			return;
+		event_type &event = m_events[m_phases.back()];
+		event.duration = clock_type::now() - event.start;
+		m_phases.pop_back();
+	}
+
+	void trace_profiler::dump_json(std::ostream &out) const
+	{
+		using microseconds = std::chrono::duration<double, std::micro>;
+		out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+		bool first = true;
+		out << std::fixed << std::setprecision(3);
+		for (auto &event:m_events) {
+			out << (first ? "\n" : ",\n") << "  {\"name\": " << json_string(event.name) << ", \"cat\": \""
+			    << event.category << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": "
+			    << microseconds(event.start - m_origin).count() << ", \"dur\": " << microseconds(event.duration).count();
+			if (!event.file.empty()) {
+				out << ", \"args\": {\"file\": " << json_string(event.file);
+				if (event.line != 0)
+					out << ", \"line\": " << event.line;
+				out << "}";
+			}
+			out << "}";
+			first = false;
+		}
+		out << "\n]}" << std::endl;
+	}
+
+	void trace_profiler::report(const std::string &path) const
+	{
+		std::ofstream json(path);
+		dump_json(json);
+	}
+
+	void coverage_profiler::run_statement(statement_base *stmt)
+	{
+		stmt->count_execution();
+		stmt->run_impl();
+	}
+
+	struct coverage_line final {
+		std::size_t count = 0;
+		const statement_base *stmt = nullptr;
+		// Evaluated conditions and taken branches of conditional statements and loops
+		bool is_branch = false;
+		std::size_t branch_exec = 0;
+		std::size_t branch_taken = 0;
+	};
+
+	using coverage_map = std::map<std::string, std::map<std::size_t, coverage_line>>;
+
+	static coverage_map collect_coverage(const std::vector<const statement_base *> &statements)
+	{
+		coverage_map files;
+		for (auto stmt:statements) {
+			switch (stmt->get_type()) {
+			// Markers which are folded into their enclosing statements and never run
+			case statement_types::null:
+			case statement_types::else_:
+			case statement_types::end_:
+			case statement_types::catch_:
+				continue;
+			default:
+				break;
+			}
+			coverage_line &line = files[stmt->get_file_path()][stmt->get_line_num()];
+			if (line.stmt == nullptr || stmt->get_exec_count() > line.count) {
+				line.count = stmt->get_exec_count();
+				line.stmt = stmt;
+			}
+			switch (stmt->get_type()) {
+			default:
+				continue;
+			case statement_types::if_:
+			case statement_types::switch_:
+			case statement_types::while_:
+			case statement_types::for_:
+				break;
+			case statement_types::loop_:
+				// Only loops closed by until have a condition
+				if (dynamic_cast<const statement_loop_until *>(stmt) == nullptr)
+					continue;
+				break;
+			}
+			line.is_branch = true;
+			line.branch_exec += stmt->get_branch_count();
+			line.branch_taken += stmt->get_taken_count();
+		}
+		return files;
+	}
+
+	void coverage_profiler::dump_lcov(std::ostream &out) const
+	{
+		for (auto &file:collect_coverage(m_statements)) {
+			std::size_t lines_hit = 0, branches = 0, branches_hit = 0;
+			out << "TN:\nSF:" << file.first << "\n";
+			for (auto &it:file.second) {
+				const coverage_line &line = it.second;
+				if (!line.is_branch)
+					continue;
+				branches += 2;
+				if (line.branch_exec == 0) {
+					out << "BRDA:" << it.first << ",0,0,-\nBRDA:" << it.first << ",0,1,-\n";
+					continue;
+				}
+				std::size_t not_taken = line.branch_exec - line.branch_taken;
+				branches_hit += (line.branch_taken != 0) + (not_taken != 0);
+				out << "BRDA:" << it.first << ",0,0," << line.branch_taken << "\nBRDA:" << it.first << ",0,1,"
+				    << not_taken << "\n";
+			}
+			out << "BRF:" << branches << "\nBRH:" << branches_hit << "\n";
+			for (auto &it:file.second) {
+				if (it.second.count != 0)
+					++lines_hit;
+				out << "DA:" << it.first << "," << it.second.count << "\n";
+			}
+			out << "LF:" << file.second.size() << "\nLH:" << lines_hit << "\nend_of_record\n";
+		}
+		out.flush();
+	}
+
+	void coverage_profiler::dump_hotspots(std::ostream &out) const
+	{
+		std::vector<std::pair<std::string, const coverage_line *>> lines;
+		coverage_map files = collect_coverage(m_statements);
+		for (auto &file:files)
+			for (auto &it:file.second)
+				if (it.second.count != 0)
+					lines.emplace_back(file.first + ":" + std::to_string(it.first), &it.second);
+		std::stable_sort(lines.begin(), lines.end(), [](const std::pair<std::string, const coverage_line *> &a,
+		const std::pair<std::string, const coverage_line *> &b) {
+			return a.second->count > b.second->count;
+		});
+		out << "Count\tLine\tCode\n";
+		for (auto &it:lines)
+			out << it.second->count << "\t" << it.first << "\t" << it.second->stmt->get_raw_code() << "\n";
+		out.flush();
+	}
+
+	void coverage_profiler::report(const std::string &path) const
+	{
+		std::ofstream lcov(path);
+		dump_lcov(lcov);
+		std::ofstream hot(path + ".hot");
+		dump_hotspots(hot);
+	}
+	void phase_profiler::run_statement(statement_base *stmt)
+	{
+		stmt->run_impl();
+	}
+
+	std::size_t phase_profiler::token_nodes()
+	{
+		return token_base::gc.node_count() + compile_unit::token_count();
+	}
+
+	std::size_t phase_profiler::statement_nodes()
+	{
+		return statement_base::gc.node_count() + compile_unit::statement_count();
+	}
+
+	std::size_t phase_profiler::node_bytes()
+	{
+		return token_base::gc.bytes_used() + statement_base::gc.bytes_used() + compile_unit::bytes_used();
+	}
+
+	void phase_profiler::enter(const char *name, record_type *record)
+	{
+		m_entries.push_back({name, record, clock_type::now(), token_nodes(), statement_nodes(), node_bytes()});
+	}
+
+	void phase_profiler::leave()
+	{
+		if (m_entries.empty())
+			return;
+		entry_type &entry = m_entries.back();
+		clock_type::duration duration = clock_type::now() - entry.start;
+		// Arenas only grow while compiling, units released meanwhile are kept by the profiler
+		std::size_t tokens = token_nodes() - entry.tokens;
+		std::size_t statements = statement_nodes() - entry.statements;
+		std::size_t bytes = node_bytes() - entry.bytes;
+		if (entry.record != nullptr) {
+			entry.record->phases[entry.name] += duration - entry.children;
+			entry.record->tokens += tokens - entry.children_tokens;
+			entry.record->statements += statements - entry.children_statements;
+			entry.record->bytes += bytes - entry.children_bytes;
+		}
+		m_entries.pop_back();
+		if (!m_entries.empty()) {
+			entry_type &parent = m_entries.back();
+			parent.children += duration;
+			parent.children_tokens += tokens;
+			parent.children_statements += statements;
+			parent.children_bytes += bytes;
+		}
+	}
+
+	void phase_profiler::begin_phase(const char *name, const std::string &detail)
+	{
+		record_type *record = nullptr;
+		if (!detail.empty()) {
+			if (m_records.count(detail) == 0)
+				m_files.push_back(detail);
+			record = &m_records[detail];
+		}
+		else if (!m_entries.empty())
+			record = m_entries.back().record;
+		enter(name, record);
+	}
+
+	void phase_profiler::dump(std::ostream &out) const
+	{
+		using milliseconds = std::chrono::duration<double, std::milli>;
+		static const char *columns[] = {"read", "lex", "parse", "match_grammar", "opt_expr", "code_gen", "import",
+		                                "dlopen"
+		                               };
+		record_type total;
+		out << std::fixed << std::setprecision(3);
+		for (auto &name:columns)
+			out << name << "\t";
+		out << "total\ttokens\tstatements\tast_bytes\tfile\n";
+		auto dump_record = [&out](const record_type &record, const std::string &name) {
+			clock_type::duration sum{0};
+			for (auto &column:columns) {
+				auto it = record.phases.find(column);
+				clock_type::duration duration = it == record.phases.end() ? clock_type::duration::zero() : it->second;
+				sum += duration;
+				out << milliseconds(duration).count() << "\t";
+			}
+			out << milliseconds(sum).count() << "\t" << record.tokens << "\t" << record.statements << "\t" << record.bytes
+			    << "\t" << name << "\n";
+		};
+		for (auto &file:m_files) {
+			const record_type &record = m_records.at(file);
+			dump_record(record, file);
+			for (auto &it:record.phases)
+				total.phases[it.first] += it.second;
+			total.tokens += record.tokens;
+			total.statements += record.statements;
+			total.bytes += record.bytes;
+		}
+		dump_record(total, "<total>");
+		out.flush();
+	}
+
+	void phase_profiler::report(const std::string &path) const
+	{
+		if (path.empty())
+			dump(std::cerr);
+		else {
+			std::ofstream out(path);
+			dump(out);
+		}
+	}
+}
@@ -36,12 +36,51 @@ namespace cs {
 			throw runtime_error("Unsupported operator operations(Add).");
 	}
 
+	// The specialized operators below are emitted by type_inference: their guard is a single type check, and
+	// anything the inference did not foresee goes through the generic operator
+	var runtime_type::parse_add_num(const var &a, const var &b)
+	{
+		if (a.type() == typeid(number) && b.type() == typeid(number))
+			return a.unchecked_val<number>() + b.unchecked_val<number>();
+		else
+			return parse_add(a, b);
+	}
+
 	var runtime_type::parse_addasi(var a, const var &b)
 	{
+		// Update in place when the swap below could not fail: saves a temporary, and for strings a full copy
+		if (a.is_assignable()) {
+			if (a.type() == typeid(number) && b.type() == typeid(number)) {
+				a.val<number>() += b.const_val<number>();
+				return a;
+			}
+			if (a.type() == typeid(string) && b.usable()) {
+				a.val<string>().append(b.to_string());
+				return a;
+			}
+		}
 		a.swap(parse_add(a, b), true);
 		return a;
 	}
 
+	var runtime_type::parse_addasi_str(var a, const var &b)
+	{
+		if (a.is_assignable() && a.type() == typeid(string)) {
+			string &str = a.unchecked_val<string>();
+			// Strings are appended as they are, without going through to_string
+			if (b.type() == typeid(string))
+				str.append(b.unchecked_val<string>());
+			else if (b.type() == typeid(char))
+				str.push_back(b.unchecked_val<char>());
+			else if (b.usable())
+				str.append(b.to_string());
+			else
+				return parse_addasi(a, b);
+			return a;
+		}
+		return parse_addasi(a, b);
+	}
+
 	var runtime_type::parse_sub(const var &a, const var &b)
 	{
 		if (a.type() == typeid(number) && b.type() == typeid(number))
@@ -52,6 +91,10 @@ namespace cs {
 
 	var runtime_type::parse_subasi(var a, const var &b)
 	{
+		if (a.is_assignable() && a.type() == typeid(number) && b.type() == typeid(number)) {
+			a.val<number>() -= b.const_val<number>();
+			return a;
+		}
 		a.swap(parse_sub(a, b), true);
 		return a;
 	}
@@ -74,6 +117,10 @@ namespace cs {
 
 	var runtime_type::parse_mulasi(var a, const var &b)
 	{
+		if (a.is_assignable() && a.type() == typeid(number) && b.type() == typeid(number)) {
+			a.val<number>() *= b.const_val<number>();
+			return a;
+		}
 		a.swap(parse_mul(a, b), true);
 		return a;
 	}
@@ -101,6 +148,10 @@ namespace cs {
 
 	var runtime_type::parse_divasi(var a, const var &b)
 	{
+		if (a.is_assignable() && a.type() == typeid(number) && b.type() == typeid(number)) {
+			a.val<number>() /= b.const_val<number>();
+			return a;
+		}
 		a.swap(parse_div(a, b), true);
 		return a;
 	}
@@ -207,7 +258,8 @@ namespace cs {
 				if (val.type() == typeid(callable)) {
 					const callable &func = val.const_val<callable>();
 					switch (func.type()) {
-					case callable::types::member_visitor: {
+					case callable::types::member_visitor:
+					case callable::types::member_visitor_fold: {
 						vector args{a};
 						return func.call(args);
 					}
@@ -459,6 +511,8 @@ namespace cs {
 				else
 					args.push_back(lvalue(parse_expr(tree.root())));
 			}
+			// Callees never see the arguments of an inlined caller
+			frame_guard guard(this, nullptr, nullptr);
 			return a.const_val<callable>().call(args);
 		}
 		else if (a.type() == typeid(object_method)) {
@@ -477,6 +531,7 @@ namespace cs {
 				else
 					args.push_back(lvalue(parse_expr(tree.root())));
 			}
+			frame_guard guard(this, nullptr, nullptr);
 			return om.callable.const_val<callable>().call(args);
 		}
 		else
@@ -557,6 +612,157 @@ namespace cs {
 			throw runtime_error("Access non-array or string object.");
 	}
 
+	var runtime_type::parse_access_arr(const var &a, const var &b)
+	{
+		if (a.type() == typeid(array) && b.type() == typeid(number)) {
+			const auto &carr = a.unchecked_val<array>();
+			number idx = b.unchecked_val<number>();
+			if (idx >= 0 && idx < carr.size())
+				return carr[static_cast<std::size_t>(idx)];
+		}
+		// Growing the array, negative indexes and errors
+		return parse_access(a, b);
+	}
+
+	var runtime_type::parse_flat(token_flat *flat)
+	{
+		using opcode = token_flat::opcode;
+		const auto &nodes = flat->get_nodes();
+		auto &ids = flat->get_ids();
+		number stack[token_flat::max_depth];
+		std::size_t top = 0;
+		bool numeric = true;
+		for (auto &node:nodes) {
+			switch (node.op) {
+			case opcode::push_number:
+				stack[top++] = node.value;
+				break;
+			case opcode::push_var: {
+				const var &val = lookup_var(ids[node.index]);
+				if (val.type() != typeid(number)) {
+					numeric = false;
+					break;
+				}
+				stack[top++] = val.const_val<number>();
+				break;
+			}
+			case opcode::add:
+				--top;
+				stack[top - 1] = stack[top - 1] + stack[top];
+				break;
+			case opcode::sub:
+				--top;
+				stack[top - 1] = stack[top - 1] - stack[top];
+				break;
+			case opcode::mul:
+				--top;
+				stack[top - 1] = stack[top - 1] * stack[top];
+				break;
+			case opcode::div:
+				--top;
+				stack[top - 1] = stack[top - 1] / stack[top];
+				break;
+			case opcode::mod:
+				--top;
+				stack[top - 1] = std::fmod(stack[top - 1], stack[top]);
+				break;
+			case opcode::pow:
+				--top;
+				stack[top - 1] = std::pow(stack[top - 1], stack[top]);
+				break;
+			case opcode::minus:
+				stack[top - 1] = -stack[top - 1];
+				break;
+			case opcode::square:
+				stack[top - 1] = stack[top - 1] * stack[top - 1];
+				break;
+			case opcode::und:
+				--top;
+				stack[top - 1] = stack[top - 1] < stack[top];
+				break;
+			case opcode::abo:
+				--top;
+				stack[top - 1] = stack[top - 1] > stack[top];
+				break;
+			case opcode::ueq:
+				--top;
+				stack[top - 1] = stack[top - 1] <= stack[top];
+				break;
+			case opcode::aeq:
+				--top;
+				stack[top - 1] = stack[top - 1] >= stack[top];
+				break;
+			}
+			if (!numeric)
+				break;
+		}
+		if (numeric) {
+			if (flat->is_predicate())
+				return rvalue(var::make<boolean>(stack[0] != 0));
+			return rvalue(var::make<number>(stack[0]));
+		}
+		// Some operand is not a number: replay through the generic operators for their semantics and errors
+		std::vector<var> vals;
+		vals.reserve(flat->get_depth());
+		for (auto &node:nodes) {
+			switch (node.op) {
+			case opcode::push_number:
+				vals.emplace_back(var::make<number>(node.value));
+				break;
+			case opcode::push_var:
+				vals.emplace_back(lookup_var(ids[node.index]));
+				break;
+			case opcode::minus:
+				vals.back() = rvalue(parse_minus(vals.back()));
+				break;
+			case opcode::square:
+				vals.back() = rvalue(parse_pow(vals.back(), var::make<number>(2)));
+				break;
+			default: {
+				var rhs = std::move(vals.back());
+				vals.pop_back();
+				var &lhs = vals.back();
+				switch (node.op) {
+				default:
+					break;
+				case opcode::add:
+					lhs = rvalue(parse_add(lhs, rhs));
+					break;
+				case opcode::sub:
+					lhs = rvalue(parse_sub(lhs, rhs));
+					break;
+				case opcode::mul:
+					lhs = rvalue(parse_mul(lhs, rhs));
+					break;
+				case opcode::div:
+					lhs = rvalue(parse_div(lhs, rhs));
+					break;
+				case opcode::mod:
+					lhs = rvalue(parse_mod(lhs, rhs));
+					break;
+				case opcode::pow:
+					lhs = rvalue(parse_pow(lhs, rhs));
+					break;
+				case opcode::und:
+					lhs = rvalue(parse_und(lhs, rhs));
+					break;
+				case opcode::abo:
+					lhs = rvalue(parse_abo(lhs, rhs));
+					break;
+				case opcode::ueq:
+					lhs = rvalue(parse_ueq(lhs, rhs));
+					break;
+				case opcode::aeq:
+					lhs = rvalue(parse_aeq(lhs, rhs));
+					break;
+				}
+				break;
+			}
+			}
+		}
+		return vals.back();
+	}
+
 	var runtime_type::parse_expr(const tree_type<token_base *>::iterator &it, bool disable_parallel)
 	{
 		if (!it.usable())
@@ -574,7 +780,7 @@ namespace cs {
 			throw runtime_error("Wrong expanding position.");
 			break;
 		case token_types::id:
-			return storage.get_var(static_cast<token_id *>(token)->get_id());
+			return lookup_var(static_cast<token_id *>(token)->get_id());
 			break;
 		case token_types::literal: {
 			token_literal *ptr = static_cast<token_literal *>(token);
@@ -586,6 +792,9 @@ namespace cs {
 		case token_types::expr:
 			return parse_expr(static_cast<token_expr *>(token)->get_tree().root());
 			break;
+		case token_types::flat:
+			return parse_flat(static_cast<token_flat *>(token));
+			break;
 		case token_types::array: {
 			array arr;
 			token_base *ptr = nullptr;
@@ -617,9 +826,15 @@ namespace cs {
 			case signal_types::add_:
 				return rvalue(parse_add(parse_expr(it.left()), parse_expr(it.right())));
 				break;
+			case signal_types::add_num_:
+				return rvalue(parse_add_num(parse_expr(it.left()), parse_expr(it.right())));
+				break;
 			case signal_types::addasi_:
 				return parse_addasi(parse_expr(it.left()), parse_expr(it.right()));
 				break;
+			case signal_types::addasi_str_:
+				return parse_addasi_str(parse_expr(it.left()), parse_expr(it.right()));
+				break;
 			case signal_types::sub_:
 				return rvalue(parse_sub(parse_expr(it.left()), parse_expr(it.right())));
 				break;
@@ -728,6 +943,9 @@ namespace cs {
 			case signal_types::access_:
 				return parse_access(parse_expr(it.left()), parse_expr(it.right()));
 				break;
+			case signal_types::access_arr_:
+				return parse_access_arr(parse_expr(it.left()), parse_expr(it.right()));
+				break;
 			}
 		}
 		}
@@ -27,6 +27,92 @@
 #include <iostream>
 
 namespace cs {
+	static bool inline_safe(const std::vector<std::string> &, tree_type<token_base *>::iterator);
+
+	static bool inline_safe(const std::vector<std::string> &args, const tree_type<token_base *> &tree)
+	{
+		return inline_safe(args, tree.root());
+	}
+
+	static bool inline_safe(const std::vector<std::string> &args, const std::string &name)
+	{
+		return std::find(args.begin(), args.end(), name) != args.end();
+	}
+
+	static bool inline_safe(const std::vector<std::string> &args, tree_type<token_base *>::iterator it)
+	{
+		if (!it.usable() || it.data() == nullptr)
+			return true;
+		token_base *token = it.data();
+		switch (token->get_type()) {
+		default:
+			return false;
+		case token_types::id:
+			return inline_safe(args, static_cast<token_id *>(token)->get_id().get_id());
+		case token_types::value:
+			// Scope tags resolve against whatever domain is on top
+			return static_cast<token_value *>(token)->get_value().type() != typeid(constant_values);
+		case token_types::literal:
+			return true;
+		case token_types::flat:
+			for (auto &id:static_cast<token_flat *>(token)->get_ids())
+				if (!inline_safe(args, id.get_id()))
+					return false;
+			return true;
+		case token_types::expr:
+			return inline_safe(args, static_cast<token_expr *>(token)->get_tree());
+		case token_types::expand:
+			return inline_safe(args, static_cast<token_expand *>(token)->get_tree());
+		case token_types::arglist:
+			for (auto &tree:static_cast<token_arglist *>(token)->get_arglist())
+				if (!inline_safe(args, tree))
+					return false;
+			return true;
+		case token_types::array:
+			for (auto &tree:static_cast<token_array *>(token)->get_array())
+				if (!inline_safe(args, tree))
+					return false;
+			return true;
+		case token_types::parallel:
+			for (auto &tree:static_cast<token_parallel *>(token)->get_parallel())
+				if (!inline_safe(args, tree))
+					return false;
+			return true;
+		case token_types::signal:
+			break;
+		}
+		switch (static_cast<token_signal *>(token)->get_signal()) {
+		default:
+			return inline_safe(args, it.left()) && inline_safe(args, it.right());
+		case signal_types::dot_:
+		case signal_types::arrow_:
+			// The right side names a member, not a variable
+			return inline_safe(args, it.left());
+		case signal_types::lnkasi_:
+		case signal_types::bind_:
+		case signal_types::vardef_:
+		case signal_types::varchk_:
+			return false;
+		}
+	}
+
+	void function::load_body() const
+	{
+		mBody = static_cast<statement_function *>(mLazy)->get_block();
+		mLazy = nullptr;
+	}
+
+	bool function::inlinable() const
+	{
+		if (mInline == inline_state::unknown) {
+			mInline = inline_state::disabled;
+			if (!mIsVargs && mBody.size() == 1 && mBody.front()->get_type() == statement_types::return_ &&
+			        inline_safe(mArgs, static_cast<statement_return *>(mBody.front())->get_tree()))
+				mInline = inline_state::enabled;
+		}
+		return mInline == inline_state::enabled;
+	}
+
 	var function::call(vector &args) const
 	{
 		current_process->poll_event();
@@ -34,9 +120,31 @@ namespace cs {
 			throw runtime_error(
 			    "Wrong size of arguments.Expected " + std::to_string(this->mArgs.size()) + ",provided " +
 			    std::to_string(args.size()));
+		if (mLazy != nullptr)
+			load_body();
+		fork_guard fork(mContext->instance.get());
+		profile_guard profile(mStmt);
+#ifndef CS_DEBUGGER
+		// Attached profilers see every statement, so nothing is inlined
+		if (current_process->profiling == nullptr && inlinable()) {
+			fcall_guard fcall;
+			runtime_type::frame_guard frame(mContext->instance.get(), &mArgs, &args);
+			statement_base *ptr = mBody.front();
+			try {
+				return mContext->instance->parse_expr(static_cast<statement_return *>(ptr)->get_tree().root());
+			}
+			catch (const cs::exception &e) {
+				throw e;
+			}
+			catch (const std::exception &e) {
+				throw exception(ptr->get_line_num(), ptr->get_file_path(), ptr->get_raw_code(), e.what());
+			}
+		}
+#endif
+		runtime_type::frame_guard frame(mContext->instance.get(), nullptr, nullptr);
 		scope_guard scope(mContext);
 #ifdef CS_DEBUGGER
-		fcall_guard fcall(mDecl);
+		fcall_guard fcall(this);
 		if(mMatch)
 			cs_debugger_func_callback(mDecl, mStmt);
 #else
@@ -58,6 +166,22 @@ namespace cs {
 			for (std::size_t i = 0; i < args.size(); ++i)
 				mContext->instance->storage.add_var(this->mArgs[i], args[i]);
 		}
+#ifndef CS_DEBUGGER
+		// Expression-bodied functions skip the statement loop and evaluate their result in place
+		if (current_process->profiling == nullptr && mBody.size() == 1 &&
+		        mBody.front()->get_type() == statement_types::return_) {
+			statement_base *ptr = mBody.front();
+			try {
+				return mContext->instance->parse_expr(static_cast<statement_return *>(ptr)->get_tree().root());
+			}
+			catch (const cs::exception &e) {
+				throw e;
+			}
+			catch (const std::exception &e) {
+				throw exception(ptr->get_line_num(), ptr->get_file_path(), ptr->get_raw_code(), e.what());
+			}
+		}
+#endif
 		for (auto &ptr:this->mBody) {
 			try {
 				ptr->run();
@@ -78,6 +202,8 @@ namespace cs {
 
 	var struct_builder::operator()()
 	{
+		// Members are initialized in the scope of the struct, never in the frame of an inlined caller
+		runtime_type::frame_guard frame(mContext->instance.get(), nullptr, nullptr);
 		scope_guard scope(mContext);
 		if (mParent.root().usable()) {
 			var builder = mContext->instance->parse_expr(mParent.root());
@@ -264,7 +390,7 @@ namespace cs {
 	void statement_if::run_impl()
 	{
 		CS_DEBUGGER_STEP(this);
-		if (context->instance->parse_expr(mTree.root()).const_val<boolean>()) {
+		if (count_branch(context->instance->parse_expr(mTree.root()).const_val<boolean>())) {
 			scope_guard scope(context);
 			for (auto &ptr:mBlock) {
 				try {
@@ -296,7 +422,7 @@ namespace cs {
 	void statement_ifelse::run_impl()
 	{
 		CS_DEBUGGER_STEP(this);
-		if (context->instance->parse_expr(mTree.root()).const_val<boolean>()) {
+		if (count_branch(context->instance->parse_expr(mTree.root()).const_val<boolean>())) {
 			scope_guard scope(context);
 			for (auto &ptr:mBlock) {
 				try {
@@ -349,7 +475,8 @@ namespace cs {
 	{
 		CS_DEBUGGER_STEP(this);
 		var key = context->instance->parse_expr(mTree.root());
-		if (mCases.count(key) > 0)
+		// Taken when a case matches, falling through to the default case is the other branch
+		if (count_branch(mCases.count(key) > 0))
 			mCases[key]->run();
 		else if (mDefault != nullptr)
 			mDefault->run();
@@ -385,7 +512,7 @@ namespace cs {
 		if (context->instance->continue_block)
 			context->instance->continue_block = false;
 		scope_guard scope(context);
-		while (context->instance->parse_expr(mTree.root()).const_val<boolean>()) {
+		while (count_branch(context->instance->parse_expr(mTree.root()).const_val<boolean>())) {
 			scope.clear();
 			current_process->poll_event();
 			for (auto &ptr:mBlock) {
@@ -501,7 +628,7 @@ namespace cs {
 				}
 			}
 		}
-		while (!context->instance->parse_expr(mExpr.root()).const_val<boolean>());
+		while (!count_branch(context->instance->parse_expr(mExpr.root()).const_val<boolean>()));
 	}
 
 	void statement_loop_until::dump(std::ostream &o) const
@@ -515,6 +642,151 @@ namespace cs {
 		o << "< EndLoop >\n";
 	}
 
+	void statement_for::analyze_loop()
+	{
+		auto cond = mParallel[1].root();
+		token_signal *sig = dynamic_cast<token_signal *>(cond.data());
+		if (sig != nullptr) {
+			switch (sig->get_signal()) {
+			default:
+				break;
+			case signal_types::und_:
+			case signal_types::abo_:
+			case signal_types::ueq_:
+			case signal_types::aeq_: {
+				token_id *id = dynamic_cast<token_id *>(cond.left().data());
+				if (id != nullptr) {
+					mCondId = &id->get_id();
+					mCondSig = sig->get_signal();
+				}
+				break;
+			}
+			}
+		}
+		else if (cond.data() != nullptr && cond.data()->get_type() == token_types::flat)
+			analyze_flat_condition(static_cast<token_flat *>(cond.data()));
+		auto step = mParallel[2].root();
+		sig = dynamic_cast<token_signal *>(step.data());
+		if (sig != nullptr && (sig->get_signal() == signal_types::inc_ || sig->get_signal() == signal_types::dec_)) {
+			token_base *lptr = step.left().data(), *rptr = step.right().data();
+			// Prefix and postfix forms only differ in the discarded result
+			if ((lptr == nullptr) != (rptr == nullptr)) {
+				mStepId = dynamic_cast<token_id *>(lptr != nullptr ? lptr : rptr);
+				mStepInc = sig->get_signal() == signal_types::inc_;
+			}
+		}
+	}
+
+	void statement_for::analyze_flat_condition(token_flat *flat)
+	{
+		using opcode = token_flat::opcode;
+		auto &nodes = flat->get_nodes();
+		if (nodes.size() < 3 || nodes.front().op != opcode::push_var)
+			return;
+		signal_types cmp;
+		switch (nodes.back().op) {
+		default:
+			return;
+		case opcode::und:
+			cmp = signal_types::und_;
+			break;
+		case opcode::abo:
+			cmp = signal_types::abo_;
+			break;
+		case opcode::ueq:
+			cmp = signal_types::ueq_;
+			break;
+		case opcode::aeq:
+			cmp = signal_types::aeq_;
+			break;
+		}
+		// The nodes between the iterator and the comparison must form the whole right operand,
+		// which rules out conditions such as "i + 1 < n" whose left operand only starts with an id
+		std::size_t height = 0, depth = 0;
+		for (std::size_t i = 1; i + 1 < nodes.size(); ++i) {
+			switch (nodes[i].op) {
+			case opcode::push_number:
+			case opcode::push_var:
+				++height;
+				break;
+			case opcode::minus:
+			case opcode::square:
+				if (height < 1)
+					return;
+				break;
+			default:
+				if (height < 2)
+					return;
+				--height;
+				break;
+			}
+			if (height > depth)
+				depth = height;
+		}
+		if (height != 1)
+			return;
+		token_flat bound;
+		bound.get_nodes().assign(nodes.begin() + 1, nodes.end() - 1);
+		bound.get_ids() = flat->get_ids();
+		bound.set_depth(depth);
+		mCondBound = new token_flat(std::move(bound));
+		mCondId = &flat->get_ids()[nodes.front().index];
+		mCondSig = cmp;
+	}
+
+	bool statement_for::test_condition()
+	{
+		if (mCondId == nullptr)
+			return context->instance->parse_expr(mParallel[1].root()).const_val<boolean>();
+		// Evaluate the bound first: it may define variables and move the iterator's storage
+		var rhs = mCondBound != nullptr ? context->instance->parse_flat(mCondBound)
+		          : context->instance->parse_expr(mParallel[1].root().right());
+		const var &lhs = context->instance->storage.get_var(*mCondId);
+		if (lhs.type() == typeid(number) && rhs.type() == typeid(number)) {
+			number a = lhs.const_val<number>(), b = rhs.const_val<number>();
+			switch (mCondSig) {
+			default:
+			case signal_types::und_:
+				return a < b;
+			case signal_types::abo_:
+				return a > b;
+			case signal_types::ueq_:
+				return a <= b;
+			case signal_types::aeq_:
+				return a >= b;
+			}
+		}
+		switch (mCondSig) {
+		default:
+		case signal_types::und_:
+			return context->instance->parse_und(lhs, rhs).const_val<boolean>();
+		case signal_types::abo_:
+			return context->instance->parse_abo(lhs, rhs).const_val<boolean>();
+		case signal_types::ueq_:
+			return context->instance->parse_ueq(lhs, rhs).const_val<boolean>();
+		case signal_types::aeq_:
+			return context->instance->parse_aeq(lhs, rhs).const_val<boolean>();
+		}
+	}
+
+	void statement_for::step()
+	{
+		if (mStepId == nullptr) {
+			context->instance->parse_expr(mParallel[2].root());
+			return;
+		}
+		var &it = context->instance->storage.get_var(mStepId->get_id());
+		if (!it.usable()) {
+			context->instance->parse_expr(mParallel[2].root());
+			return;
+		}
+		number &n = it.val<number>();
+		if (mStepInc)
+			++n;
+		else
+			--n;
+	}
+
 	void statement_for::run_impl()
 	{
 		CS_DEBUGGER_STEP(this);
@@ -528,7 +800,7 @@ namespace cs {
 		while (true) {
 			scope.clear();
 			current_process->poll_event();
-			if (!context->instance->parse_expr(mParallel[1].root()).const_val<boolean>())
+			if (!count_branch(test_condition()))
 				break;
 			for (auto &ptr:mBlock) {
 				try {
@@ -552,7 +824,7 @@ namespace cs {
 					break;
 				}
 			}
-			context->instance->parse_expr(mParallel[2].root());
+			step();
 		}
 	}
 
@@ -645,7 +917,9 @@ namespace cs {
 	void statement_struct::run_impl()
 	{
 		CS_DEBUGGER_STEP(this);
-		context->instance->storage.add_struct(this->mName, this->mBuilder);
+		struct_builder builder(this->mBuilder);
+		builder.hold_unit(compile_unit::hold(mUnit));
+		context->instance->storage.add_struct(this->mName, builder);
 	}
 
 	void statement_struct::dump(std::ostream &o) const
@@ -664,12 +938,14 @@ namespace cs {
 	void statement_function::run_impl()
 	{
 		CS_DEBUGGER_STEP(this);
+		function func_body(this->mFunc);
+		func_body.hold_unit(compile_unit::hold(mUnit));
 		if (this->mIsMemFn)
 			context->instance->storage.add_var(this->mName,
-			                                   var::make_protect<callable>(this->mFunc, callable::types::member_fn),
+			                                   var::make_protect<callable>(std::move(func_body), callable::types::member_fn),
 			                                   mOverride);
 		else {
-			var func = var::make_protect<callable>(this->mFunc);
+			var func = var::make_protect<callable>(std::move(func_body));
 #ifdef CS_DEBUGGER
 			if(context->instance->storage.is_initial())
 				cs_debugger_func_breakpoint(this->mName, func);
@@ -678,6 +954,16 @@ namespace cs {
 		}
 	}
 
+	void statement_function::load_block()
+	{
+		std::deque<statement_base *> block;
+		compile_unit::scope scope(mUnit);
+		context->compiler->code_gen_deferred(context, mArgs, mLazyBlock, block);
+		mBlock = std::move(block);
+		mLazyBlock.clear();
+		mIsLazy = false;
+	}
+
 	void statement_function::dump(std::ostream &o) const
 	{
 		o << "< BeginFunction: ID = \"" << mName << "\"";
@@ -689,6 +975,8 @@ namespace cs {
 		for (auto &name:mArgs)
 			o << "< ID = \"" << name << "\" >";
 		o << "} >\n< Body >\n";
+		if (mIsLazy)
+			o << "< Deferred >\n";
 		for (auto &ptr:mBlock)
 			ptr->dump(o);
 		o << "< EndFunction >\n";
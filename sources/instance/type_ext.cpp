@@ -28,9 +28,13 @@
 #include <covscript_impl/mozart/timer.hpp>
 #include <covscript_impl/system.hpp>
 #include <covscript/impl/impl.hpp>
+#include <covscript/covscript.hpp>
 #include <algorithm>
 #include <iostream>
 #include <future>
+#include <chrono>
+#include <cmath>
+#include <thread>
 
 namespace cs_impl {
 	namespace member_visitor_cs_ext {
@@ -44,6 +48,165 @@ namespace cs_impl {
 		}
 	}
 
+	namespace sort_impl {
+		using namespace cs;
+
+		// Below these sizes the plain algorithms win over thread start-up and counting passes
+		constexpr std::size_t parallel_threshold = 1 << 16;
+		constexpr std::size_t radix_threshold = 1 << 8;
+
+		// Stable sort, chunks are sorted and merged by worker threads for large inputs
+		template<typename T, typename CompareT>
+		void stable_sort(std::vector<T> &data, CompareT cmp)
+		{
+			std::size_t threads = std::thread::hardware_concurrency();
+			if (data.size() < parallel_threshold || threads < 2) {
+				std::stable_sort(data.begin(), data.end(), cmp);
+				return;
+			}
+			std::size_t chunk = (data.size() + threads - 1) / threads;
+			std::vector<std::size_t> bounds;
+			for (std::size_t posit = 0; posit < data.size(); posit += chunk)
+				bounds.push_back(posit);
+			bounds.push_back(data.size());
+			std::vector<std::thread> workers;
+			for (std::size_t i = 0; i + 1 < bounds.size(); ++i)
+				workers.emplace_back([&data, &cmp](std::size_t b, std::size_t e) {
+					std::stable_sort(data.begin() + b, data.begin() + e, cmp);
+				}, bounds[i], bounds[i + 1]);
+			for (auto &it:workers)
+				it.join();
+			while (bounds.size() > 2) {
+				std::vector<std::size_t> merged;
+				workers.clear();
+				std::size_t i = 0;
+				for (; i + 2 < bounds.size(); i += 2) {
+					merged.push_back(bounds[i]);
+					workers.emplace_back([&data, &cmp](std::size_t b, std::size_t m, std::size_t e) {
+						std::inplace_merge(data.begin() + b, data.begin() + m, data.begin() + e, cmp);
+					}, bounds[i], bounds[i + 1], bounds[i + 2]);
+				}
+				for (; i < bounds.size(); ++i)
+					merged.push_back(bounds[i]);
+				for (auto &it:workers)
+					it.join();
+				bounds.swap(merged);
+			}
+		}
+
+		// LSD radix sort on integral keys, byte positions shared by all keys are skipped
+		void radix_sort(std::vector<std::pair<std::uint64_t, std::size_t>> &data)
+		{
+			std::size_t histogram[8][256] = {{0}};
+			for (auto &it:data)
+				for (std::size_t b = 0; b < 8; ++b)
+					++histogram[b][(it.first >> (b * 8)) & 0xff];
+			std::vector<std::pair<std::uint64_t, std::size_t>> buff(data.size());
+			for (std::size_t b = 0; b < 8; ++b) {
+				std::size_t *count = histogram[b];
+				if (count[(data.front().first >> (b * 8)) & 0xff] == data.size())
+					continue;
+				for (std::size_t i = 0, sum = 0; i < 256; ++i) {
+					std::size_t n = count[i];
+					count[i] = sum;
+					sum += n;
+				}
+				for (auto &it:data)
+					buff[count[(it.first >> (b * 8)) & 0xff]++] = it;
+				data.swap(buff);
+			}
+		}
+
+		/*
+		* Compute the stable ascending order of keys without calling back into scripts.
+		* Keys must be all numbers(or chars) or all strings.
+		*/
+		std::vector<std::size_t> sort_order(const std::vector<var> &keys)
+		{
+			std::vector<std::size_t> order;
+			order.reserve(keys.size());
+			if (keys.empty())
+				return order;
+			if (keys.front().type() == typeid(string)) {
+				std::vector<std::pair<const string *, std::size_t>> entries;
+				entries.reserve(keys.size());
+				for (std::size_t i = 0; i < keys.size(); ++i) {
+					if (keys[i].type() != typeid(string))
+						throw lang_error("Default ordering requires keys of the same type, either number or string.");
+					entries.emplace_back(&keys[i].const_val<string>(), i);
+				}
+				using entry_t = std::pair<const string *, std::size_t>;
+				stable_sort(entries, [](const entry_t &lhs, const entry_t &rhs) {
+					return *lhs.first < *rhs.first;
+				});
+				for (auto &it:entries)
+					order.push_back(it.second);
+				return order;
+			}
+			std::vector<std::pair<number, std::size_t>> entries;
+			entries.reserve(keys.size());
+			bool integral = true;
+			for (std::size_t i = 0; i < keys.size(); ++i) {
+				number key;
+				if (keys[i].type() == typeid(number))
+					key = keys[i].const_val<number>();
+				else if (keys[i].type() == typeid(char))
+					key = keys[i].const_val<char>();
+				else
+					throw lang_error("Default ordering requires keys of the same type, either number or string.");
+				if (integral && !(key == std::floor(key) && key >= -9.2e18 && key <= 9.2e18))
+					integral = false;
+				entries.emplace_back(key, i);
+			}
+			if (integral && entries.size() >= radix_threshold) {
+				std::vector<std::pair<std::uint64_t, std::size_t>> radix;
+				radix.reserve(entries.size());
+				// Flip the sign bit so that unsigned order matches signed order
+				for (auto &it:entries)
+					radix.emplace_back(static_cast<std::uint64_t>(static_cast<std::int64_t>(it.first)) ^
+					                   (std::uint64_t(1) << 63), it.second);
+				radix_sort(radix);
+				for (auto &it:radix)
+					order.push_back(it.second);
+				return order;
+			}
+			// NaN is ordered after every other number to keep the ordering strict weak
+			using entry_t = std::pair<number, std::size_t>;
+			stable_sort(entries, [](const entry_t &lhs, const entry_t &rhs) {
+				return lhs.first < rhs.first || (std::isnan(rhs.first) && !std::isnan(lhs.first));
+			});
+			for (auto &it:entries)
+				order.push_back(it.second);
+			return order;
+		}
+
+		template<typename ContainerT>
+		void apply_order(ContainerT &container, const std::vector<var> &elements, const std::vector<std::size_t> &order)
+		{
+			ContainerT sorted;
+			for (auto idx:order)
+				sorted.push_back(elements[idx]);
+			container.swap(sorted);
+		}
+
+		template<typename ContainerT>
+		void sort_default(ContainerT &container)
+		{
+			std::vector<var> elements(container.begin(), container.end());
+			apply_order(container, elements, sort_order(elements));
+		}
+
+		template<typename ContainerT>
+		void sort_by(ContainerT &container, const var &func)
+		{
+			std::vector<var> elements(container.begin(), container.end()), keys;
+			keys.reserve(elements.size());
+			for (auto &it:elements)
+				keys.push_back(invoke(func, it));
+			apply_order(container, elements, sort_order(keys));
+		}
+	}
+
 	namespace array_cs_ext {
 		using namespace cs;
 
@@ -155,11 +318,26 @@ namespace cs_impl {
 		}
 
 // Operations
-		void sort(array &arr, const var &func)
+		var sort(vector &args)
 		{
-			std::sort(arr.begin(), arr.end(), [&](const var &lhs, const var &rhs) -> bool {
-				return invoke(func, lhs, rhs).const_val<boolean>();
-			});
+			if (args.size() != 1 && args.size() != 2)
+				throw cs::runtime_error(
+				    "Wrong size of the arguments. Expected 1 or 2, provided " + std::to_string(args.size()));
+			array &arr = args[0].val<array>();
+			if (args.size() == 1)
+				sort_impl::sort_default(arr);
+			else {
+				const var &func = args[1];
+				std::sort(arr.begin(), arr.end(), [&](const var &lhs, const var &rhs) -> bool {
+					return invoke(func, lhs, rhs).const_val<boolean>();
+				});
+			}
+			return null_pointer;
+		}
+
+		void sort_by(array &arr, const var &func)
+		{
+			sort_impl::sort_by(arr, func);
 		}
 
 		var to_hash_set(const array &arr)
@@ -209,7 +387,7 @@ namespace cs_impl {
 			.add_var("begin", make_cni(begin, callable::types::member_visitor))
 			.add_var("end", make_cni(end, callable::types::member_visitor))
 			.add_var("empty", make_cni(empty, true))
-			.add_var("size", make_cni(size, callable::types::member_visitor))
+			.add_var("size", make_cni(size, callable::types::member_visitor_fold))
 			.add_var("clear", make_cni(clear, true))
 			.add_var("insert", make_cni(insert, true))
 			.add_var("erase", make_cni(erase, true))
@@ -217,7 +395,8 @@ namespace cs_impl {
 			.add_var("pop_front", make_cni(pop_front, true))
 			.add_var("push_back", make_cni(push_back, true))
 			.add_var("pop_back", make_cni(pop_back, true))
-			.add_var("sort", make_cni(sort, true))
+			.add_var("sort", var::make_protect<callable>(sort, callable::types::request_fold))
+			.add_var("sort_by", make_cni(sort_by, true))
 			.add_var("to_hash_set", make_cni(to_hash_set, true))
 			.add_var("to_hash_map", make_cni(to_hash_map, true))
 			.add_var("to_list", make_cni(to_list, true));
@@ -405,7 +584,7 @@ namespace cs_impl {
 		{
 			(*hash_set_ext)
 			.add_var("empty", make_cni(empty, true))
-			.add_var("size", make_cni(size, callable::types::member_visitor))
+			.add_var("size", make_cni(size, callable::types::member_visitor_fold))
 			.add_var("clear", make_cni(empty, true))
 			.add_var("insert", make_cni(insert, true))
 			.add_var("erase", make_cni(erase, true))
@@ -463,7 +642,7 @@ namespace cs_impl {
 		{
 			(*hash_map_ext)
 			.add_var("empty", make_cni(empty, true))
-			.add_var("size", make_cni(size, callable::types::member_visitor))
+			.add_var("size", make_cni(size, callable::types::member_visitor_fold))
 			.add_var("clear", make_cni(clear, true))
 			.add_var("insert", make_cni(insert, true))
 			.add_var("erase", make_cni(erase, true))
@@ -805,11 +984,26 @@ namespace cs_impl {
 			lst.unique();
 		}
 
-		void sort(list &lst, const var &func)
+		var sort(vector &args)
 		{
-			lst.sort([&](const var &lhs, const var &rhs) -> bool {
-				return invoke(func, lhs, rhs).const_val<boolean>();
-			});
+			if (args.size() != 1 && args.size() != 2)
+				throw cs::runtime_error(
+				    "Wrong size of the arguments. Expected 1 or 2, provided " + std::to_string(args.size()));
+			list &lst = args[0].val<list>();
+			if (args.size() == 1)
+				sort_impl::sort_default(lst);
+			else {
+				const var &func = args[1];
+				lst.sort([&](const var &lhs, const var &rhs) -> bool {
+					return invoke(func, lhs, rhs).const_val<boolean>();
+				});
+			}
+			return null_pointer;
+		}
+
+		void sort_by(list &lst, const var &func)
+		{
+			sort_impl::sort_by(lst, func);
 		}
 
 		void init()
@@ -825,7 +1019,7 @@ namespace cs_impl {
 			.add_var("begin", make_cni(begin, callable::types::member_visitor))
 			.add_var("end", make_cni(end, callable::types::member_visitor))
 			.add_var("empty", make_cni(empty, true))
-			.add_var("size", make_cni(size, callable::types::member_visitor))
+			.add_var("size", make_cni(size, callable::types::member_visitor_fold))
 			.add_var("clear", make_cni(clear, true))
 			.add_var("insert", make_cni(insert, true))
 			.add_var("erase", make_cni(erase, true))
@@ -836,7 +1030,8 @@ namespace cs_impl {
 			.add_var("remove", make_cni(remove, true))
 			.add_var("reverse", make_cni(reverse, true))
 			.add_var("unique", make_cni(unique, true))
-			.add_var("sort", make_cni(sort, true));
+			.add_var("sort", var::make_protect<callable>(sort, callable::types::request_fold))
+			.add_var("sort_by", make_cni(sort_by, true));
 		}
 	}
 	namespace math_cs_ext {
@@ -1022,16 +1217,214 @@ namespace cs_impl {
 		void init()
 		{
 			(*time_ext)
-			.add_var("sec", make_cni(sec, callable::types::member_visitor))
-			.add_var("min", make_cni(tm_min, callable::types::member_visitor))
-			.add_var("hour", make_cni(hour, callable::types::member_visitor))
-			.add_var("wday", make_cni(wday, callable::types::member_visitor))
-			.add_var("mday", make_cni(mday, callable::types::member_visitor))
-			.add_var("yday", make_cni(yday, callable::types::member_visitor))
-			.add_var("mon", make_cni(mon, callable::types::member_visitor))
-			.add_var("year", make_cni(year, callable::types::member_visitor))
-			.add_var("is_dst", make_cni(is_dst, callable::types::member_visitor))
-			.add_var("unixtime", make_cni(unixtime, callable::types::member_visitor));
+			.add_var("sec", make_cni(sec, callable::types::member_visitor_fold))
+			.add_var("min", make_cni(tm_min, callable::types::member_visitor_fold))
+			.add_var("hour", make_cni(hour, callable::types::member_visitor_fold))
+			.add_var("wday", make_cni(wday, callable::types::member_visitor_fold))
+			.add_var("mday", make_cni(mday, callable::types::member_visitor_fold))
+			.add_var("yday", make_cni(yday, callable::types::member_visitor_fold))
+			.add_var("mon", make_cni(mon, callable::types::member_visitor_fold))
+			.add_var("year", make_cni(year, callable::types::member_visitor_fold))
+			.add_var("is_dst", make_cni(is_dst, callable::types::member_visitor_fold))
+			.add_var("unixtime", make_cni(unixtime, callable::types::member_visitor_fold));
+		}
+	}
+	namespace pipeline_cs_ext {
+		using namespace cs;
+		using stage_types = pipeline::stage_types;
+
+		var from(const var &source)
+		{
+			if (source.type() != typeid(array) && source.type() != typeid(list) && source.type() != typeid(hash_set) &&
+			        source.type() != typeid(hash_map) && source.type() != typeid(range_type) &&
+			        source.type() != typeid(string) && source.type() != typeid(istream))
+				throw lang_error("Unsupported source of pipeline: " + source.get_type_name());
+			return var::make<pipeline>(source);
+		}
+
+		var add_stage(const pipeline &p, stage_types type, const var &func, number count)
+		{
+			if (count < 0)
+				throw lang_error("Count of pipeline stage must not be negative.");
+			// Compared before the conversion, huge counts are clamped to the largest size
+			std::size_t size = count < (std::numeric_limits<std::size_t>::max)() ? static_cast<std::size_t>(count)
+			                   : (std::numeric_limits<std::size_t>::max)();
+			var result = var::make<pipeline>(p);
+			result.val<pipeline>().stages.push_back({type, func, size});
+			return result;
+		}
+
+		var map(const pipeline &p, const var &func)
+		{
+			return add_stage(p, stage_types::map, func, 0);
+		}
+
+		var filter(const pipeline &p, const var &func)
+		{
+			return add_stage(p, stage_types::filter, func, 0);
+		}
+
+		var take(const pipeline &p, number n)
+		{
+			return add_stage(p, stage_types::take, null_pointer, n);
+		}
+
+		var skip(const pipeline &p, number n)
+		{
+			return add_stage(p, stage_types::skip, null_pointer, n);
+		}
+
+		var take_while(const pipeline &p, const var &func)
+		{
+			return add_stage(p, stage_types::take_while, func, 0);
+		}
+
+		/*
+		* Pull elements from the source one by one and push them through all stages in a single pass.
+		* The sink returns false to stop the iteration early.
+		*/
+		template<typename SinkT>
+		void drive(const pipeline &p, SinkT &&sink)
+		{
+			// Nothing can pass an empty take, so the source is not touched at all
+			for (auto &s:p.stages)
+				if (s.type == stage_types::take && s.count == 0)
+					return;
+			std::vector<std::size_t> counters(p.stages.size(), 0);
+			bool exhausted = false;
+			auto push = [&](var val) -> bool {
+				for (std::size_t i = 0; i < p.stages.size(); ++i) {
+					const pipeline::stage &s = p.stages[i];
+					switch (s.type) {
+					case stage_types::map:
+						val = invoke(s.func, val);
+						break;
+					case stage_types::filter:
+						// Rejected elements still stop the pull once an earlier take is done
+						if (!invoke(s.func, val).const_val<boolean>())
+							return !exhausted;
+						break;
+					case stage_types::take:
+						if (counters[i] >= s.count)
+							return false;
+						// Stop pulling as soon as the last element passes, streams must not be over-read
+						if (++counters[i] == s.count)
+							exhausted = true;
+						break;
+					case stage_types::skip:
+						if (counters[i] < s.count) {
+							++counters[i];
+							return !exhausted;
+						}
+						break;
+					case stage_types::take_while:
+						if (!invoke(s.func, val).const_val<boolean>())
+							return false;
+						break;
+					}
+				}
+				return sink(val) && !exhausted;
+			};
+			const var &src = p.source;
+			if (src.type() == typeid(array)) {
+				for (auto &it:src.const_val<array>())
+					if (!push(it))
+						return;
+			}
+			else if (src.type() == typeid(list)) {
+				for (auto &it:src.const_val<list>())
+					if (!push(it))
+						return;
+			}
+			else if (src.type() == typeid(hash_set)) {
+				for (auto &it:src.const_val<hash_set>())
+					if (!push(it))
+						return;
+			}
+			else if (src.type() == typeid(hash_map)) {
+				for (auto &it:src.const_val<hash_map>())
+					if (!push(var::make<pair>(it.first, it.second)))
+						return;
+			}
+			else if (src.type() == typeid(range_type)) {
+				for (number it:src.const_val<range_type>())
+					if (!push(it))
+						return;
+			}
+			else if (src.type() == typeid(string)) {
+				for (char it:src.const_val<string>())
+					if (!push(it))
+						return;
+			}
+			else if (src.type() == typeid(istream)) {
+				const istream &in = src.const_val<istream>();
+				for (string line; std::getline(*in, line);)
+					if (!push(line))
+						return;
+			}
+		}
+
+		var reduce(const pipeline &p, const var &func, const var &init)
+		{
+			var result = init;
+			drive(p, [&](const var &val) {
+				result = invoke(func, result, val);
+				return true;
+			});
+			return result;
+		}
+
+		void for_each(const pipeline &p, const var &func)
+		{
+			drive(p, [&](const var &val) {
+				invoke(func, val);
+				return true;
+			});
+		}
+
+		number count(const pipeline &p)
+		{
+			std::size_t result = 0;
+			drive(p, [&](const var &) {
+				++result;
+				return true;
+			});
+			return result;
+		}
+
+		array to_array(const pipeline &p)
+		{
+			array result;
+			drive(p, [&](const var &val) {
+				result.push_back(val);
+				return true;
+			});
+			return std::move(result);
+		}
+
+		list to_list(const pipeline &p)
+		{
+			list result;
+			drive(p, [&](const var &val) {
+				result.push_back(val);
+				return true;
+			});
+			return std::move(result);
+		}
+
+		void init()
+		{
+			(*pipeline_ext)
+			.add_var("map", make_cni(map))
+			.add_var("filter", make_cni(filter))
+			.add_var("take", make_cni(take))
+			.add_var("skip", make_cni(skip))
+			.add_var("take_while", make_cni(take_while))
+			.add_var("reduce", make_cni(reduce))
+			.add_var("for_each", make_cni(for_each))
+			.add_var("count", make_cni(count))
+			.add_var("to_array", make_cni(to_array))
+			.add_var("to_list", make_cni(to_list));
 		}
 	}
 	namespace runtime_cs_ext {
@@ -1131,6 +1524,36 @@ namespace cs_impl {
 			return make_namespace(context->instance->source_import(path));
 		}
 
+		static var allocator_stats_map(const allocator_stats &stats)
+		{
+			hash_map map;
+			map[var::make<string>("alloc_count")] = var::make<number>(stats.alloc_count);
+			map[var::make<string>("pool_hits")] = var::make<number>(stats.pool_hits);
+			map[var::make<string>("hit_rate")] = var::make<number>(
+			        stats.alloc_count != 0 ? static_cast<number>(stats.pool_hits) / stats.alloc_count : 0);
+			map[var::make<string>("live")] = var::make<number>(stats.live);
+			map[var::make<string>("peak")] = var::make<number>(stats.peak);
+			return var::make<hash_map>(std::move(map));
+		}
+
+		var stats()
+		{
+			runtime_stats stats = get_runtime_stats();
+			hash_map types, ast, map;
+			for (auto &it:stats.types)
+				types[var::make<string>(cxx_demangle(it.name))] = allocator_stats_map(it);
+			ast[var::make<string>("token")] = var::make<number>(stats.token_nodes);
+			ast[var::make<string>("statement")] = var::make<number>(stats.statement_nodes);
+			ast[var::make<string>("method")] = var::make<number>(stats.method_nodes);
+			map[var::make<string>("values")] = allocator_stats_map(stats.values);
+			map[var::make<string>("types")] = var::make<hash_map>(std::move(types));
+			map[var::make<string>("domain_count")] = var::make<number>(stats.domain_count);
+			map[var::make<string>("copy_count")] = var::make<number>(stats.copy_count);
+			map[var::make<string>("ast_nodes")] = var::make<hash_map>(std::move(ast));
+			map[var::make<string>("resident_memory")] = var::make<number>(stats.resident_memory);
+			return var::make<hash_map>(std::move(map));
+		}
+
 		number argument_count(const var &func)
 		{
 			if (func.type() == typeid(object_method)) {
@@ -1222,6 +1645,290 @@ namespace cs_impl {
 			_a = copy(_a);
 		}
 
+		// Results of parallel_for cross process boundaries, so only plain data is allowed
+		void pack_value(const var &val, std::string &buff)
+		{
+			auto pack_size = [&buff](std::size_t size) {
+				buff.append(reinterpret_cast<const char *>(&size), sizeof(size));
+			};
+			if (val.type() == typeid(pointer) && val.const_val<pointer>() == null_pointer)
+				buff.push_back('p');
+			else if (val.type() == typeid(boolean))
+				buff.push_back(val.const_val<boolean>() ? 'T' : 'F');
+			else if (val.type() == typeid(number)) {
+				buff.push_back('n');
+				buff.append(reinterpret_cast<const char *>(&val.const_val<number>()), sizeof(number));
+			}
+			else if (val.type() == typeid(char)) {
+				buff.push_back('c');
+				buff.push_back(val.const_val<char>());
+			}
+			else if (val.type() == typeid(string)) {
+				const string &str = val.const_val<string>();
+				buff.push_back('s');
+				pack_size(str.size());
+				buff.append(str);
+			}
+			else if (val.type() == typeid(pair)) {
+				buff.push_back('P');
+				pack_value(val.const_val<pair>().first, buff);
+				pack_value(val.const_val<pair>().second, buff);
+			}
+			else if (val.type() == typeid(array)) {
+				buff.push_back('a');
+				pack_size(val.const_val<array>().size());
+				for (auto &it:val.const_val<array>())
+					pack_value(it, buff);
+			}
+			else if (val.type() == typeid(list)) {
+				buff.push_back('l');
+				pack_size(val.const_val<list>().size());
+				for (auto &it:val.const_val<list>())
+					pack_value(it, buff);
+			}
+			else if (val.type() == typeid(hash_set)) {
+				buff.push_back('S');
+				pack_size(val.const_val<hash_set>().size());
+				for (auto &it:val.const_val<hash_set>())
+					pack_value(it, buff);
+			}
+			else if (val.type() == typeid(hash_map)) {
+				buff.push_back('M');
+				pack_size(val.const_val<hash_map>().size());
+				for (auto &it:val.const_val<hash_map>()) {
+					pack_value(it.first, buff);
+					pack_value(it.second, buff);
+				}
+			}
+			else
+				throw lang_error("Result of parallel_for can not be transferred: " + val.get_type_name());
+		}
+
+		var unpack_value(const std::string &buff, std::size_t &posit)
+		{
+			auto unpack_size = [&buff, &posit]() {
+				std::size_t size = 0;
+				buff.copy(reinterpret_cast<char *>(&size), sizeof(size), posit);
+				posit += sizeof(size);
+				return size;
+			};
+			switch (buff.at(posit++)) {
+			case 'p':
+				return null_pointer;
+			case 'T':
+				return true;
+			case 'F':
+				return false;
+			case 'n': {
+				number n = 0;
+				buff.copy(reinterpret_cast<char *>(&n), sizeof(number), posit);
+				posit += sizeof(number);
+				return n;
+			}
+			case 'c':
+				return buff.at(posit++);
+			case 's': {
+				std::size_t size = unpack_size();
+				string str = buff.substr(posit, size);
+				posit += size;
+				return var::make<string>(std::move(str));
+			}
+			case 'P': {
+				var first = unpack_value(buff, posit);
+				return var::make<pair>(first, unpack_value(buff, posit));
+			}
+			case 'a': {
+				var arr = var::make<array>();
+				for (std::size_t i = 0, size = unpack_size(); i < size; ++i)
+					arr.val<array>().push_back(unpack_value(buff, posit));
+				return arr;
+			}
+			case 'l': {
+				var lst = var::make<list>();
+				for (std::size_t i = 0, size = unpack_size(); i < size; ++i)
+					lst.val<list>().push_back(unpack_value(buff, posit));
+				return lst;
+			}
+			case 'S': {
+				var set = var::make<hash_set>();
+				for (std::size_t i = 0, size = unpack_size(); i < size; ++i)
+					set.val<hash_set>().insert(unpack_value(buff, posit));
+				return set;
+			}
+			case 'M': {
+				var map = var::make<hash_map>();
+				for (std::size_t i = 0, size = unpack_size(); i < size; ++i) {
+					var key = unpack_value(buff, posit);
+					map.val<hash_map>()[key] = unpack_value(buff, posit);
+				}
+				return map;
+			}
+			default:
+				throw internal_error("Corrupted parallel_for payload.");
+			}
+		}
+
+		var parallel_for(vector &args)
+		{
+			if (args.size() != 3 && args.size() != 4)
+				throw cs::runtime_error(
+				    "Wrong size of the arguments. Expected 3 or 4, provided " + std::to_string(args.size()));
+			const var &source = args[0], &func = args[1], &reducer = args[2];
+			// Random access is needed to partition the source, so ranges and lists are expanded first
+			var items;
+			if (source.type() == typeid(array))
+				items = source;
+			else if (source.type() == typeid(range_type)) {
+				items = var::make<array>();
+				for (number it:source.const_val<range_type>())
+					items.val<array>().push_back(it);
+			}
+			else if (source.type() == typeid(list)) {
+				const list &lst = source.const_val<list>();
+				items = var::make<array>(lst.begin(), lst.end());
+			}
+			else
+				throw lang_error("Unsupported source of parallel_for: " + source.get_type_name());
+			const array &arr = items.const_val<array>();
+			if (arr.empty())
+				return null_pointer;
+			std::size_t workers = std::thread::hardware_concurrency();
+			if (args.size() == 4) {
+				if (args[3].type() != typeid(number) || args[3].const_val<number>() < 1 ||
+				        args[3].const_val<number>() != std::floor(args[3].const_val<number>()))
+					throw lang_error("Worker count of parallel_for must be a positive integer.");
+				// Compared before the conversion, huge counts are clamped to the size of the source
+				workers = args[3].const_val<number>() < arr.size() ? static_cast<std::size_t>(args[3].const_val<number>())
+				          : arr.size();
+			}
+			workers = (std::min)((std::max)(workers, std::size_t(1)), arr.size());
+			std::size_t chunk = (arr.size() + workers - 1) / workers;
+			workers = (arr.size() + chunk - 1) / chunk;
+			auto run_chunk = [&](std::size_t idx) -> var {
+				std::size_t begin = idx * chunk, end = (std::min)(begin + chunk, arr.size());
+				var result = invoke(func, arr[begin]);
+				for (std::size_t i = begin + 1; i < end; ++i)
+					result = invoke(reducer, result, invoke(func, arr[i]));
+				return result;
+			};
+			auto run_worker = [&run_chunk](std::size_t idx) -> std::string {
+				std::string buff;
+				pack_value(run_chunk(idx), buff);
+				return buff;
+			};
+			// Every chunk runs in a worker process, even a single one, so writes to outer variables never leak.
+			// Without fork(Win32) the chunks run in this process and such writes are visible, but results
+			// still go through the same transfer, so values which can not cross a process fail everywhere.
+			std::vector<std::string> payloads;
+			if (!process::fork_join(workers, run_worker, payloads)) {
+				payloads.clear();
+				for (std::size_t i = 0; i < workers; ++i)
+					payloads.push_back(run_worker(i));
+			}
+			var result;
+			for (std::size_t i = 0; i < payloads.size(); ++i) {
+				std::size_t posit = 0;
+				var val = unpack_value(payloads[i], posit);
+				result = i == 0 ? val : invoke(reducer, result, val);
+			}
+			return result;
+		}
+
+		// Values are range checked here, before any conversion to an integer or a duration
+		static number bench_option(const hash_map &options, const char *name, number value, number limit,
+		                           bool integral = false)
+		{
+			auto it = options.find(var::make<string>(name));
+			if (it == options.end())
+				return value;
+			if (it->second.type() != typeid(number))
+				throw lang_error(std::string("Option \"") + name + "\" of bench must be a number.");
+			number val = it->second.const_val<number>();
+			if (integral && (val < 1 || val > limit || val != std::floor(val)))
+				throw lang_error(std::string("Option \"") + name + "\" of bench must be an integer between 1 and " +
+				                 std::to_string(static_cast<std::size_t>(limit)) + ".");
+			if (!integral && !(val > 0 && val <= limit))
+				throw lang_error(std::string("Option \"") + name + "\" of bench must be a positive number up to " +
+				                 std::to_string(static_cast<std::size_t>(limit)) + ".");
+			return val;
+		}
+
+		/*
+		 * bench(func[, options])
+		 * Options: warmup(ms, default 100, up to an hour), batch_time(ms, default 10, up to a minute),
+		 *          batches(integer, default 30, up to 1000000)
+		 * given as a hash map or as an array of pairs.
+		 * The iteration count of a batch is doubled until the batch lasts batch_time,
+		 * statistics are nanoseconds per iteration over the batches.
+		 */
+		var bench(vector &args)
+		{
+			if (args.size() != 1 && args.size() != 2)
+				throw cs::runtime_error(
+				    "Wrong size of the arguments. Expected 1 or 2, provided " + std::to_string(args.size()));
+			using clock_type = std::chrono::steady_clock;
+			const var &func = args[0];
+			hash_map options;
+			if (args.size() == 2) {
+				if (args[1].type() == typeid(hash_map))
+					options = args[1].const_val<hash_map>();
+				else if (args[1].type() == typeid(array)) {
+					// Literals such as {"warmup": 1} are arrays of pairs
+					for (auto &it:args[1].const_val<array>()) {
+						if (it.type() != typeid(pair))
+							throw lang_error("Options of bench must be a hash map or an array of pairs.");
+						const auto &p = it.const_val<pair>();
+						options[p.first] = p.second;
+					}
+				}
+				else
+					throw lang_error("Options of bench must be a hash map or an array of pairs.");
+			}
+			std::chrono::duration<double, std::milli> warmup(bench_option(options, "warmup", 100, 3600000));
+			std::chrono::duration<double, std::milli> batch_time(bench_option(options, "batch_time", 10, 60000));
+			std::size_t batches = static_cast<std::size_t>(bench_option(options, "batches", 30, 1000000, true));
+			auto run_batch = [&func](std::size_t size) -> clock_type::duration {
+				clock_type::time_point start = clock_type::now();
+				for (std::size_t i = 0; i < size; ++i)
+					invoke(func);
+				return clock_type::now() - start;
+			};
+			clock_type::time_point warmup_start = clock_type::now();
+			do
+				invoke(func);
+			while (clock_type::now() - warmup_start < warmup);
+			std::size_t size = 1;
+			while (run_batch(size) < batch_time && size < (std::size_t(1) << 30))
+				size *= 2;
+			std::vector<double> samples;
+			std::size_t allocs = allocator_total();
+			for (std::size_t i = 0; i < batches; ++i)
+				samples.push_back(std::chrono::duration<double, std::nano>(run_batch(size)).count() / size);
+			allocs = allocator_total() - allocs;
+			std::sort(samples.begin(), samples.end());
+			double mean = 0, variance = 0;
+			for (auto &it:samples)
+				mean += it / batches;
+			for (auto &it:samples)
+				variance += (it - mean) * (it - mean) / (batches > 1 ? batches - 1 : 1);
+			// Nearest rank percentiles
+			auto percentile = [&samples](double p) -> number {
+				std::size_t rank = std::ceil(p * samples.size());
+				return samples[(std::max)(rank, std::size_t(1)) - 1];
+			};
+			hash_map result;
+			result[var::make<string>("iterations")] = var::make<number>(size * batches);
+			result[var::make<string>("batch_size")] = var::make<number>(size);
+			result[var::make<string>("mean")] = var::make<number>(mean);
+			result[var::make<string>("median")] = var::make<number>(percentile(0.5));
+			result[var::make<string>("p99")] = var::make<number>(percentile(0.99));
+			result[var::make<string>("stddev")] = var::make<number>(std::sqrt(variance));
+			result[var::make<string>("min")] = var::make<number>(samples.front());
+			result[var::make<string>("max")] = var::make<number>(samples.back());
+			result[var::make<string>("allocs")] = var::make<number>(static_cast<number>(allocs) / (size * batches));
+			return var::make<hash_map>(std::move(result));
+		}
+
 		void init()
 		{
 			(*runtime_ext)
@@ -1241,10 +1948,14 @@ namespace cs_impl {
 			.add_var("import", make_cni(import, true))
 			.add_var("source_import", make_cni(source_import, true))
 			.add_var("argument_count", make_cni(argument_count, true))
+			.add_var("stats", make_cni(stats))
+			.add_var("bench", var::make_protect<callable>(bench))
 			.add_var("add_literal", make_cni(add_string_literal, true))
 			.add_var("get_current_dir", make_cni(file_system::get_current_dir))
 			.add_var("wait_for", make_cni(wait_for))
-			.add_var("wait_until", make_cni(wait_until));
+			.add_var("wait_until", make_cni(wait_until))
+			.add_var("parallel_for", var::make_protect<callable>(parallel_for))
+			.add_var("from", make_cni(pipeline_cs_ext::from));
 			(*context_ext)
 			.add_var("build", make_cni(build))
 			.add_var("solve", make_cni(solve))
@@ -1400,7 +2111,7 @@ namespace cs_impl {
 			.add_var("cut", make_cni(cut, true))
 			.add_var("empty", make_cni(empty, true))
 			.add_var("clear", make_cni(clear, true))
-			.add_var("size", make_cni(size, callable::types::member_visitor))
+			.add_var("size", make_cni(size, callable::types::member_visitor_fold))
 			.add_var("tolower", make_cni(tolower, true))
 			.add_var("toupper", make_cni(toupper, true))
 			.add_var("to_number", make_cni(to_number, true))
@@ -1594,6 +2305,7 @@ namespace cs_impl {
 			ostream_cs_ext::init();
 			system_cs_ext::init();
 			time_cs_ext::init();
+			pipeline_cs_ext::init();
 			runtime_cs_ext::init();
 			math_cs_ext::init();
 			except_cs_ext::init();
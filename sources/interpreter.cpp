@@ -23,9 +23,14 @@
 * Github:  https://github.com/mikecovlee
 * Website: http://covscript.org.cn
 */
+#include <covscript_impl/dirent/dirent.hpp>
 #include <covscript_impl/system.hpp>
 #include <covscript/covscript.hpp>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <ctime>
 
 #ifdef COVSCRIPT_PLATFORM_WIN32
 
@@ -76,11 +81,21 @@ void activate_sigint_handler()
 #endif
 
 std::string log_path;
+std::string profile_path;
+std::string instrument_path;
+std::string trace_path;
+std::string coverage_path;
+std::string baseline_path;
+std::size_t bench_runs = 5;
+bool bench = false;
 bool repl = false;
 bool silent = false;
 bool dump_ast = false;
+std::string aot_path;
 bool no_optimize = false;
+bool lazy_compile = false;
 bool compile_only = false;
+bool time_phases = false;
 bool show_help_info = false;
 bool dump_dependency = false;
 bool wait_before_exit = false;
@@ -89,14 +104,56 @@ bool show_version_info = false;
 int covscript_args(int args_size, char *args[])
 {
 	int expect_log_path = 0;
+	int expect_profile_path = 0;
+	int expect_instrument_path = 0;
+	int expect_trace_path = 0;
+	int expect_coverage_path = 0;
+	int expect_baseline_path = 0;
+	int expect_bench_runs = 0;
 	int expect_import_path = 0;
 	int expect_stack_resize = 0;
+	int expect_module_cache = 0;
+	int expect_aot_path = 0;
 	int index = 1;
 	for (; index < args_size; ++index) {
-		if (expect_log_path == 1) {
+		if (expect_module_cache == 1) {
+			cs::current_process->module_cache_path = cs::process_path(args[index]);
+			expect_module_cache = 2;
+		}
+		else if (expect_aot_path == 1) {
+			aot_path = cs::process_path(args[index]);
+			expect_aot_path = 2;
+		}
+		else if (expect_log_path == 1) {
 			log_path = cs::process_path(args[index]);
 			expect_log_path = 2;
 		}
+		else if (expect_profile_path == 1) {
+			profile_path = cs::process_path(args[index]);
+			expect_profile_path = 2;
+		}
+		else if (expect_instrument_path == 1) {
+			instrument_path = cs::process_path(args[index]);
+			expect_instrument_path = 2;
+		}
+		else if (expect_trace_path == 1) {
+			trace_path = cs::process_path(args[index]);
+			expect_trace_path = 2;
+		}
+		else if (expect_coverage_path == 1) {
+			coverage_path = cs::process_path(args[index]);
+			expect_coverage_path = 2;
+		}
+		else if (expect_baseline_path == 1) {
+			baseline_path = cs::process_path(args[index]);
+			expect_baseline_path = 2;
+		}
+		else if (expect_bench_runs == 1) {
+			bench_runs = std::stoul(args[index]);
+			if (bench_runs < 2)
+				throw cs::fatal_error("benchmark needs at least 2 runs.");
+			expect_bench_runs = 2;
+		}
 		else if (expect_import_path == 1) {
 			cs::current_process->import_path += cs::path_delimiter + cs::process_path(args[index]);
 			expect_import_path = 2;
@@ -114,12 +171,18 @@ int covscript_args(int args_size, char *args[])
 				silent = true;
 			else if ((std::strcmp(args[index], "--dump-ast") == 0 || std::strcmp(args[index], "-d") == 0) && !dump_ast)
 				dump_ast = true;
+			else if ((std::strcmp(args[index], "--aot") == 0 || std::strcmp(args[index], "-A") == 0) &&
+			         expect_aot_path == 0)
+				expect_aot_path = 1;
 			else if ((std::strcmp(args[index], "--dependency") == 0 || std::strcmp(args[index], "-r") == 0) &&
 			         !dump_dependency)
 				dump_dependency = true;
 			else if ((std::strcmp(args[index], "--no-optimize") == 0 || std::strcmp(args[index], "-o") == 0) &&
 			         !no_optimize)
 				no_optimize = true;
+			else if ((std::strcmp(args[index], "--lazy-compile") == 0 || std::strcmp(args[index], "-L") == 0) &&
+			         !lazy_compile)
+				lazy_compile = true;
 			else if ((std::strcmp(args[index], "--compile-only") == 0 || std::strcmp(args[index], "-c") == 0) &&
 			         !compile_only)
 				compile_only = true;
@@ -135,27 +198,329 @@ int covscript_args(int args_size, char *args[])
 			else if ((std::strcmp(args[index], "--log-path") == 0 || std::strcmp(args[index], "-l") == 0) &&
 			         expect_log_path == 0)
 				expect_log_path = 1;
+			else if ((std::strcmp(args[index], "--profile") == 0 || std::strcmp(args[index], "-p") == 0) &&
+			         expect_profile_path == 0)
+				expect_profile_path = 1;
+			else if (std::strncmp(args[index], "--profile=", 10) == 0 && expect_profile_path == 0) {
+				profile_path = cs::process_path(args[index] + 10);
+				expect_profile_path = 2;
+			}
+			else if ((std::strcmp(args[index], "--instrument") == 0 || std::strcmp(args[index], "-I") == 0) &&
+			         expect_instrument_path == 0)
+				expect_instrument_path = 1;
+			else if ((std::strcmp(args[index], "--trace") == 0 || std::strcmp(args[index], "-t") == 0) &&
+			         expect_trace_path == 0)
+				expect_trace_path = 1;
+			else if (std::strncmp(args[index], "--trace=", 8) == 0 && expect_trace_path == 0) {
+				trace_path = cs::process_path(args[index] + 8);
+				expect_trace_path = 2;
+			}
+			else if ((std::strcmp(args[index], "--coverage") == 0 || std::strcmp(args[index], "-C") == 0) &&
+			         expect_coverage_path == 0)
+				expect_coverage_path = 1;
+			else if (std::strncmp(args[index], "--coverage=", 11) == 0 && expect_coverage_path == 0) {
+				coverage_path = cs::process_path(args[index] + 11);
+				expect_coverage_path = 2;
+			}
+			else if ((std::strcmp(args[index], "--time-phases") == 0 || std::strcmp(args[index], "-T") == 0) &&
+			         !time_phases)
+				time_phases = true;
+			else if ((std::strcmp(args[index], "--bench") == 0 || std::strcmp(args[index], "-b") == 0) && !bench)
+				bench = true;
+			else if (std::strcmp(args[index], "--bench-runs") == 0 && expect_bench_runs == 0)
+				expect_bench_runs = 1;
+			else if (std::strcmp(args[index], "--baseline") == 0 && expect_baseline_path == 0)
+				expect_baseline_path = 1;
 			else if ((std::strcmp(args[index], "--import-path") == 0 || std::strcmp(args[index], "-i") == 0) &&
 			         expect_import_path == 0)
 				expect_import_path = 1;
 			else if ((std::strcmp(args[index], "--stack-resize") == 0 || std::strcmp(args[index], "-S") == 0) &&
 			         expect_stack_resize == 0)
 				expect_stack_resize = 1;
+			else if ((std::strcmp(args[index], "--module-cache") == 0 || std::strcmp(args[index], "-m") == 0) &&
+			         expect_module_cache == 0)
+				expect_module_cache = 1;
 			else
 				throw cs::fatal_error("argument syntax error.");
 		}
 		else
 			break;
 	}
-	if (expect_log_path == 1 || expect_import_path == 1 || expect_import_path == 1)
+	if (expect_log_path == 1 || expect_profile_path == 1 || expect_instrument_path == 1 || expect_trace_path == 1 ||
+	        expect_coverage_path == 1 || expect_baseline_path == 1 || expect_bench_runs == 1 || expect_import_path == 1 || expect_module_cache == 1 || expect_aot_path == 1)
 		throw cs::fatal_error("argument syntax error.");
+	if (!profile_path.empty() + !instrument_path.empty() + !trace_path.empty() + !coverage_path.empty() + time_phases > 1)
+		throw cs::fatal_error(
+		    "can not use more than one of profile, instrument, trace, coverage and time-phases at the same time.");
 	return index;
 }
 
+// Script Benchmark
+struct bench_record {
+	// Path relative to the benchmark directory, or the file name of a single script
+	std::string script;
+	std::string path;
+	std::size_t runs = 0;
+	double wall_mean = 0, wall_stddev = 0, cpu_mean = 0;
+	std::size_t peak_rss = 0, allocations = 0;
+};
+
+void bench_collect(const std::string &path, std::vector<bench_record> &scripts)
+{
+	bench_record record;
+	if (!cs_impl::file_system::is_dir(path)) {
+		record.path = path;
+		record.script = path.substr(path.find_last_of(cs::path_separator) + 1);
+		scripts.push_back(record);
+		return;
+	}
+	DIR *dir = ::opendir(path.c_str());
+	if (dir == nullptr)
+		throw cs::fatal_error("can not open benchmark directory " + path + ".");
+	std::vector<std::string> found;
+	for (dirent *dp = ::readdir(dir); dp != nullptr; dp = ::readdir(dir)) {
+		std::string name = dp->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csc") == 0)
+			found.push_back(name);
+	}
+	::closedir(dir);
+	std::sort(found.begin(), found.end());
+	for (auto &name:found) {
+		record.path = path + cs::path_separator + name;
+		record.script = name;
+		scripts.push_back(record);
+	}
+}
+
+// Wall time, CPU time, allocations and peak resident size of one run, script output is discarded
+void bench_run(const std::string &path, double &wall, double &cpu, std::size_t &allocations, std::size_t &peak_rss)
+{
+	std::string import_path = cs::current_process->import_path;
+	cs::prepend_import_path(path, cs::current_process);
+	cs::context_t context = cs::create_context({cs::var::make_constant<cs::string>(path)});
+	context->compiler->disable_optimizer = no_optimize;
+	std::atomic<bool> running(true);
+	std::atomic<std::size_t> peak(cs_impl::process::resident_memory());
+	std::thread monitor([&running, &peak] {
+		while (running) {
+			std::size_t rss = cs_impl::process::resident_memory();
+			if (rss > peak)
+				peak = rss;
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+	});
+	std::ostringstream discard;
+	std::streambuf *cout_buff = std::cout.rdbuf(discard.rdbuf());
+	std::size_t allocs = cs::allocator_total();
+	std::clock_t cpu_start = std::clock();
+	auto wall_start = std::chrono::steady_clock::now();
+	std::string error;
+	try {
+		context->instance->compile(path);
+		context->instance->interpret();
+	}
+	catch (const std::exception &e) {
+		if (std::strstr(e.what(), "CS_EXIT") == nullptr)
+			error = e.what();
+	}
+	wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+	cpu = 1000.0 * (std::clock() - cpu_start) / CLOCKS_PER_SEC;
+	allocations = cs::allocator_total() - allocs;
+	std::cout.rdbuf(cout_buff);
+	running = false;
+	monitor.join();
+	peak_rss = std::max<std::size_t>(peak, cs_impl::process::resident_memory());
+	cs::collect_garbage(context);
+	cs::current_process->import_path = import_path;
+	if (!error.empty())
+		throw cs::fatal_error(path + ": " + error);
+}
+
+// Tab separated results, lines starting with # are comments
+void bench_write(std::ostream &out, const std::vector<bench_record> &records)
+{
+	out << "# script\truns\twall_mean_ms\twall_stddev_ms\tcpu_mean_ms\tpeak_rss\tpool_allocations\n";
+	out << std::fixed << std::setprecision(3);
+	for (auto &it:records)
+		out << it.script << '\t' << it.runs << '\t' << it.wall_mean << '\t' << it.wall_stddev << '\t' << it.cpu_mean
+		    << '\t' << it.peak_rss << '\t' << it.allocations << '\n';
+}
+
+std::vector<bench_record> bench_read(const std::string &path)
+{
+	std::ifstream in(path);
+	if (!in)
+		throw cs::fatal_error("can not read benchmark baseline " + path + ".");
+	std::vector<bench_record> records;
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		std::istringstream ss(line);
+		bench_record record;
+		std::getline(ss, record.script, '\t');
+		ss >> record.runs >> record.wall_mean >> record.wall_stddev >> record.cpu_mean >> record.peak_rss
+		   >> record.allocations;
+		if (!ss)
+			throw cs::fatal_error("broken benchmark baseline " + path + ".");
+		records.push_back(record);
+	}
+	return records;
+}
+
+// One-sided Welch's t-test at 95% confidence
+bool bench_slower(const bench_record &current, const bench_record &base)
+{
+	static const double t_table[] = {6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812,
+	                                 1.796, 1.782, 1.771, 1.761, 1.753, 1.746, 1.740, 1.734, 1.729, 1.725,
+	                                 1.721, 1.717, 1.714, 1.711, 1.708, 1.706, 1.703, 1.701, 1.699, 1.697
+	                                };
+	double va = current.wall_stddev * current.wall_stddev / current.runs;
+	double vb = base.wall_stddev * base.wall_stddev / base.runs;
+	double diff = current.wall_mean - base.wall_mean;
+	if (diff <= 0)
+		return false;
+	if (va + vb == 0)
+		return true;
+	double t = diff / std::sqrt(va + vb);
+	double df = (va + vb) * (va + vb) /
+	            (va * va / std::max<double>(current.runs - 1, 1) + vb * vb / std::max<double>(base.runs - 1, 1));
+	std::size_t row = std::max<std::size_t>(1, static_cast<std::size_t>(df));
+	return t > (row <= 30 ? t_table[row - 1] : 1.645);
+}
+
+// All runs of a script, the first one warms up the allocators and caches and is not measured
+std::string bench_measure(bench_record &record)
+{
+	std::vector<double> walls;
+	double wall, cpu, cpu_total = 0;
+	std::size_t allocations, peak_rss;
+	bench_run(record.path, wall, cpu, allocations, peak_rss);
+	for (std::size_t i = 0; i < bench_runs; ++i) {
+		bench_run(record.path, wall, cpu, allocations, peak_rss);
+		walls.push_back(wall);
+		cpu_total += cpu;
+		record.peak_rss = std::max(record.peak_rss, peak_rss);
+		record.allocations = std::max(record.allocations, allocations);
+	}
+	for (auto &it:walls)
+		record.wall_mean += it / walls.size();
+	for (auto &it:walls)
+		record.wall_stddev += (it - record.wall_mean) * (it - record.wall_mean) / (walls.size() - 1);
+	record.wall_stddev = std::sqrt(record.wall_stddev);
+	record.cpu_mean = cpu_total / bench_runs;
+	std::ostringstream out;
+	out << std::setprecision(17) << record.wall_mean << ' ' << record.wall_stddev << ' ' << record.cpu_mean << ' '
+	    << record.peak_rss << ' ' << record.allocations;
+	return out.str();
+}
+
+void covscript_bench(int args_size, char *args[])
+{
+	std::vector<bench_record> records;
+	for (int i = 0; i < args_size; ++i)
+		bench_collect(cs::process_path(args[i]), records);
+	if (records.empty())
+		throw cs::fatal_error("no benchmark script.");
+	cs::current_process->on_process_exit.add_listener([](void *) -> bool {
+		throw cs::fatal_error("CS_EXIT");
+	});
+	std::cout << std::fixed << std::setprecision(3);
+	for (auto &record:records) {
+		record.runs = bench_runs;
+		// Each script runs in its own process, so the peak resident size belongs to that script alone
+		std::vector<std::string> results;
+		if (cs_impl::process::fork_join(1, [&record](std::size_t) {
+		return bench_measure(record);
+		}, results)) {
+			std::istringstream in(results.front());
+			in >> record.wall_mean >> record.wall_stddev >> record.cpu_mean >> record.peak_rss >> record.allocations;
+		}
+		else {
+			// Without fork the resident size covers every script measured so far and is not reported
+			bench_measure(record);
+			record.peak_rss = 0;
+		}
+		std::cout << record.script << ": " << record.wall_mean << " ms +- " << record.wall_stddev << ", cpu "
+		          << record.cpu_mean << " ms, ";
+		if (record.peak_rss > 0)
+			std::cout << "peak rss " << record.peak_rss / 1024 << " KiB, ";
+		std::cout << record.allocations << " pool allocations" << std::endl;
+	}
+	if (!log_path.empty()) {
+		std::ofstream out(::log_path);
+		bench_write(out, records);
+	}
+	if (baseline_path.empty())
+		return;
+	std::size_t regressions = 0;
+	for (auto &base:bench_read(baseline_path)) {
+		bool found = false;
+		for (auto &it:records) {
+			if (it.script != base.script)
+				continue;
+			found = true;
+			double ratio = base.wall_mean > 0 ? it.wall_mean / base.wall_mean : 1;
+			// Differences under 5% are noise even when significant
+			if (ratio > 1.05 && bench_slower(it, base)) {
+				std::cout << "REGRESSION " << it.script << ": " << base.wall_mean << " ms -> " << it.wall_mean
+				          << " ms (+" << (ratio - 1) * 100 << "%)" << std::endl;
+				++regressions;
+			}
+			if (base.allocations > 0 && it.allocations > base.allocations * 1.05) {
+				std::cout << "REGRESSION " << it.script << ": " << base.allocations << " -> " << it.allocations
+				          << " pool allocations" << std::endl;
+				++regressions;
+			}
+		}
+		// A script of the baseline which was not measured can hide any regression
+		if (!found) {
+			std::cout << "MISSING " << base.script << ": not benchmarked" << std::endl;
+			++regressions;
+		}
+	}
+	if (regressions > 0)
+		cs::current_process->exit_code = 1;
+	else
+		std::cout << "No regression against " << baseline_path << std::endl;
+}
+
+std::unique_ptr<cs::profiler> profiler;
+
+// Profilers report before the statements they refer to are collected, the tracer after the collection
+void finish_profiler(cs::context_t &context)
+{
+	if (profiler && trace_path.empty()) {
+		profiler->stop();
+		if (!profile_path.empty())
+			profiler->report(profile_path);
+		else if (!instrument_path.empty())
+			profiler->report(instrument_path);
+		else if (!coverage_path.empty())
+			profiler->report(coverage_path);
+		else
+			profiler->report(std::string());
+	}
+	cs::collect_garbage(context);
+	if (profiler && !trace_path.empty()) {
+		profiler->stop();
+		profiler->report(trace_path);
+	}
+	profiler.reset();
+}
+
 void covscript_main(int args_size, char *args[])
 {
 	int index = covscript_args(args_size, args);
 	cs::current_process->import_path += cs::path_delimiter + cs::get_import_path();
+	if (cs::current_process->module_cache_path.empty()) {
+		const char *module_cache_path = std::getenv("CS_MODULE_CACHE");
+		if (module_cache_path != nullptr)
+			cs::current_process->module_cache_path = cs::process_path(module_cache_path);
+	}
+	if (!cs::current_process->module_cache_path.empty() &&
+	        !cs_impl::file_system::mkdir_p(cs::current_process->module_cache_path))
+		throw cs::fatal_error("can not create module cache directory.");
 	if (show_help_info) {
 		std::cout << "Usage:\n";
 		std::cout << "    cs [options...] <FILE> [arguments...]\n";
@@ -166,6 +531,18 @@ void covscript_main(int args_size, char *args[])
 		std::cout << "  --compile-only         -c          Only compile\n";
 		std::cout << "  --dump-ast             -d          Export abstract syntax tree\n";
 		std::cout << "  --dependency           -r          Export module dependency\n";
+		std::cout << "  --aot          <DIR>   -A <DIR>    Translate package into extension source and wrapper package\n";
+		std::cout << "  --module-cache <PATH>  -m <PATH>   Cache lexed modules in the directory\n";
+		std::cout << "  --lazy-compile         -L          Compile function bodies on first call\n";
+		std::cout << "  --profile      <PATH>  -p <PATH>   Sample call stacks into <PATH> and <PATH>.lines\n";
+		std::cout << "  --instrument   <PATH>  -I <PATH>   Count calls and time into <PATH> and <PATH>.txt\n";
+		std::cout << "  --trace        <PATH>  -t <PATH>   Write a Chrome trace of compiling, imports and calls\n";
+		std::cout << "  --coverage     <PATH>  -C <PATH>   Write lcov coverage into <PATH> and hot lines into <PATH>.hot\n";
+		std::cout << "                                     Branches of the ?: operator are not recorded\n";
+		std::cout << "  --time-phases          -T          Print compile time of each phase and file to stderr\n";
+		std::cout << "  --bench <FILE|DIR...>  -b <...>    Benchmark scripts, results are written to the log path\n";
+		std::cout << "  --bench-runs   <N>                 Set the measured runs of each script, default 5\n";
+		std::cout << "  --baseline     <PATH>              Compare the benchmark against earlier results\n";
 		std::cout << std::endl;
 		std::cout << "Interpreter REPL Options:" << std::endl;
 		std::cout << "    Option                Mnemonic   Function\n";
@@ -200,6 +577,10 @@ void covscript_main(int args_size, char *args[])
 		std::cout << std::endl;
 		return;
 	}
+	if (bench) {
+		covscript_bench(args_size - index, args + index);
+		return;
+	}
 	if (!repl && index != args_size) {
 		std::string path = cs::process_path(args[index]);
 		if (!cs_impl::file_system::exist(path) || cs_impl::file_system::is_dir(path) ||
@@ -216,8 +597,26 @@ void covscript_main(int args_size, char *args[])
 			return true;
 		});
 		context->compiler->disable_optimizer = no_optimize;
+		// Every body is needed when only compiling or exporting
+		cs::current_process->lazy_compile =
+		    lazy_compile && !compile_only && !dump_ast && aot_path.empty() && coverage_path.empty();
+		// Tracing covers compilation and imports, coverage needs every compiled statement
+		if (!trace_path.empty())
+			profiler.reset(new cs::trace_profiler);
+		else if (!coverage_path.empty())
+			profiler.reset(new cs::coverage_profiler);
+		else if (time_phases)
+			profiler.reset(new cs::phase_profiler);
+		if (profiler)
+			profiler->start();
 		try {
 			context->instance->compile(path);
+			// Phases end with the compilation, the script runs without a profiler
+			if (time_phases) {
+				profiler->stop();
+				profiler->report(std::string());
+				profiler.reset();
+			}
 			if (dump_ast) {
 				if (!log_path.empty()) {
 					std::ofstream out(::log_path);
@@ -237,18 +636,32 @@ void covscript_main(int args_size, char *args[])
 						std::cout << it.first << std::endl;
 				}
 			}
-			if (!compile_only)
+			if (!aot_path.empty()) {
+				if (!cs_impl::file_system::mkdir_p(aot_path))
+					throw cs::fatal_error("can not create AOT output directory.");
+				context->instance->dump_aot(aot_path);
+			}
+			if (!compile_only && aot_path.empty()) {
+				if (!profile_path.empty())
+					profiler.reset(new cs::sampling_profiler);
+				else if (!instrument_path.empty())
+					profiler.reset(new cs::instrument_profiler);
+				if (profiler)
+					profiler->start();
 				context->instance->interpret();
+			}
 		}
 		catch (const std::exception &e) {
-			if (std::strstr(e.what(), "CS_EXIT") == nullptr)
+			if (std::strstr(e.what(), "CS_EXIT") == nullptr) {
+				finish_profiler(context);
 				throw;
+			}
 		}
 		catch (...) {
-			cs::collect_garbage(context);
+			finish_profiler(context);
 			throw;
 		}
-		cs::collect_garbage(context);
+		finish_profiler(context);
 	}
 	else {
 		if (!silent)
@@ -26,10 +26,16 @@
 
 #include <sys/select.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <termios.h>
 #include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#include <iostream>
 #include <sstream>
 #include <climits>
 #include <cstdio>
@@ -210,5 +216,167 @@ namespace cs_impl {
 			}
 			}
 		}
+
+		file_view::file_view(const std::string &path)
+		{
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				return;
+			struct stat s {};
+			if (::fstat(fd, &s) == 0 && S_ISREG(s.st_mode) && s.st_size > 0) {
+				void *addr = ::mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (addr != MAP_FAILED) {
+					m_data = static_cast<const char *>(addr);
+					m_size = s.st_size;
+					m_mapped = true;
+				}
+			}
+			if (!m_mapped) {
+				// Pipes and other special files can not be mapped
+				char buff[4096];
+				for (ssize_t n; (n = ::read(fd, buff, sizeof(buff))) != 0;) {
+					if (n < 0 && errno == EINTR)
+						continue;
+					if (n < 0) {
+						::close(fd);
+						return;
+					}
+					m_buff.append(buff, n);
+				}
+				m_data = m_buff.data();
+				m_size = m_buff.size();
+			}
+			::close(fd);
+			m_open = true;
+		}
+
+		file_view::~file_view()
+		{
+			if (m_mapped)
+				::munmap(const_cast<char *>(m_data), m_size);
+		}
+	}
+	namespace process {
+		bool fork_join(std::size_t count, const std::function<std::string(std::size_t)> &job,
+		               std::vector<std::string> &results)
+		{
+			std::vector<std::pair<pid_t, int>> workers;
+			std::cout.flush();
+			std::fflush(stdout);
+			for (std::size_t i = 0; i < count; ++i) {
+				int fd[2];
+				if (::pipe(fd) != 0)
+					throw cs::runtime_error("Create pipe for worker process failed.");
+				pid_t pid = ::fork();
+				if (pid < 0) {
+					::close(fd[0]);
+					::close(fd[1]);
+					for (auto &it:workers) {
+						::close(it.second);
+						::waitpid(it.first, nullptr, 0);
+					}
+					throw cs::runtime_error("Create worker process failed.");
+				}
+				else if (pid == 0) {
+					// Worker process: leading byte of the payload marks success(0), failure(1) or script exception(2)
+					::close(fd[0]);
+					for (auto &it:workers)
+						::close(it.second);
+					std::string payload(1, '\0');
+					try {
+						payload.append(job(i));
+					}
+					catch (const std::exception &e) {
+						payload.assign(1, '\1');
+						payload.append(e.what());
+					}
+					catch (const cs::lang_error &e) {
+						payload.assign(1, '\2');
+						payload.append(e.what());
+					}
+					catch (...) {
+						payload.assign(1, '\1');
+						payload.append("Uncaught exception in worker process.");
+					}
+					std::cout.flush();
+					std::fflush(stdout);
+					for (std::size_t posit = 0; posit < payload.size();) {
+						ssize_t n = ::write(fd[1], payload.data() + posit, payload.size() - posit);
+						if (n < 0 && errno == EINTR)
+							continue;
+						if (n <= 0)
+							::_exit(1);
+						posit += n;
+					}
+					::close(fd[1]);
+					::_exit(0);
+				}
+				::close(fd[1]);
+				workers.emplace_back(pid, fd[0]);
+			}
+			// Workers block on a full pipe until we reach them, so reading one by one can not deadlock
+			std::string error;
+			bool lang_error = false;
+			results.clear();
+			for (auto &it:workers) {
+				std::string payload;
+				char buff[4096];
+				while (true) {
+					ssize_t n = ::read(it.second, buff, sizeof(buff));
+					if (n < 0 && errno == EINTR)
+						continue;
+					if (n <= 0)
+						break;
+					payload.append(buff, n);
+				}
+				::close(it.second);
+				int status = 0;
+				while (::waitpid(it.first, &status, 0) < 0 && errno == EINTR);
+				if (!error.empty())
+					continue;
+				if (payload.empty() || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+					error = "Worker process terminated unexpectedly.";
+				else if (payload[0] != '\0') {
+					error = payload.substr(1);
+					lang_error = payload[0] == '\2';
+				}
+				else
+					results.emplace_back(payload.substr(1));
+			}
+			// Script exceptions stay catchable by the script
+			if (lang_error)
+				throw cs::lang_error(error);
+			if (!error.empty())
+				throw cs::runtime_error(error);
+			return true;
+		}
+
+		std::size_t id()
+		{
+			return ::getpid();
+		}
+
+		std::size_t resident_memory()
+		{
+#ifdef __APPLE__
+			mach_task_basic_info_data_t info;
+			mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+			if (::task_info(::mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) ==
+			        KERN_SUCCESS)
+				return info.resident_size;
+			return 0;
+#else
+			// Second field of statm is the resident page count
+			std::FILE *statm = std::fopen("/proc/self/statm", "r");
+			if (statm == nullptr)
+				return 0;
+			unsigned long size = 0, resident = 0;
+			int fields = std::fscanf(statm, "%lu %lu", &size, &resident);
+			std::fclose(statm);
+			if (fields != 2)
+				return 0;
+			return static_cast<std::size_t>(resident) * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+		}
 	}
-}
\ No newline at end of file
+}
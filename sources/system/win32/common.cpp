@@ -27,8 +27,10 @@
 #include <direct.h>
 #include <conio.h>
 #include <cstdlib>
+#include <fstream>
 #include <string>
 #include <io.h>
+#include <psapi.h>
 
 namespace cs_system_impl {
 	bool chmod_impl(const std::string &path, unsigned int mode)
@@ -168,5 +170,37 @@ namespace cs_impl {
 			}
 			}
 		}
+
+		file_view::file_view(const std::string &path)
+		{
+			std::ifstream in(path, std::ios::binary);
+			if (!in.is_open())
+				return;
+			m_buff.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			m_data = m_buff.data();
+			m_size = m_buff.size();
+			m_open = true;
+		}
+
+		file_view::~file_view() = default;
+	}
+	namespace process {
+		bool fork_join(std::size_t, const std::function<std::string(std::size_t)> &, std::vector<std::string> &)
+		{
+			return false;
+		}
+
+		std::size_t id()
+		{
+			return ::GetCurrentProcessId();
+		}
+
+		std::size_t resident_memory()
+		{
+			PROCESS_MEMORY_COUNTERS counters;
+			if (::K32GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters)))
+				return counters.WorkingSetSize;
+			return 0;
+		}
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,43 @@
+# Calls between translated functions keep the result type of the callee, parameters are typed by their uses
+var pkg = iostream.fstream("./aot_pkg.csp", iostream.openmode.out)
+pkg.println("package aot_pkg\nfunction is_pos(x)\n    return x > 0\nend\nfunction h(x)\n    return is_pos(x)\nend")
+pkg.println("function k(x)\n    return is_pos(x) + 1\nend")
+pkg.println("function fib(n)\n    return n < 2 ? n : fib(n - 1) + fib(n - 2)\nend")
+pkg.println("function cat(a, b)\n    return a + b\nend")
+pkg.println("function greet(name)\n    return \"Hello, \" + name\nend")
+pkg.println("function pair_sum(arr)\n    return arr[0] + arr[1]\nend")
+pkg.println("function count(obj)\n    return obj.size\nend")
+pkg = null
+system.run("cs --aot ./aot_out ./aot_pkg.csp")
+function read_lines(path)
+    var file = iostream.fstream(path, iostream.openmode.in)
+    var lines = new hash_set
+    while !file.eof()
+        lines.insert(file.getline())
+    end
+    return lines
+end
+var source = read_lines("./aot_out/aot_pkg_aot.cpp")
+var wrapper = read_lines("./aot_out/aot_pkg.csp")
+foreach file in {"./aot_pkg.csp", "./aot_out/aot_pkg_aot.cpp", "./aot_out/aot_pkg.csp"}
+    system.file.remove(file)
+end
+system.path.remove("./aot_out")
+var expects = {"\tcs::boolean cs_aot_is_pos(cs::number arg_x)", "\tcs::boolean cs_aot_h(cs::number arg_x)", "\tcs::number cs_aot_fib(cs::number arg_n)", "//   function k"}
+foreach it in {"\tcs::number cs_aot_cat(cs::number arg_a, cs::number arg_b)", "\tcs::string cs_aot_greet(const cs::var &arg_name)", "\tcs::number cs_aot_pair_sum(const cs::array &arg_arr)", "\tcs::number cs_aot_count(const cs::var &arg_obj)"}
+    expects.push_back(it)
+end
+# Other argument types run the script function
+expects.push_back("\t\t\t\tif (arg_a.type() == typeid(cs::number) && arg_b.type() == typeid(cs::number))")
+expects.push_back("\t\t\treturn cs::invoke(fallback, arg_a, arg_b);")
+foreach line in expects
+    if !source.exist(line)
+        throw runtime.exception("Missing from AOT source: " + line)
+    end
+end
+foreach line in {"package aot_pkg", "import aot_pkg_aot", "var cat = aot_pkg_aot.cat([](a, b) -> __aot_script_cat(a, b))", "function __aot_script_cat(a, b)", "function k(x)"}
+    if !wrapper.exist(line)
+        throw runtime.exception("Missing from AOT wrapper: " + line)
+    end
+end
+system.out.println("aot: ok")
@@ -0,0 +1,38 @@
+# Checks the statistics of runtime.bench and the validation of its options
+function check(value, expected, what)
+    if value != expected
+        throw runtime.exception("Wrong result of " + what + ": " + to_string(value))
+    end
+end
+function rejects(options, what)
+    var thrown = false
+    try
+        runtime.bench([]() -> 0, options)
+    catch e
+        thrown = true
+    end
+    check(thrown, true, what)
+end
+var count = 0
+var result = runtime.bench([]() -> ++count, {"warmup": 1, "batch_time": 1, "batches": 5})
+foreach key in {"iterations", "batch_size", "mean", "median", "p99", "stddev", "min", "max", "allocs"}
+    check(result.exist(key), true, "key " + key)
+    check(typeid result[key], typeid number, "type of " + key)
+end
+check(result.size, 9, "number of keys")
+check(result.iterations, result.batch_size * 5, "iterations")
+check(result.min <= result.median && result.median <= result.max, true, "order of percentiles")
+check(count > result.iterations, true, "warmup calls")
+var options = new hash_map
+options.insert("warmup", 1)
+options.insert("batch_time", 1)
+options.insert("batches", 2)
+check(runtime.bench([]() -> 0, options).iterations % 2, 0, "hash map options")
+rejects({"warmup": "1"}, "string option")
+rejects({"warmup": 0}, "zero warmup")
+rejects({"batch_time": 60001}, "batch time out of range")
+rejects({"batches": 1.5}, "fractional batches")
+rejects({"batches": 0}, "zero batches")
+rejects({1, 2}, "array without pairs")
+rejects("warmup", "string options")
+system.out.println("Bench test passed")
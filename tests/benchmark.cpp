@@ -0,0 +1,305 @@
+/*
+* Covariant Script Interpreter Microbenchmarks
+*
+* Usage: cs_bench [--output <FILE>] [--corpus <FILE>] [FILTER]
+* Every case is calibrated to batches of at least 10ms and measured over several batches,
+* ns/op is the median of the batches, pool_allocs/op counts allocations of every named buffer pool,
+* so a value which needs a proxy and a holder counts twice.
+* Results are written as JSON to stdout or the output file, progress goes to stderr.
+*/
+#include <covscript/impl/codegen.hpp>
+#include <covscript/covscript.hpp>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+
+using bench_clock = std::chrono::steady_clock;
+
+static const char *setup_code = R"(
+var a = 3, b = 4, c = 0, s = "hello", t = "world"
+var arr = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10}
+struct point
+	var x = 1
+	var y = 2
+	function length()
+		return x * x + y * y
+	end
+end
+var p = new point
+function add(x, y)
+	return x + y
+end
+function add_block(x, y)
+	var z = x + y
+	if z > 0
+		return z
+	end
+	return -z
+end
+var twice = [](x) -> x * 2
+namespace ns
+	var value = 1
+end
+)";
+
+class bench_suite final {
+	struct result_type final {
+		std::string name;
+		std::size_t iterations;
+		double ns_per_op;
+		double pool_allocs_per_op;
+	};
+
+	static constexpr std::size_t sample_count = 7;
+	std::string m_filter;
+	std::vector<result_type> m_results;
+
+	template<typename T>
+	static bench_clock::duration run_batch(T &op, std::size_t batch)
+	{
+		bench_clock::time_point start = bench_clock::now();
+		for (std::size_t i = 0; i < batch; ++i)
+			op();
+		return bench_clock::now() - start;
+	}
+
+public:
+	explicit bench_suite(std::string filter) : m_filter(std::move(filter)) {}
+
+	template<typename T>
+	void run(const std::string &name, T op)
+	{
+		if (!m_filter.empty() && name.find(m_filter) == std::string::npos)
+			return;
+		std::size_t batch = 1;
+		while (run_batch(op, batch) < std::chrono::milliseconds(10) && batch < (std::size_t(1) << 30))
+			batch *= 2;
+		std::vector<double> samples;
+		std::size_t allocs = cs::allocator_total();
+		for (std::size_t i = 0; i < sample_count; ++i)
+			samples.push_back(std::chrono::duration<double, std::nano>(run_batch(op, batch)).count() / batch);
+		allocs = cs::allocator_total() - allocs;
+		std::sort(samples.begin(), samples.end());
+		result_type result{name, batch * sample_count, samples[sample_count / 2],
+		                   static_cast<double>(allocs) / (batch * sample_count)};
+		std::cerr << name << ": " << result.ns_per_op << " ns/op, " << result.pool_allocs_per_op << " pool allocs/op" << std::endl;
+		m_results.push_back(result);
+	}
+
+	void dump_json(std::ostream &out) const
+	{
+		out << "{\n  \"version\": \"" << cs::current_process->version << "\",\n  \"benchmarks\": [";
+		for (std::size_t i = 0; i < m_results.size(); ++i) {
+			const result_type &result = m_results[i];
+			out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name << "\", \"iterations\": "
+			    << result.iterations << ", \"ns_per_op\": " << result.ns_per_op << ", \"pool_allocs_per_op\": "
+			    << result.pool_allocs_per_op << "}";
+		}
+		out << "\n  ]\n}" << std::endl;
+	}
+};
+
+static cs::tree_type<cs::token_base *> build_expr(const cs::context_t &context, const std::string &expr)
+{
+	cs::tree_type<cs::token_base *> tree;
+	std::deque<char> buff(expr.begin(), expr.end());
+	context->compiler->build_expr(buff, tree);
+	return tree;
+}
+
+static void compile(const cs::context_t &context, const std::string &code, std::deque<cs::statement_base *> &statements)
+{
+	std::deque<std::deque<cs::token_base *>> ast;
+	context->compiler->clear_metadata();
+	context->compiler->build_ast(code.data(), code.data() + code.size(), ast);
+	context->compiler->code_gen(ast, statements);
+	context->compiler->utilize_metadata();
+}
+
+static std::string read_file(const std::string &path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+		throw cs::fatal_error(path + ": No such file or directory");
+	std::stringstream ss;
+	ss << in.rdbuf();
+	return ss.str();
+}
+
+static void show_usage(std::ostream &out)
+{
+	out << "Usage: cs_bench [--output <FILE>] [--corpus <FILE>] [FILTER]\n"
+	    << "  --output <FILE>  -o <FILE>  Write the JSON results to FILE instead of stdout\n"
+	    << "  --corpus <FILE>             Lex and compile FILE instead of the synthetic corpus\n"
+	    << "  --help           -h         Show this help\n"
+	    << "Only cases whose name contains FILTER are run." << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string output, filter, corpus;
+	bool has_filter = false;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+			show_usage(std::cout);
+			return 0;
+		}
+		else if (std::strcmp(argv[i], "--output") == 0 || std::strcmp(argv[i], "-o") == 0 ||
+		         std::strcmp(argv[i], "--corpus") == 0) {
+			if (i + 1 >= argc) {
+				std::cerr << "cs_bench: " << argv[i] << " requires a file." << std::endl;
+				show_usage(std::cerr);
+				return -1;
+			}
+			if (std::strcmp(argv[i], "--corpus") == 0)
+				corpus = read_file(argv[++i]);
+			else
+				output = argv[++i];
+		}
+		// A filter never starts with a dash, and only one is accepted
+		else if (argv[i][0] == '-' || has_filter) {
+			std::cerr << "cs_bench: unexpected argument \"" << argv[i] << "\"." << std::endl;
+			show_usage(std::cerr);
+			return -1;
+		}
+		else {
+			filter = argv[i];
+			has_filter = true;
+		}
+	}
+	if (corpus.empty()) {
+		// Synthetic corpus, copies of the setup program in their own namespaces
+		for (int i = 0; i < 50; ++i)
+			corpus += "namespace bench_" + std::to_string(i) + "\n" + setup_code + "end\n";
+	}
+	bench_suite suite(filter);
+	cs::context_t context = cs::create_context({"<BENCHMARK>"});
+	context->file_path = "<BENCHMARK>";
+	std::deque<cs::statement_base *> statements;
+	compile(context, setup_code, statements);
+	for (auto &it:statements)
+		it->run();
+
+	// Expressions
+	const std::pair<const char *, const char *> expressions[] = {
+		{"expr.add", "a + b"}, {"expr.sub", "a - b"}, {"expr.mul", "a * b"}, {"expr.div", "a / b"},
+		{"expr.mod", "a % b"}, {"expr.pow", "a ^ b"}, {"expr.minus", "-a"}, {"expr.lt", "a < b"},
+		{"expr.eq", "a == b"}, {"expr.ne", "a != b"}, {"expr.and", "a < b && b > a"}, {"expr.not", "!(a < b)"},
+		{"expr.ternary", "a < b ? a : b"}, {"expr.assign", "c = a"}, {"expr.addasi", "c += a"},
+		{"expr.inc", "++c"}, {"expr.index", "arr[2]"}, {"expr.string_add", "s + t"},
+		// Function calls
+		{"call.expression_body", "add(a, b)"}, {"call.block_body", "add_block(a, b)"},
+		{"call.lambda", "twice(a)"}, {"call.method", "p.length()"}, {"call.native", "math.abs(a)"},
+		{"call.type_ext", "arr.size"},
+		// Member lookups
+		{"dot.struct_member", "p.x"}, {"dot.namespace_member", "ns.value"}, {"dot.type_ext", "s.size"}
+	};
+	for (auto &it:expressions) {
+		cs::tree_type<cs::token_base *> tree = build_expr(context, it.second);
+		cs::instance_type *instance = context->instance.get();
+		suite.run(it.first, [instance, &tree] {
+			instance->parse_expr(tree.root());
+		});
+	}
+	cs::var add = context->instance->storage.get_var("add");
+	cs::var add_block = context->instance->storage.get_var("add_block");
+	suite.run("call.invoke", [&add] {
+		cs::invoke(add, cs::number(1), cs::number(2));
+	});
+	suite.run("call.invoke_block", [&add_block] {
+		cs::invoke(add_block, cs::number(1), cs::number(2));
+	});
+
+	// Values
+	cs::var num = cs::var::make<cs::number>(1);
+	cs::var str = cs::var::make<cs::string>("covariant script");
+	cs::var array = context->instance->storage.get_var("arr");
+	suite.run("any.make_number", [] {
+		cs::var::make<cs::number>(1);
+	});
+	suite.run("any.make_string", [] {
+		cs::var::make<cs::string>("covariant script");
+	});
+	suite.run("any.share", [&num] {
+		cs::var copy = num;
+	});
+	suite.run("any.copy_number", [&num] {
+		cs::copy(num);
+	});
+	suite.run("any.copy_string", [&str] {
+		cs::copy(str);
+	});
+	suite.run("any.copy_array", [&array] {
+		cs::copy(array);
+	});
+
+	// Scopes
+	cs::domain_manager &storage = context->instance->storage;
+	cs::var_id id("b");
+	suite.run("domain.get_var_by_name", [&storage] {
+		storage.get_var("b");
+	});
+	suite.run("domain.get_var_by_id", [&storage, &id] {
+		storage.get_var(id);
+	});
+	suite.run("domain.add_remove_scope", [&storage] {
+		storage.add_domain();
+		storage.add_var("x", cs::null_pointer);
+		storage.remove_domain();
+	});
+
+	// Containers
+	cs::array arr;
+	cs::list lst;
+	cs::hash_map map;
+	cs::var key = cs::var::make<cs::number>(42), skey = cs::var::make<cs::string>("key");
+	map[key] = num;
+	map[skey] = num;
+	suite.run("container.array_push_pop", [&arr, &num] {
+		arr.push_back(num);
+		arr.pop_back();
+	});
+	suite.run("container.list_push_pop", [&lst, &num] {
+		lst.push_back(num);
+		lst.pop_front();
+	});
+	suite.run("container.hash_map_find_number", [&map, &key] {
+		map.find(key);
+	});
+	suite.run("container.hash_map_find_string", [&map, &skey] {
+		map.find(skey);
+	});
+	suite.run("container.hash_map_insert_erase", [&map, &num] {
+		cs::var k = cs::var::make<cs::number>(7);
+		map.emplace(k, num);
+		map.erase(k);
+	});
+
+	// Compiling, collects every arena so it must come last
+	suite.run("compile.build_ast", [&corpus] {
+		cs::context_t cxt = cs::create_context({"<BENCHMARK>"});
+		std::deque<std::deque<cs::token_base *>> ast;
+		cxt->compiler->build_ast(corpus.data(), corpus.data() + corpus.size(), ast);
+		cs::collect_garbage(cxt);
+	});
+	suite.run("compile.code_gen", [&corpus] {
+		cs::context_t cxt = cs::create_context({"<BENCHMARK>"});
+		cxt->file_path = "<BENCHMARK>";
+		std::deque<cs::statement_base *> code;
+		compile(cxt, corpus, code);
+		cs::collect_garbage(cxt);
+	});
+
+	if (!output.empty()) {
+		std::ofstream out(output);
+		suite.dump_json(out);
+	}
+	else
+		suite.dump_json(std::cout);
+	statements.clear();
+	cs::collect_garbage(context);
+	return 0;
+}
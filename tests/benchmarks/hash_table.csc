@@ -0,0 +1,24 @@
+# Hash map insertion, lookup and removal with pseudo random keys
+var seed = 12345
+function next_key()
+	seed = (seed * 1103515245 + 12345) % 2147483648
+	return seed % 50000
+end
+var table = new hash_map
+for i = 0, i < 30000, ++i
+	table[next_key()] = i
+end
+var hits = 0
+for i = 0, i < 30000, ++i
+	if table.exist(next_key())
+		++hits
+	end
+end
+for i = 0, i < 10000, ++i
+	var key = next_key()
+	if table.exist(key)
+		table.erase(key)
+	end
+end
+system.out.println(hits)
+system.out.println(table.size)
@@ -0,0 +1,15 @@
+# Deep and wide recursion, dominated by function calls
+function fib(n)
+	if n < 2
+		return n
+	end
+	return fib(n - 1) + fib(n - 2)
+end
+function hanoi(n, from, to, via)
+	if n == 0
+		return 0
+	end
+	return hanoi(n - 1, from, via, to) + 1 + hanoi(n - 1, via, to, from)
+end
+system.out.println(fib(22))
+system.out.println(hanoi(14, 1, 3, 2))
@@ -0,0 +1,43 @@
+# Quicksort of pseudo random numbers, from examples/quicksort.csc
+function quicksort(a, m, n)
+	if n <= m
+		return 0
+	end
+	var i = m - 1
+	var j = n
+	var v = a[n]
+	loop
+		loop
+			++i
+			if i >= a.size
+				break
+			end
+		until a[i] >= v
+		loop
+			--j
+			if j < 0
+				break
+			end
+		until a[j] <= v
+		if i >= j
+			break
+		end
+		swap(a[i], a[j])
+	end
+	swap(a[i], a[n])
+	quicksort(a, m, j)
+	quicksort(a, i + 1, n)
+end
+var seed = 42
+var a = new array
+for i = 0, i < 10000, ++i
+	seed = (seed * 1103515245 + 12345) % 2147483648
+	a.push_back(seed % 100000)
+end
+quicksort(a, 0, a.size - 1)
+for i = 1, i < a.size, ++i
+	if a[i - 1] > a[i]
+		throw runtime.exception("not sorted")
+	end
+end
+system.out.println(a.size)
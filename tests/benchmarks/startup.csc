@@ -0,0 +1,27 @@
+# Import heavy startup, most of the time goes to compiling the generated startup_lib package
+var dir = system.is_platform_windows() ? system.getenv("TEMP") : "/tmp"
+var lib = iostream.fstream(dir + system.path.separator + "startup_lib.csp", iostream.openmode.out)
+lib.println("package startup_lib")
+foreach i in range(40)
+    lib.println("function clamp_" + to_string(i) + "(v, lo, hi)")
+    lib.println("\tif v < lo\n\t\treturn lo\n\tend")
+    lib.println("\tif v > hi\n\t\treturn hi\n\tend")
+    lib.println("\treturn v\nend")
+end
+foreach i in range(10)
+    var name = "record_" + to_string(i)
+    lib.println("struct " + name)
+    lib.println("\tvar id = 0\n\tvar name = \"\"\n\tvar tags = new array")
+    lib.println("\tfunction describe()\n\t\treturn \"" + name + ":\" + to_string(id) + \":\" + name\n\tend")
+    lib.println("\tfunction tag(t)\n\t\ttags.push_back(t)\n\t\treturn tags.size\n\tend")
+    lib.println("end")
+end
+lib.println("function total(n)\n\tvar s = 0\n\tfor i = 0, i < n, ++i")
+lib.println("\t\ts += clamp_0(i, 0, 10) + clamp_39(i, 5, 20)\n\tend\n\treturn s\nend")
+lib = null
+var startup_lib = context.import(dir, "startup_lib")
+var r = new startup_lib.record_3
+r.id = 7
+r.name = "startup"
+system.out.println(r.describe())
+system.out.println(startup_lib.total(100))
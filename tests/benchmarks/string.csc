@@ -0,0 +1,22 @@
+# String building, scanning and word counting
+var words = {"alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta"}
+var text = new string
+for i = 0, i < 20000, ++i
+	text += words[i % words.size] + " " + to_string(i % 13) + " "
+end
+var counts = new hash_map
+var word = new string
+foreach ch in text
+	if ch == ' '
+		if counts.exist(word)
+			++counts[word]
+		else
+			counts.insert(word, 1)
+		end
+		word = ""
+	else
+		word += ch
+	end
+end
+system.out.println(counts.size)
+system.out.println(text.split({' '}).size)
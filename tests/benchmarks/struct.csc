@@ -0,0 +1,42 @@
+# Struct creation, member access and method calls
+struct vector2
+	var x = 0
+	var y = 0
+	function add(v)
+		var r = new vector2
+		r.x = x + v.x
+		r.y = y + v.y
+		return r
+	end
+	function scale(k)
+		var r = new vector2
+		r.x = x * k
+		r.y = y * k
+		return r
+	end
+	function dot(v)
+		return x * v.x + y * v.y
+	end
+end
+struct particle
+	var position = new vector2
+	var velocity = new vector2
+	function step(dt)
+		position = position.add(velocity.scale(dt))
+	end
+end
+var particles = new array
+for i = 0, i < 200, ++i
+	var p = new particle
+	p.velocity.x = i % 7
+	p.velocity.y = i % 5
+	particles.push_back(p)
+end
+var energy = 0
+for t = 0, t < 50, ++t
+	foreach p in particles
+		p.step(0.1)
+		energy += p.velocity.dot(p.velocity)
+	end
+end
+system.out.println(energy)
@@ -0,0 +1,21 @@
+# Expressions built at runtime release their tokens once they are dropped
+function token_nodes()
+    return runtime.stats().ast_nodes.token
+end
+var x = 2
+var expr = context.build("x * 3 + 1")
+if context.solve(expr) != 7
+    throw runtime.exception("Wrong result of a built expression")
+end
+var base = token_nodes()
+foreach i in range(1000)
+    expr = context.build("x * " + to_string(i) + " + 1")
+    if context.solve(expr) != x * i + 1
+        throw runtime.exception("Wrong result of a built expression")
+    end
+end
+# Only the tokens of the last expression are still held
+if token_nodes() - base > 16
+    throw runtime.exception("Tokens of dropped expressions are not released: " + to_string(token_nodes() - base))
+end
+system.out.println("compile_unit: ok")
@@ -0,0 +1,58 @@
+#include <covscript/covscript.hpp>
+#include <iostream>
+
+static int failures = 0;
+
+static void check(const cs::context_t &context, const std::string &expr, cs::number expected)
+{
+	cs::number result = cs::eval(context, expr).const_val<cs::number>();
+	if (result != expected) {
+		std::cerr << "Failed: " << expr << " gives " << result << ", expected " << expected << std::endl;
+		++failures;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc <= 1)
+		return -1;
+	cs::prepend_import_path(argv[1], cs::current_process);
+	cs::context_t origin = cs::create_context({argv[1]});
+	origin->instance->compile(argv[1]);
+	origin->instance->interpret();
+	{
+		cs::context_pool pool(origin);
+		// Every tenant starts over from the origin, package functions included
+		for (int i = 0; i < 3; ++i) {
+			cs::context_t context = pool.acquire();
+			check(context, "counter.inc()", 1);
+			check(context, "hit()", 1);
+			check(context, "settings.value += 1", 2);
+			pool.release(context);
+		}
+		// Package functions and namespace members of a fork see the same copy
+		cs::context_t context = pool.acquire();
+		check(context, "counter.inc()", 1);
+		check(context, "counter.n", 1);
+		check(context, "counter.inc()", 2);
+		check(context, "counter.n", 2);
+		check(context, "hit()", 1);
+		check(context, "hits", 1);
+		// Forks in use at the same time do not see each other
+		cs::context_t other = pool.acquire();
+		check(other, "counter.inc()", 1);
+		check(context, "counter.n", 2);
+		check(other, "counter.n", 1);
+		pool.release(other);
+		pool.release(context);
+	}
+	cs::context_t context = cs::fork_context(origin);
+	check(context, "counter.inc()", 1);
+	cs::collect_garbage(context);
+	check(origin, "counter.n", 0);
+	check(origin, "hits", 0);
+	check(origin, "settings.value", 1);
+	check(origin, "counter.inc()", 1);
+	cs::collect_garbage(origin);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+import counter
+var hits = 0
+function hit()
+    ++hits
+    return hits
+end
+namespace settings
+    var value = 1
+end
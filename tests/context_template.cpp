@@ -0,0 +1,50 @@
+#include <covscript/covscript.hpp>
+#include <iostream>
+
+static int failures = 0;
+
+static void check(bool cond, const std::string &what)
+{
+	if (!cond) {
+		std::cerr << "Failed: " << what << std::endl;
+		++failures;
+	}
+}
+
+static cs::context_t run_script(const std::string &path)
+{
+	cs::context_t context = cs::create_context({path});
+	context->instance->compile(path);
+	context->instance->interpret();
+	return context;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc <= 1)
+		return -1;
+	// Contexts copy the grammar and builtins of the template, releasing them must leave the template intact
+	std::size_t token_nodes = 0, statement_nodes = 0;
+	for (int i = 0; i < 3; ++i) {
+		cs::context_t context = run_script(argv[1]);
+		check(cs::eval(context, "test(4)").const_val<cs::number>() == 10, "script result before collection");
+		check(cs::eval(context, "twice(2) + ([](x) -> x + 1)(1)").const_val<cs::number>() == 6, "lambda result");
+		cs::collect_garbage(context);
+		cs::collect_garbage();
+		// Units declaring lambdas are released with their context as well
+		cs::runtime_stats stats = cs::get_runtime_stats();
+		if (i > 0)
+			check(stats.token_nodes == token_nodes && stats.statement_nodes == statement_nodes, "released units");
+		token_nodes = stats.token_nodes;
+		statement_nodes = stats.statement_nodes;
+	}
+	// Grammar tokens are retained by the arenas, so a new context still compiles after every collection
+	cs::context_t context = run_script(argv[1]);
+	check(cs::eval(context, "test(100)").const_val<cs::number>() == 5050, "script result after collection");
+	check(cs::eval(context, "words.size").const_val<cs::number>() == 2, "string and array extensions");
+	check(cs::eval(context, "to_string(math.abs(-1)) + type(range(1))").const_val<cs::string>() == "1cs::range",
+	      "builtin functions");
+	check(cs::eval(context, "context.cmd_args[0]").const_val<cs::string>() == argv[1], "context of its own");
+	cs::collect_garbage(context);
+	return failures == 0 ? 0 : 1;
+}
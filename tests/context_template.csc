@@ -0,0 +1,9 @@
+function test(n)
+    var sum = 0
+    foreach i in range(n + 1)
+        sum += i
+    end
+    return sum
+end
+var words = "covariant script".split({' '})
+var twice = [](x) -> x * 2
@@ -0,0 +1,38 @@
+# Counted for loops take a fast path that must behave like the generic condition
+function check(value, expected, what)
+    if value != expected
+        throw runtime.exception("Wrong result of " + what + ": " + to_string(value))
+    end
+end
+var n = 10
+var count = 0
+for i = 0, i < n - 1, ++i
+    ++count
+end
+check(count, 9, "flattened bound")
+count = 0
+for i = n * 2, i >= n / 2 + 1, --i
+    ++count
+end
+check(count, 15, "flattened bound with a decrement")
+count = 0
+for i = 0, i + 1 < n * 2, ++i
+    ++count
+end
+check(count, 19, "flattened condition without an iterator on the left")
+count = 0
+for i = 0, i <= n - 1 - count, ++i
+    ++count
+end
+check(count, 5, "bound reevaluated on every iteration")
+count = 0
+for i = 0, i < -n + 2 * n - 5, i += 2
+    ++count
+end
+check(count, 3, "flattened bound with another step")
+var s = ""
+for c = "", c.size < 3 - 0 * 1, c += "x"
+    s += c
+end
+check(s, "xxx", "non-numeric condition")
+system.out.println("Counted loop test passed")
@@ -0,0 +1,59 @@
+# Runs a small program under --coverage and checks the lcov records
+var source = iostream.fstream("./coverage_target.csc", iostream.openmode.out)
+source.println("function twice(x)")
+source.println("    return x * 2")
+source.println("end")
+source.println("var sum = 0")
+source.println("foreach i in range(5)")
+source.println("    if i % 2 == 0")
+source.println("        sum += twice(i)")
+source.println("    end")
+source.println("end")
+source.println("for j = 0, j < 3, ++j")
+source.println("    sum += j")
+source.println("end")
+source.println("var k = 0")
+source.println("while k < 2")
+source.println("    ++k")
+source.println("end")
+source.println("loop")
+source.println("    --k")
+source.println("until k == 0")
+source.println("foreach key in {0, 1, 5}")
+source.println("    switch key")
+source.println("        case 0")
+source.println("            ++k")
+source.println("        end")
+source.println("        case 1")
+source.println("            ++k")
+source.println("        end")
+source.println("        default")
+source.println("            --k")
+source.println("        end")
+source.println("    end")
+source.println("end")
+source = null
+system.run("cs --coverage=./coverage_target.info ./coverage_target.csc")
+var records = new hash_map
+var lcov = iostream.fstream("./coverage_target.info", iostream.openmode.in)
+while !lcov.eof()
+    var line = lcov.getline()
+    if line.find("DA:", 0) == 0 || line.find("BRDA:", 0) == 0
+        records.insert(line, true)
+    end
+end
+# The expression-bodied function runs three times, loops count every evaluation of their condition
+var expects = {"DA:2,3", "DA:6,5", "DA:7,3", "BRDA:6,0,0,3", "BRDA:6,0,1,2", "BRDA:10,0,0,3", "BRDA:10,0,1,1"}
+foreach it in {"BRDA:14,0,0,2", "BRDA:14,0,1,1", "BRDA:17,0,0,1", "BRDA:17,0,1,1", "BRDA:21,0,0,2", "BRDA:21,0,1,1"}
+    expects.push_back(it)
+end
+foreach expect in expects
+    if !records.exist(expect)
+        throw runtime.exception("Missing coverage record " + expect)
+    end
+end
+lcov = null
+system.file.remove("./coverage_target.csc")
+system.file.remove("./coverage_target.info")
+system.file.remove("./coverage_target.info.hot")
+system.out.println("coverage: ok")
@@ -0,0 +1,38 @@
+# Conditional breakpoints in an imported package see the locals of that package
+var pkg = iostream.fstream("./debugger_pkg.csp", iostream.openmode.out)
+pkg.println("package debugger_pkg\nfunction sum(n)\n    var s = 0\n    foreach i in range(n)")
+pkg.println("        s += i\n    end\n    return s\nend")
+pkg = null
+var target = iostream.fstream("./debugger_target.csc", iostream.openmode.out)
+target.println("import debugger_pkg\nsystem.out.println(debugger_pkg.sum(5))")
+target = null
+var commands = iostream.fstream("./debugger_commands.txt", iostream.openmode.out)
+commands.println("break debugger_pkg.csp:5 if i == 3\nrun\nprint s + i * 100\ncontinue\nquit")
+commands = null
+system.run("cs_dbg ./debugger_target.csc < ./debugger_commands.txt > ./debugger_output.txt")
+var output = iostream.fstream("./debugger_output.txt", iostream.openmode.in)
+var lines = new array
+while output.good() && !output.eof()
+    lines.push_back(output.getline())
+end
+output = null
+# Files are removed before anything is checked, so a failed check leaves nothing behind
+foreach file in {"./debugger_pkg.csp", "./debugger_target.csc", "./debugger_commands.txt", "./debugger_output.txt"}
+    system.file.remove(file)
+end
+var hits = 0, printed = false
+foreach line in lines
+    if line.find("condition failed", 0) != -1
+        throw runtime.exception("Breakpoint condition failed: " + line)
+    end
+    if line.find("Hit breakpoint", 0) != -1
+        ++hits
+    end
+    if line == "> 303"
+        printed = true
+    end
+end
+if hits != 1 || !printed
+    throw runtime.exception("Conditional breakpoint stopped " + to_string(hits) + " times")
+end
+system.out.println("debugger: ok")
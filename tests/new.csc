@@ -8,3 +8,15 @@ end
 a=gcnew foo
 ++a->a
 system.out.println((*a).a)
+struct point
+    var x=1
+    var y=x+1
+end
+function make(x)
+    return new x
+end
+system.out.println(make(point).y)
+function make_gc(x)
+    return gcnew x
+end
+system.out.println(make_gc(point)->y)
@@ -0,0 +1,35 @@
+var square = [](x)->x*x
+var sum = [](a, b)->a + b
+system.out.println(runtime.parallel_for(range(1, 101), square, sum))
+system.out.println(runtime.parallel_for({1, 2, 3, 4, 5, 6, 7}, square, sum, 3))
+var words = runtime.parallel_for({"a", "b", "c", "d"}, [](s)->{s + s}, [](a, b)->(a.push_back(b[0]), a))
+system.out.println(words)
+# Chunks run in worker processes, writes to outer variables do not leak whatever the worker count is
+var hits = 0
+function count_hit(x)
+    ++hits
+    return x
+end
+runtime.parallel_for({1, 2, 3, 4}, count_hit, sum, 1)
+runtime.parallel_for({1, 2, 3, 4}, count_hit, sum, 4)
+runtime.parallel_for({1}, count_hit, sum)
+system.out.println("hits: " + hits)
+# Results which can not cross a process are rejected on every path
+struct point
+    var x = 1
+end
+foreach workers in {1, 2}
+    try
+        runtime.parallel_for({1, 2}, [](x)->new point, [](a, b)->a, workers)
+    catch e
+        system.out.println(e.what)
+    end
+end
+foreach workers in {0, 1.5}
+    try
+        runtime.parallel_for({1, 2}, square, sum, workers)
+    catch e
+        system.out.println(e.what)
+    end
+end
+system.out.println(runtime.parallel_for({1, 2, 3}, square, sum, 10^30))
@@ -0,0 +1,24 @@
+var evens = runtime.from(range(1, 100)).filter([](x)->x % 2 == 0)
+system.out.println(evens.map([](x)->x*x).take(5).to_array())
+system.out.println(evens.skip(10).take(3).reduce([](a, b)->a + b, 0))
+system.out.println(runtime.from({3, 1, 4, 1, 5, 9, 2, 6}).take_while([](x)->x < 9).count())
+runtime.from("Hello").map([](c)->c.toupper()).for_each([](c)->system.out.print(c))
+system.out.println("")
+var pulls = 0
+function pull(x)
+    ++pulls
+    return x
+end
+system.out.println(runtime.from(range(10)).map(pull).take(0).to_array())
+system.out.println(runtime.from(range(10)).map(pull).take(2).count())
+system.out.println("pulls: " + pulls)
+var outfs = iostream.fstream("./pipeline.txt", iostream.openmode.out)
+foreach line in {"1", "2", "3", "4"} do outfs.println(line)
+outfs = null
+var infs = iostream.fstream("./pipeline.txt", iostream.openmode.in)
+system.out.println(runtime.from(infs).take(1).filter([](x)->x == "0").count())
+system.out.println(runtime.from(infs).take(1).skip(1).count())
+system.out.println("next: " + infs.getline())
+infs = null
+system.file.remove("./pipeline.txt")
+system.out.println(runtime.from(range(3)).take(10^30).skip(10^30).count())
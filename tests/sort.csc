@@ -0,0 +1,17 @@
+var arr = {5, -3, 8, 0, 2.5, -7, 8}
+arr.sort()
+system.out.println(arr)
+var names = {"pear", "apple", "fig", "banana"}
+names.sort_by([](s)->s.size)
+system.out.println(names)
+names.sort()
+system.out.println(names)
+var big = new array
+foreach i in range(1000)
+    big.push_back((i * 7919) % 1000 - 500)
+end
+big.sort()
+system.out.println(to_string(big.front) + ", " + big.back)
+var lst = {3, 1, 2}.to_list()
+lst.sort([](a, b)->a > b)
+system.out.println(lst)
@@ -0,0 +1,57 @@
+# Operators specialized by the type inference must behave like the generic ones
+function check(value, expected, what)
+    if value != expected
+        throw runtime.exception("Wrong result of " + what + ": " + to_string(value))
+    end
+end
+function retype()
+    n = "text"
+end
+function specialized()
+    var s = ""
+    var arr = {1, 2, 3}
+    var sum = 0
+    for i = 0, i < 4, ++i
+        s += "ab"
+        s += 'c'
+        s += i
+        sum = sum + arr[i % 3] + arr.size
+    end
+    check(s, "abc0abc1abc2abc3", "string append")
+    check(sum, 19, "number add")
+    # Out of range and negative indexes go through the generic access
+    check(arr[-1], 3, "negative index")
+    arr[5] = 6
+    check(arr.size, 6, "growing array")
+    check(arr[4], 0, "padded element")
+    # Callees see the locals of their caller
+    var n = 1
+    retype()
+    check(n + "!", "text!", "add after a call")
+    # Links and pointers share the value with another name
+    var m = 1
+    link l = m
+    l = "linked"
+    check(m + 1, "linked1", "add through a link")
+    var k = 1
+    var p = &k
+    *p = "pointer"
+    check(k + 1, "pointer1", "add through a pointer")
+    # Facts from branches are merged
+    var b = 0
+    if sum > 0
+        b = "branch"
+    end
+    check(b + 2, "branch2", "add after a branch")
+    var w = 0
+    while w < 3
+        if w == 2
+            w = "done"
+            break
+        end
+        w = w + 1
+    end
+    check(w + 0, "done0", "add after a loop")
+end
+specialized()
+system.out.println("type_inference: ok")